@@ -0,0 +1,82 @@
+#ifndef COMPILED_DFA_H
+#define COMPILED_DFA_H
+
+#include <vector>
+#include "dfa_class.h"
+
+// Runtime form of a (minimized) DFA for matching. All transitions are in one state-major array and states
+// are given by "cells": cell of state s is s * stride + acc(s). The row of s starts at its cell, so
+// delta(s, a) is table[cell + a] -- one add and one load per symbol, without masks or other arrays.
+// stride is even and > alphabet_length, so the lowest bit of a cell is the acc tag and rows of acc states
+// (shifted by one) still fit in their strides.
+//
+//   CompiledDFA compiled(dfa);
+//   compiled.check(word, length);
+//   compiled.save("dfa.cmp"); ... other.load("dfa.cmp");
+class CompiledDFA {
+
+private:
+    uint32_t alphabet_length=0;
+    uint32_t stride=0;
+    uint32_t start_cell=0;
+    table_vector<uint32_t> table={};
+
+public:
+    static const uint32_t ACC_TAG = 1;
+
+    CompiledDFA() {}
+
+    // works with any DFA, but a minimized one gives the smallest table; size * stride must be < 2^32,
+    // otherwise the table stays empty and ok() is false
+    explicit CompiledDFA(const DFA& dfa);
+
+    // false if the DFA was too big (or nothing is compiled/loaded yet); check must not be called then
+    bool ok() const {
+        return this->stride != 0;
+    }
+
+    uint32_t get_start_cell() const {
+        return this->start_cell;
+    }
+
+    uint32_t step(uint32_t cell, uint32_t symbol) const {
+        return this->table[cell + symbol];
+    }
+
+    static bool is_acc(uint32_t cell) {
+        return (cell & ACC_TAG) != 0;
+    }
+
+    // symbols must be < alphabet_length
+    bool check(const uint32_t* word, size_t length) const {
+        // column = table + word[i] doesn't depend on the previous step, so only the load (column[cell]) is on
+        // the chain of steps; the empty asm keeps the compiler from turning it back into table[cell + word[i]]
+        const uint32_t* table_data = this->table.data();
+        uint32_t cell = this->start_cell;
+        for (size_t i = 0; i < length; ++i) {
+            const uint32_t* column = table_data + word[i];
+            asm("" : "+r"(column));
+            cell = column[cell];
+        }
+        return is_acc(cell);
+    }
+
+    bool check_string(const std::vector<uint32_t>& word) const {
+        return check(word.data(), word.size());
+    }
+
+    uint32_t get_alphabet_length() const {
+        return this->alphabet_length;
+    }
+
+    uint32_t get_size() const {
+        return (this->stride == 0 ? 0 : (uint32_t)(this->table.size() / this->stride));
+    }
+
+    // binary file: alphabet_length, stride, start_cell, number of cells, then the table (native byte order);
+    // both return 0 on success, 1 if the file couldn't be written/read or is incorrect
+    int save(const char* filename) const;
+    int load(const char* filename);
+};
+
+#endif
@@ -7,9 +7,17 @@
 #include <vector>
 #include <cassert>
 #include <queue>
+#include <deque>
+#include <algorithm>
+#include <functional>
 #include <unordered_map>
 #include <cassert>
 #include <chrono>
+#include <atomic>
+#include <memory>
+#include "table_allocator.h"
+
+class PerfReport; // see perf_counters.h
 
 struct request_check{
     bool accepted;
@@ -32,90 +40,291 @@ struct StateInfo {
     uint32_t prev_state_of_same_block=EMPTY_STATE; // number of the next state of the same color
 };
 
-class DFA{
+// how acc states of product of 2 DFAs are chosen
+enum class ProductType {
+    INTERSECTION, // acc in both
+    UNION, // acc in at least one
+    DIFFERENCE // acc in first, rej in second
+};
+
+// orders of states for renumbering (see dfa_layout.cpp)
+enum class StateOrder {
+    BFS, // BFS from starting node
+    DFS, // DFS (preorder) from starting node
+    HOTNESS // the most visited states on sample words first
+};
+
+// what is a splitter in Hopcroft's algorithm
+enum class RefinementMode {
+    SYMBOL, // pair (symbol, block): B_cap lists are kept for all of them
+    BLOCK // block for all symbols at once: its reversed transitions are read in one pass and grouped by symbols
+};
+
+// order in which splitters are taken from L
+enum class QueuePolicy {
+    FIFO,
+    LIFO,
+    SMALLEST_FIRST // the smallest splitter (by its size when it was pushed)
+};
+
+// L of Hopcroft's algorithm with the chosen order
+class SplitterQueue {
 
 private:
-    uint32_t alphabet_length=0; // length of the alphabet
-    uint32_t size=0; // number of states in DFA
-    std::vector<std::vector<uint32_t> > delta; // delta function
-    std::vector<bool> acc;
-    uint32_t starting_node=0;
+    QueuePolicy policy=QueuePolicy::FIFO;
+    std::deque<uint32_t> items={};
+    std::vector<std::pair<uint32_t, uint32_t> > heap={}; // (size, splitter) for SMALLEST_FIRST
 
-    std::vector<StateInfo> states_info={}; // information about colors and acc/rej of all states
+public:
+    void set_policy(QueuePolicy _policy) {
+        this->policy = _policy;
+    }
 
-    std::vector<uint32_t> block2first_state_in_it={}; // if we color states we need to remember index of first state of each color
-    std::vector<std::vector<uint32_t> > block_and_char2first_B_cap={};
+    bool empty() const {
+        return this->items.empty() && this->heap.empty();
+    }
 
-    std::vector<std::vector<bool> > info_L = {};
-    std::queue<std::pair<uint32_t, uint32_t> > L={};
+    void push(uint32_t splitter, uint32_t splitter_size) {
+        if (this->policy == QueuePolicy::SMALLEST_FIRST) {
+            this->heap.push_back({splitter_size, splitter});
+            std::push_heap(this->heap.begin(), this->heap.end(), std::greater<std::pair<uint32_t, uint32_t> >());
+        } else {
+            this->items.push_back(splitter);
+        }
+    }
 
-    // for each char a in alphabet if state is reachable by a then we need
-    // to know the next state of same color which is also reachable by a
-    std::vector<std::vector<uint32_t> > next_B_cap={};
+    uint32_t pop() {
+        uint32_t splitter;
+        if (this->policy == QueuePolicy::SMALLEST_FIRST) {
+            std::pop_heap(this->heap.begin(), this->heap.end(), std::greater<std::pair<uint32_t, uint32_t> >());
+            splitter = this->heap.back().second;
+            this->heap.pop_back();
+        } else if (this->policy == QueuePolicy::LIFO) {
+            splitter = this->items.back();
+            this->items.pop_back();
+        } else {
+            splitter = this->items.front();
+            this->items.pop_front();
+        }
+        return splitter;
+    }
 
-    // for each char a in alphabet if state is reachable by a then we need
-    // to know the previous state of same color which is also reachable by a
-    std::vector<std::vector<uint32_t> > prev_B_cap={};
+    size_t size() const {
+        return this->items.size() + this->heap.size();
+    }
 
-    // all this is used for reversed_delta
-    std::vector<std::vector<uint32_t> > addresses_for_reversed_delta = {}; // each element <= n*I
-    std::vector<uint32_t> reversed_delta={}; // each element <= n
+    // frees the memory too
+    void clear() {
+        std::deque<uint32_t>().swap(this->items);
+        std::vector<std::pair<uint32_t, uint32_t> >().swap(this->heap);
+    }
+};
 
-    std::vector<std::vector<uint32_t> > B_cap_lengths = {};
+// result of one call of DFA::minimization_step
+enum class MinimizationStatus {
+    DONE, // DFA is minimized
+    PAUSED, // the budget of the call is used, next call goes on
+    CANCELLED // refinement is dropped, DFA is not changed (except trimming)
+};
 
-    std::vector<uint32_t> sep_blocks={}; // Blocks to separate
-    std::vector<uint32_t> sep_states={}; // states which should be separated from the blocks they are in (states, which will change their block)
+// limits of one call of DFA::minimization_step (0: no limit)
+struct MinimizationBudget {
+    double seconds;
+    uint64_t iterations; // splitters taken from L
+};
 
-    std::vector<uint32_t> block_lengths={};
+// the partition has `blocks` blocks of `states` states now (blocks == states: nothing to merge)
+struct MinimizationProgress {
+    uint32_t blocks; // 0 if refinement isn't started yet
+    uint32_t states;
+    uint64_t queue_length; // splitters in L
+    uint32_t iterations;
+};
+
+class DFA{
+
+    friend class DictionaryBuilder; // it builds minimal DFAs directly
+
+private:
+    uint32_t alphabet_length=0; // length of the alphabet
+    uint32_t size=0; // number of states in DFA
+    std::vector<table_vector<uint32_t> > delta; // delta function
+    std::vector<bool> acc;
+    std::vector<uint32_t> labels={}; // outputs of states (Moore machine), empty if DFA only accepts/rejects; acc[s] is labels[s] != 0
+    uint32_t starting_node=0;
+
+    table_vector<StateInfo> states_info={}; // information about colors and acc/rej of all states
+
+    table_vector<uint32_t> block2first_state_in_it={}; // if we color states we need to remember index of first state of each color
+
+    // reversed delta is stored only for "incoming pairs" (a, s): s has at least one incoming transition by a.
+    // Pairs of state s are pair_begin[s], ..., pair_begin[s + 1] - 1 (sorted by symbol), pair_symbol[p] is a of pair p;
+    // states t such as delta(t, a) = s are reversed_delta[reversed_begin[p]], ..., reversed_delta[reversed_begin[p + 1] - 1].
+    // So all of this takes O(transitions) memory, not O(alphabet_length * size)
+    table_vector<uint32_t> pair_begin={}; // size + 1 elements
+    table_vector<uint32_t> pair_symbol={};
+    table_vector<uint32_t> reversed_begin={}; // pairs + 1 elements
+    table_vector<uint32_t> reversed_delta={}; // each element <= n
+
+    // B_cap(B, a) is the list of pairs (a, s) with s in block B. They are created only for nonempty B_cap(B, a)
+    // and have their own indexes (empty ones are reused), so we don't need alphabet_length * size tables for them
+    table_vector<uint32_t> B_cap_first={}; // first pair of B_cap
+    table_vector<uint32_t> B_cap_lengths={};
+    table_vector<uint32_t> B_cap_symbol={};
+    table_vector<uint32_t> B_cap_next_of_block={}; // B_caps of one block are in a list too
+    table_vector<char> B_cap_in_L={};
+    table_vector<uint32_t> free_B_caps={};
+    table_vector<uint32_t> block_first_B_cap={};
+
+    // for each incoming pair the next and the previous pair of the same B_cap
+    table_vector<uint32_t> next_B_cap={};
+    table_vector<uint32_t> prev_B_cap={};
+
+    // symbol --> B_cap of the block which is being changed now (EMPTY_STATE if there is no such B_cap)
+    table_vector<uint32_t> old_B_cap_of_symbol={};
+    table_vector<uint32_t> new_B_cap_of_symbol={};
+
+    RefinementMode refinement_mode=RefinementMode::SYMBOL;
+    SplitterQueue L={}; // B_caps (or blocks in BLOCK mode) which will be splitters
+    table_vector<char> block_in_L={}; // for BLOCK mode
+    uint32_t iterations=0; // number of splitters taken from L by the last minimization
+    uint32_t prepartition_rounds=0; // rounds of refine_by_signatures before Hopcroft's algorithm
+    bool acyclic_fast_path=true; // acyclic DFAs are minimized by levels (see dfa_acyclic.cpp)
+    bool unary_fast_path=true; // DFAs with one symbol are minimized by the period of the cycle (see dfa_unary.cpp)
+    bool arena_mode=false; // tables of refinement are taken from one arena (see table_allocator.h)
+    PerfReport* perf_report=nullptr; // phases of minimization are profiled if it is set
+
+    // for BLOCK mode: sources of transitions to the splitter block, grouped by symbols
+    table_vector<uint32_t> symbol_sources_begin={};
+    table_vector<uint32_t> splitter_sources={};
+
+    table_vector<uint32_t> sep_blocks={}; // Blocks to separate
+    table_vector<uint32_t> sep_states={}; // states which should be separated from the blocks they are in (states, which will change their block)
+    table_vector<uint32_t> sorted_sep_states={}; // sep_states grouped by blocks
+    table_vector<bool> is_sep_state={}; // is_sep_state[s] is true if s is in sep_states
+
+    table_vector<uint32_t> block_lengths={};
 
     bool deleted_unreachable_states = false;
+    bool trimmed_states = false;
     bool constructed_reversed_delta = false;
     bool minimized = false;
+    bool refining = false; // minimization_step stopped in the middle of Hopcroft's iterations
+    // shared_ptr which isn't copied: a copy of DFA copies the tables of a paused minimization to the heap
+    // and doesn't share the arena with the original
+    struct UnsharedArena : std::shared_ptr<TableArena> {
+        using std::shared_ptr<TableArena>::operator=;
+        UnsharedArena() = default;
+        UnsharedArena(const UnsharedArena&) : std::shared_ptr<TableArena>() {}
+        UnsharedArena(UnsharedArena&&) = default;
+        UnsharedArena& operator=(UnsharedArena&&) = default;
+    };
+    UnsharedArena refinement_arena={}; // arena of the started minimization (in arena mode)
 
     struct info {
         uint32_t states2extract;
         uint32_t new_color;
+        bool extract_sep_states; // false if other states of the block were moved to new_color instead
+        uint32_t sep_states_begin; // place of its sep_states in sorted_sep_states
     };
 
     std::unordered_map<uint32_t, info> blocks_info;
 
     uint32_t colors=0;
 
-    uint32_t next_address_for_reversed_delta(const uint32_t& a, const uint32_t& state) {
-        assert(a < this->alphabet_length && state < this->size);
-        if (state < this->size - 1) { 
-            return addresses_for_reversed_delta[a][state + 1];
-        } else if (a < this->alphabet_length - 1) {
-            return addresses_for_reversed_delta[a + 1][0];
-        } else { // (a, state) is the last pair
-            return this->alphabet_length * this->size;
-        }
-    }
+    // sep_state has a transition to the splitter
+    void add_sep_state(const uint32_t sep_state);
 
-    uint32_t get_reversed_delta_length(const uint32_t& a, const uint32_t& state) {
-        return next_address_for_reversed_delta(a, state) - addresses_for_reversed_delta[a][state];
-    }
+    // splits blocks by sep_states and updates L
+    void split_blocks();
+
+    // new B_cap (a, block) which is added to the list of B_caps of the block
+    uint32_t create_B_cap(const uint32_t a, const uint32_t block);
+
+    // fills old_B_cap_of_symbol by B_caps of the block (empty B_caps which are not in L are deleted here)
+    void collect_B_caps_of_block(const uint32_t block);
+    void forget_B_caps_of_block(const uint32_t block, table_vector<uint32_t>& B_cap_of_symbol);
+
+    // frees reversed delta (it's not correct after changing delta) and lists of refinement (except blocks of states)
+    void forget_reversed_delta();
+    void forget_refinement();
 
     void extract_state_to_new_block(const uint32_t s, const uint32_t new_block);
 
+    // splits blocks of states_info (colors of them) by hashes of blocks of successors, at most `rounds` times
+    // (see dfa_prepartition.cpp); equivalent states stay in one block
+    void refine_by_signatures(uint32_t rounds);
+
+    // linear minimization of trimmed DFA without cycles (except uniform states like the sink);
+    // returns false if there are cycles, then nothing is changed
+    bool minimize_acyclic(bool debug);
+
+    // linear minimization of trimmed DFA with alphabet_length == 1 (tail and cycle);
+    // returns false for other alphabets, then nothing is changed
+    bool minimize_unary(bool debug);
+
+    // stages of minimization before and after Hopcroft's iterations;
+    // start returns true if DFA is already minimized (it is small or a fast path worked)
+    bool start_minimization(bool debug);
+    void finish_minimization(bool debug);
+
+    // builds only pairs of states reachable from the pair of starting nodes
+    DFA product(const DFA& other, ProductType type) const;
+
+    // states in BFS or DFS order from starting node (unreachable states at the end)
+    std::vector<uint32_t> traversal_order(StateOrder order) const;
+
 
 public:
     void init(uint32_t _alphabet_length, uint32_t _size, uint32_t _starting_node, std::vector<std::vector<uint32_t> > &table, std::vector<bool> &v_acc);
 
+    // takes the tables (nothing is copied)
+    void init(uint32_t _alphabet_length, uint32_t _size, uint32_t _starting_node, std::vector<table_vector<uint32_t> > &&table, std::vector<bool> &&v_acc);
+
+    // rows of table are copied one by one and freed, so only one extra row is in memory at any time
+    void init(uint32_t _alphabet_length, uint32_t _size, uint32_t _starting_node, std::vector<std::vector<uint32_t> > &&table, std::vector<bool> &&v_acc);
+
+    // tables from memory which DFA doesn't own (for example, a mapped file): table is alphabet_length * size numbers
+    // (table[a * size + s] is delta(s, a)), bit s % 8 of acc_bits[s / 8] is acc of s (like in save_to_file).
+    // They are read once directly into delta, there are no temporary tables
+    void init(uint32_t _alphabet_length, uint32_t _size, uint32_t _starting_node, const uint32_t* table, const uint8_t* acc_bits);
+
     void print_table() const;
 
     bool check_string(std::vector<uint32_t> &str) const;
 
+    // label of the state after reading str (0 or 1 if DFA has no labels)
+    uint32_t classify_string(std::vector<uint32_t> &str) const;
+
+    // labels of states: 0 means rejecting, others are accepting (for example, token IDs of a tokenizer).
+    // Minimization starts from one block for each label, so states with different labels are never merged
+    void set_labels(const std::vector<uint32_t> &_labels);
+    void set_labels(std::vector<uint32_t> &&_labels);
+
     // we can delete unreachable states (for example, at the start of the algorithm)
     void delete_unreachable_states();
 
+    // deletes unreachable states and merges dead states (which can't reach acc states) into one sink;
+    // searches and renumbering run in `threads` threads (see dfa_trim.cpp)
+    void trim_states(uint32_t threads);
+
+    // gives states new numbers for locality of delta (starting node becomes 0 for BFS/DFS);
+    // samples are used only by HOTNESS
+    void renumber_states(StateOrder order, const std::vector<std::vector<uint32_t> >& samples = {});
+
+
+    // threads are used only for big DFAs (the result is the same), see construct_reversed_delta_parallel
+    void construct_reversed_delta(uint32_t threads = 1);
 
-    void construct_reversed_delta();
+    // per-thread histograms of targets for contiguous ranges of transitions, prefix sums and a stable scatter;
+    // threads * size counters are kept for the scatter, so threads <= alphabet_length
+    void construct_reversed_delta_parallel(uint32_t threads);
 
 
     // When starting we might try to color all states in to colors:
     // acceptable states in one color, rejectable - in another
     // acc is 0; rej is 1
+    // (with labels: one color for each label, in order of the first state with it)
     void color_acc_and_rej_in_2_colors();
 
     // true, if algorithm terminates
@@ -124,6 +333,53 @@ public:
 
     void minimization(bool no_debug);
 
+    // Time-sliced minimization: goes on from where the previous call stopped until DFA is minimized or the budget
+    // is used. Stages before Hopcroft's iterations (trimming, reversed delta, fast paths) are not split.
+    // The budget and cancel are checked between iterations; after CANCELLED the next call starts again.
+    // progress (if it is set) is called at the end of every call
+    MinimizationStatus minimization_step(const MinimizationBudget& budget, const std::function<void(const MinimizationProgress&)>& progress = nullptr,
+                                         const std::atomic<bool>* cancel = nullptr);
+
+    // drops started minimization (nothing if it isn't started)
+    void cancel_minimization();
+
+    MinimizationProgress get_minimization_progress() const;
+
+    void set_refinement(RefinementMode mode, QueuePolicy policy) {
+        this->refinement_mode = mode;
+        this->L.set_policy(policy);
+    }
+
+    // Hopcroft's algorithm starts from the partition after `rounds` rounds of signature hashing (0: labels only);
+    // it has less splitters to process, the result is the same
+    void set_prepartition(uint32_t rounds) {
+        this->prepartition_rounds = rounds;
+    }
+
+    // if it is off, acyclic DFAs are minimized by Hopcroft's algorithm too
+    void set_acyclic_fast_path(bool on) {
+        this->acyclic_fast_path = on;
+    }
+
+    // if it is off, unary DFAs are minimized by Hopcroft's algorithm too
+    void set_unary_fast_path(bool on) {
+        this->unary_fast_path = on;
+    }
+
+    // in arena mode minimization frees all its tables at once at the end
+    void set_arena_mode(bool on) {
+        this->arena_mode = on;
+    }
+
+    // counters of phases of minimization go to report (nullptr: no profiling)
+    void set_perf_report(PerfReport* report) {
+        this->perf_report = report;
+    }
+
+    uint32_t get_iterations() const noexcept {
+        return this->iterations;
+    }
+
     void print_current_classes_of_equality() const;
 
     uint32_t get_size() const noexcept {
@@ -138,20 +394,101 @@ public:
         return this->starting_node;
     }
 
+    uint32_t get_transition(const uint32_t a, const uint32_t state) const {
+        return this->delta[a][state];
+    }
+
+    bool is_accepting(const uint32_t state) const {
+        return this->acc[state];
+    }
+
+    bool has_labels() const noexcept {
+        return !this->labels.empty();
+    }
+
+    uint32_t get_label(const uint32_t state) const {
+        return (this->labels.empty() ? (uint32_t)this->acc[state] : this->labels[state]);
+    }
+
     int save_to_file(char* filename) const;
 
+    // binary format of save_to_file; returns 0 on success, 1 if the file couldn't be read or is incorrect
+    int load_from_bin_file(const char* filename);
+
+    // edge-list text format (see text_format.h); file is parsed/written by `threads` threads
+    // return 0 on success, 1 on error (like save_to_file)
+    int load_from_text_file(const char* filename, uint32_t threads);
+    int save_to_text_file(const char* filename, uint32_t threads) const;
+
+    // compressed binary format (see packed_format.h); blocks of states are encoded/decoded by `threads` threads
+    int load_from_packed_file(const char* filename, uint32_t threads);
+    int save_to_packed_file(const char* filename, uint32_t threads) const;
+
     // DFA constructor [works the same way as init method]
     DFA(uint32_t _alphabet_length, uint32_t _size, uint32_t _starting_node, std::vector<std::vector<uint32_t> > &_delta, std::vector<bool> &_v_acc) {
         init(_alphabet_length, _size, _starting_node, _delta, _v_acc);
     }
 
+    // DFA with labels of states (see set_labels)
+    DFA(uint32_t _alphabet_length, uint32_t _size, uint32_t _starting_node, std::vector<std::vector<uint32_t> > &_delta, std::vector<uint32_t> &_labels) {
+        std::vector<bool> v_acc(_labels.size());
+        for (size_t s = 0; s < _labels.size(); ++s) v_acc[s] = (_labels[s] != 0);
+        init(_alphabet_length, _size, _starting_node, _delta, v_acc);
+        set_labels(_labels);
+    }
+
+    // DFA which owns the given tables (see init)
+    DFA(uint32_t _alphabet_length, uint32_t _size, uint32_t _starting_node, std::vector<table_vector<uint32_t> > &&_delta, std::vector<bool> &&_v_acc) {
+        init(_alphabet_length, _size, _starting_node, std::move(_delta), std::move(_v_acc));
+    }
+
+    DFA(uint32_t _alphabet_length, uint32_t _size, uint32_t _starting_node, std::vector<std::vector<uint32_t> > &&_delta, std::vector<bool> &&_v_acc) {
+        init(_alphabet_length, _size, _starting_node, std::move(_delta), std::move(_v_acc));
+    }
+
+    // DFA from memory which it doesn't own (see init)
+    DFA(uint32_t _alphabet_length, uint32_t _size, uint32_t _starting_node, const uint32_t* _delta, const uint8_t* acc_bits) {
+        init(_alphabet_length, _size, _starting_node, _delta, acc_bits);
+    }
+
     // DFA constructor from 2 arguments (for small automata)
     explicit DFA(char* command, char* dfa_str);
 
+    // a paused minimization is cancelled first: its tables may be in refinement_arena, so they are released
+    // while the arena is installed (the member tables would be freed after the arena otherwise)
+    ~DFA() {
+        cancel_minimization();
+    }
+
+    // a copy of paused DFA goes on with its own tables (in the heap, see UnsharedArena)
+    DFA(const DFA& other) = default;
+    DFA(DFA&& other) = default;
+    DFA& operator=(const DFA& other);
+    DFA& operator=(DFA&& other) noexcept;
+
     bool operator==(const DFA& other) const;
 
+    // operations between DFAs with the same alphabet (results are not minimized)
+    DFA intersect(const DFA& other) const;
+    DFA unite(const DFA& other) const;
+    DFA difference(const DFA& other) const;
+
     // explicit DFA(std::string &special_type, std::vector<uint32_t> &parameters);
 
 };
 
+// "512M", "2G", "100000" --> number of bytes; 0 if the string is incorrect
+uint64_t parse_memory_size(const char* s);
+
+// Minimization of DFA from binary file (format of DFA::save_to_file) which doesn't fit in RAM.
+// Partition refinement runs through temporary files, RAM usage is bounded by mem_limit bytes.
+// The quotient DFA is written to result (its unreachable states are not deleted yet), it must fit in mem_limit too;
+// returns 0 on success, 1 if the file is incorrect, temporary files couldn't be written or the quotient is too big
+// (result isn't changed).
+int external_minimization(char* filename, uint64_t mem_limit, bool debug, DFA& result);
+
+// The same, but the quotient DFA is streamed to out_filename (binary format) and never is in RAM
+// (its unreachable states stay there, they are only deleted by minimization in RAM).
+int external_minimization_to_file(char* filename, uint64_t mem_limit, bool debug, char* out_filename);
+
 #endif
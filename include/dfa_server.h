@@ -0,0 +1,102 @@
+#ifndef DFA_SERVER_H
+#define DFA_SERVER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include "dfa_class.h"
+
+// DFA from 2 arguments of command line (like the 1st and 2nd arguments of minimizer);
+// NFA inputs are converted to DFA. Returns 0 on success, 1 if the file couldn't be read or is incorrect
+// (result isn't changed then)
+int read_dfa(char* command, char* s, DFA& result);
+
+// Daemon which keeps automata in memory between requests. It listens on a Unix domain socket, every request
+// is one line, every reply is one line ("ok ..." or "error ..."):
+//
+//   load {name} {command} {argument}   -- reads DFA like `minimizer {command} {argument}` (again only if the source changed)
+//   minimize {name}                    -- minimizes the cached DFA in place, in time slices (matching goes between them)
+//   match {name} [{word}]              -- word of symbols 0-9a-zA-Z (empty word without it): accepted/rejected or label
+//   compare {name} {name}              -- equality of languages (both are minimized)
+//   drop {name}, stats, shutdown
+//
+// Cache is LRU, bounded by the memory of tables (the last used DFA is kept even if it is bigger than the bound).
+// Connections are served by a pool of workers (one connection at a time for each worker).
+//
+//   DFAServer server("/tmp/minimizer.sock", 4, 1 << 30);
+//   server.run(); // until "shutdown"
+class DFAServer {
+
+private:
+    struct Entry {
+        std::string source; // "{command} {argument}" of load (with mtime and size if it is a file)
+        DFA dfa;
+        std::shared_mutex lock; // matching shares the DFA, minimization needs it alone
+        bool cached=false; // it is in the cache now (changed by cache_lock)
+        uint64_t bytes=0; // memory of tables (changed by cache_lock)
+        std::list<std::string>::iterator recent_position; // position in `recent` (changed by cache_lock)
+
+        Entry(const std::string& _source, DFA&& _dfa) : source(_source), dfa(std::move(_dfa)) {}
+    };
+
+    std::string socket_path;
+    uint32_t workers;
+    uint64_t cache_limit; // bytes
+    int listen_fd=-1;
+    std::atomic<bool> stopping{false};
+
+    std::mutex cache_lock;
+    std::unordered_map<std::string, std::shared_ptr<Entry> > cache={};
+    std::list<std::string> recent={}; // names, the most recently used first
+    uint64_t cached_bytes=0;
+    uint64_t hits=0, misses=0, evictions=0;
+
+    // accepted connections which wait for a worker
+    std::mutex queue_lock;
+    std::condition_variable queue_ready;
+    std::deque<int> connections={};
+
+    // cached DFA (it becomes the most recently used one), nullptr if there is no such name
+    std::shared_ptr<Entry> find(const std::string& name);
+
+    // puts the DFA under the name (the old one is replaced) and evicts least recently used DFAs over the limit
+    void insert(const std::string& name, const std::shared_ptr<Entry>& entry);
+
+    // new memory of the DFA after it was changed (nothing if it was evicted meanwhile)
+    void update_bytes(const std::shared_ptr<Entry>& entry, uint64_t bytes);
+
+    // evicts least recently used DFAs while the cache is over the limit (cache_lock must be held)
+    void evict();
+
+    // reply to one request line (without '\n')
+    std::string handle(const std::string& request);
+
+    // reads requests until the client closes the connection
+    void serve_connection(int fd);
+
+    void work();
+
+public:
+    DFAServer(const char* _socket_path, uint32_t _workers, uint64_t _cache_limit);
+    ~DFAServer();
+
+    DFAServer(const DFAServer&) = delete;
+    DFAServer& operator=(const DFAServer&) = delete;
+
+    // serves clients until "shutdown"; returns 0 after it, 1 if the socket couldn't be created
+    int run();
+};
+
+// memory of tables of DFA (transitions, acc and labels)
+uint64_t dfa_memory(const DFA& dfa);
+
+// sends one request to the server and gets one reply; returns 0 on success, 1 if the server can't be reached
+int ask_server(const char* socket_path, const std::string& request, std::string& reply);
+
+#endif
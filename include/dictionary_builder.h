@@ -0,0 +1,82 @@
+#ifndef DICTIONARY_BUILDER_H
+#define DICTIONARY_BUILDER_H
+
+#include <vector>
+#include <unordered_set>
+#include "dfa_class.h"
+
+// Minimal acyclic DFA of a word list, built incrementally (Daciuk, Mihov, Watson, Watson, 2000).
+// Words must be grouped by prefixes: after a word leaves a branch, no later word goes back to it
+// (so any lexicographic order works, sorting by symbols or by bytes). Only the path of the last word
+// is not minimized yet; when the next word leaves a state of the path, the state is replaced by an equivalent
+// registered one or registered itself. So memory is O(minimal automaton + longest word), not O(trie).
+//
+//   DictionaryBuilder builder(alphabet_length); // 0: alphabet is found from the words
+//   builder.add_word(word); ...
+//   DFA dfa = builder.finish(); // minimal (the sink is added to make it complete)
+class DictionaryBuilder {
+
+private:
+    uint32_t alphabet_length; // 0 if it isn't known
+    uint32_t max_symbol=0;
+    uint64_t words=0;
+
+    // registered states: transitions of q are (edge_symbol[i], edge_target[i]) for i in
+    // [edge_begin[q], edge_begin[q + 1]), sorted by symbols
+    std::vector<uint64_t> edge_begin={0};
+    std::vector<uint32_t> edge_symbol={};
+    std::vector<uint32_t> edge_target={};
+    std::vector<char> final_state={};
+
+    struct StateHash {
+        const DictionaryBuilder* builder;
+        size_t operator()(uint32_t q) const;
+    };
+
+    struct StateEqual {
+        const DictionaryBuilder* builder;
+        bool operator()(uint32_t q, uint32_t r) const;
+    };
+
+    // register of states: there are no 2 equivalent states in it
+    std::unordered_set<uint32_t, StateHash, StateEqual> states;
+
+    // states of the path of the last word (path[d] is after d symbols); the last edge of path[d]
+    // goes to path[d + 1], its target is known only when path[d + 1] is registered
+    struct PathState {
+        bool final;
+        std::vector<std::pair<uint32_t, uint32_t> > edges; // (symbol, target)
+    };
+    std::vector<PathState> path;
+    std::vector<uint32_t> last_word={};
+
+    // registers path[depth] (or finds the equivalent state), returns its number; path[depth] must be the last one
+    uint32_t freeze(uint32_t depth);
+
+    // freezes the path down to path[depth + 1]
+    void freeze_path(uint32_t depth);
+
+public:
+    explicit DictionaryBuilder(uint32_t _alphabet_length);
+
+    DictionaryBuilder(const DictionaryBuilder&) = delete;
+    DictionaryBuilder& operator=(const DictionaryBuilder&) = delete;
+
+    // returns 0 on success, 1 if the word breaks the order or has a symbol out of the alphabet
+    // (repeated word is fine, it is added once)
+    int add_word(const std::vector<uint32_t>& word);
+
+    // minimal complete DFA of all added words; the builder is empty after it
+    DFA finish();
+
+    // number of states which are registered now
+    uint32_t get_states() const {
+        return (uint32_t)this->final_state.size();
+    }
+};
+
+// dictionary DFA of a file with one word per line (symbols 0-9a-zA-Z, other bytes are skipped, empty lines too);
+// the file is read sequentially. Returns 0 on success, 1 if the file can't be read or the words are not sorted
+int build_dictionary(const char* filename, DFA& result);
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef EXTERNAL_SORT_H
+#define EXTERNAL_SORT_H
+
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+
+// Sorts fixed-width records (each record is `width` uint32_t words) with a bounded amount of RAM.
+// Records are compared lexicographically by their first `key_width` words.
+// While the records fit into the memory budget nothing is written to disk,
+// otherwise sorted runs are spilled into temporary files and merged at the end.
+// At most fan_in runs are merged at once (so every run gets a big enough read buffer and few files are open):
+// when fan_in runs of the same level are spilled, they are merged into one run of the next level,
+// and finish merges the rest in passes until one more merge is enough.
+class ExternalSorter {
+
+private:
+    uint32_t width;
+    uint32_t key_width;
+    uint64_t records_per_run; // how many records we can keep in RAM at once
+    uint32_t fan_in;
+
+    std::vector<uint32_t> buffer={}; // records of the current (not spilled yet) run
+    std::vector<uint32_t> order={}; // sorted order of records in buffer
+    std::vector<FILE*> runs={}; // spilled sorted runs (in the order of their records)
+    std::vector<uint32_t> levels={}; // how many merges made each run
+
+    // merging state
+    struct RunReader {
+        FILE* file;
+        std::vector<uint32_t> data; // buffered records of this run
+        uint64_t pos; // index of the current record in data
+        uint64_t records; // number of records in data
+    };
+    std::vector<RunReader> readers={};
+    std::vector<uint32_t> heap={}; // indices of readers, the smallest current record on top
+    uint64_t records_per_reader=0;
+    uint64_t next_in_memory=0; // used when the only run is still in the buffer
+    bool finished=false;
+
+    bool less(const uint32_t* x, const uint32_t* y) const;
+    void sort_buffer();
+    void release_buffer();
+    bool spill_run();
+    bool refill(RunReader& reader);
+    // readers of runs[first, last), the memory budget is split into `shares` equal parts
+    void start_merge(size_t first, size_t last, uint64_t shares);
+    bool pop(uint32_t* record);
+    // runs[first, last) --> one run in their place
+    bool merge_runs(size_t first, size_t last);
+    void sift_down(size_t idx);
+    void sift_up(size_t idx);
+
+public:
+    static const uint32_t MAX_FAN_IN = 32;
+    static const uint64_t MIN_RECORDS_PER_READER = 8;
+
+    ExternalSorter(uint32_t _width, uint32_t _key_width, uint64_t mem_limit);
+    ~ExternalSorter();
+
+    ExternalSorter(const ExternalSorter&) = delete;
+    ExternalSorter& operator=(const ExternalSorter&) = delete;
+
+    // returns false if a temporary file could not be written
+    bool push(const uint32_t* record);
+
+    // no more push after finish; returns false on I/O errors
+    bool finish();
+
+    // copies the next record in sorted order to `record`; false when all records are read
+    bool next(uint32_t* record);
+};
+
+// Sequential buffered reader/writer of uint32_t words, used to stream big tables from/to files
+class WordReader {
+private:
+    FILE* file;
+    std::vector<uint32_t> data;
+    size_t pos=0;
+    size_t length=0;
+    uint64_t left; // words that are still not read from file
+public:
+    WordReader(FILE* _file, uint64_t offset_in_bytes, uint64_t words, uint64_t buffer_words);
+    bool next(uint32_t& x);
+};
+
+class WordWriter {
+private:
+    FILE* file;
+    std::vector<uint32_t> data;
+    size_t capacity;
+public:
+    WordWriter(FILE* _file, uint64_t buffer_words);
+    bool put(uint32_t x);
+    bool flush();
+};
+
+#endif
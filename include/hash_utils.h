@@ -0,0 +1,14 @@
+#ifndef HASH_UTILS_H
+#define HASH_UTILS_H
+
+#include <cstdint>
+
+// hashes of signatures of states (sequences of uint32_t): start with HASH_SEED and mix in the numbers one by one
+const uint64_t HASH_SEED = 0x9E3779B97F4A7C15ULL;
+
+inline uint64_t hash_mix(uint64_t h, uint32_t x) {
+    h = (h ^ x) * 0x100000001B3ULL;
+    return h ^ (h >> 32);
+}
+
+#endif
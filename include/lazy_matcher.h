@@ -0,0 +1,106 @@
+#ifndef LAZY_MATCHER_H
+#define LAZY_MATCHER_H
+
+#include <functional>
+#include "matcher.h"
+#include "nfa_class.h"
+
+// counters of LazyMatcher (since it was created)
+struct LazyStats {
+    uint64_t hits; // transitions which were found in the cache
+    uint64_t misses; // transitions which were computed from subsets
+    uint64_t states; // DFA states built (all of them, also the flushed ones)
+    uint64_t flushes; // the cache was full and was cleared (not counting the clear after simulation)
+    uint64_t simulated; // symbols read by bitset simulation (when the cache was thrashing)
+};
+
+// Streaming matcher of NFA which determinizes it lazily (like RE2): DFA states are subsets of NFA states,
+// they are built when the scan comes to them and their transitions are filled on first use.
+// All states live in a cache of fixed capacity (found from memory_limit); when it is full, it is flushed
+// and the scan goes on from the current subset. If the cache is flushed too often (less than
+// MIN_SYMBOLS_PER_STATE symbols read for each built state), the matcher simulates the NFA with bitsets
+// for a while and then tries the cache again. Input bytes and match reporting are the same as in Matcher.
+//
+//   LazyMatcher matcher(nfa, MatchMode::POSITIONS, 64 << 20);
+//   matcher.feed(data, length, on_match); ...
+//   matcher.get_stats();
+class LazyMatcher {
+
+private:
+    uint32_t alphabet_length;
+    uint32_t words; // uint64_t words in one subset
+    MatchMode mode;
+    uint32_t byte2symbol[256];
+
+    // NFA: targets of (q, a) are targets[target_begin[q * alphabet_length + a]], ..., up to the next begin
+    std::vector<uint64_t> target_begin={};
+    std::vector<uint32_t> targets={};
+    std::vector<uint64_t> start_subset={};
+    std::vector<uint64_t> acc_subset={};
+
+    // cache of DFA states: subset of state d is subsets[d * words], ..., next[d * alphabet_length + a] is
+    // delta(d, a) (EMPTY_STATE if it isn't known yet); slots is open addressing table of subsets --> states
+    uint32_t max_states;
+    std::vector<uint64_t> subsets={};
+    std::vector<uint32_t> next={};
+    std::vector<char> state_acc={};
+    std::vector<uint32_t> slots={};
+    uint32_t start_state=EMPTY_STATE; // starting state in the cache (EMPTY_STATE after flush)
+
+    // current position: a state of the cache, or (while simulating) the subset itself
+    uint32_t current=EMPTY_STATE;
+    std::vector<uint64_t> current_subset={};
+    uint64_t position=0;
+    uint64_t line=1;
+    bool line_reported=false;
+    uint64_t symbols_since_flush=0;
+    uint64_t simulation_left=0; // symbols to simulate before the cache is used again
+
+    std::vector<uint64_t> scratch={}; // the next subset
+    LazyStats stats={0, 0, 0, 0, 0};
+
+    // state of the subset in scratch: it is added to the cache if it isn't there, a full cache is flushed before;
+    // if may_give_up and the cache thrashes, EMPTY_STATE is returned instead of flush
+    uint32_t find_or_add(bool may_give_up);
+
+    // empties the cache; flush() does it when the cache is full and counts it in stats
+    void clear_cache();
+    void flush();
+
+    // scratch = union of targets of the subset by symbol a
+    void step_subset(const uint64_t* subset, uint32_t a);
+
+    bool subset_acc(const uint64_t* subset) const;
+
+    uint32_t cached_start();
+
+    // goes to the starting subset (new line in LINES mode, reset)
+    void restart();
+
+public:
+    static const uint64_t MIN_SYMBOLS_PER_STATE = 10;
+
+    LazyMatcher(const NFA& nfa, MatchMode _mode, uint64_t memory_limit);
+
+    void reset();
+
+    // feeds next chunk of stream; on_match gets a position or a line number (depends on mode)
+    void feed(const char* data, size_t length, const std::function<void(uint64_t)>& on_match);
+
+    // is the NFA in acc state now
+    bool accepted() const;
+
+    const LazyStats& get_stats() const {
+        return this->stats;
+    }
+
+    // capacity of the cache (DFA states)
+    uint32_t get_max_states() const {
+        return this->max_states;
+    }
+};
+
+// sequential scan of a file by LazyMatcher; returns 0 on success, 1 if the file couldn't be read
+int scan_file(LazyMatcher& matcher, const char* filename, const std::function<void(uint64_t)>& on_match);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+
+// read-only mmap of a whole file, unmapped in destructor
+class MappedFile {
+
+private:
+    const char* data=nullptr;
+    size_t length=0;
+    bool error=false;
+
+public:
+    explicit MappedFile(const char* filename);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // false if the file couldn't be opened or mapped (empty files are fine, their data is nullptr)
+    bool ok() const {
+        return !this->error;
+    }
+
+    const char* get_data() const {
+        return this->data;
+    }
+
+    size_t get_length() const {
+        return this->length;
+    }
+};
+
+#endif
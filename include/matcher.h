@@ -0,0 +1,160 @@
+#ifndef MATCHER_H
+#define MATCHER_H
+
+#include <functional>
+#include "dfa_class.h"
+
+// Bytes of the input are turned into symbols of the alphabet:
+//  - if alphabet_length >= 256, byte b is symbol b;
+//  - otherwise '0'-'9', 'a'-'z', 'A'-'Z' are symbols 0..61 (as in the strings of dfa/nfa), if they are < alphabet_length.
+// Other bytes are skipped.
+const uint32_t UNMAPPED_BYTE = UINT32_MAX;
+
+// symbol of byte b (or UNMAPPED_BYTE) by the rules above
+uint32_t byte_to_symbol(uint32_t b, uint32_t alphabet_length);
+
+enum class MatchMode {
+    POSITIONS, // report every position (number of read bytes) after which the DFA is in acc state
+    LINES // '\n' restarts the DFA; report (1-based) numbers of lines, where the DFA enters acc state
+};
+
+// current state of streaming matcher; can be saved and restored later to continue the stream
+struct MatcherState {
+    uint32_t state;
+    uint64_t position; // number of bytes read
+    uint64_t line; // number of the current line (1-based)
+    bool line_reported; // current line was already reported (in LINES mode)
+};
+
+class Matcher {
+
+private:
+    uint32_t alphabet_length;
+    uint32_t starting_node;
+    MatchMode mode;
+    table_vector<uint32_t> table={}; // table[s * alphabet_length + a] = delta(s, a) (state-major for scanning)
+    std::vector<char> acc={};
+    std::vector<uint32_t> labels={}; // labels of states (empty if the DFA has no labels)
+    uint32_t byte2symbol[256];
+    MatcherState current;
+
+    // on_match(position or line, state) for every match
+    template <typename F>
+    MatcherState run_states(MatcherState cur, const char* data, size_t length, F on_match) const;
+
+public:
+    Matcher(const DFA& dfa, MatchMode _mode);
+
+    void reset();
+
+    MatcherState save() const {
+        return this->current;
+    }
+
+    void restore(const MatcherState& saved) {
+        this->current = saved;
+    }
+
+    // reads data starting from state `from` and returns the state after it (doesn't change the matcher)
+    MatcherState run(MatcherState from, const char* data, size_t length, const std::function<void(uint64_t)>& on_match) const;
+
+    // feeds next chunk of stream; on_match gets a position or a line number (depends on mode)
+    void feed(const char* data, size_t length, const std::function<void(uint64_t)>& on_match);
+
+    // the same, but on_match gets the label of the state too (for example, token ID)
+    MatcherState run_labels(MatcherState from, const char* data, size_t length, const std::function<void(uint64_t, uint32_t)>& on_match) const;
+    void feed_labels(const char* data, size_t length, const std::function<void(uint64_t, uint32_t)>& on_match);
+
+    // is the DFA in acc state now
+    bool accepted() const {
+        return this->acc[this->current.state];
+    }
+
+    MatchMode get_mode() const {
+        return this->mode;
+    }
+
+    uint32_t get_starting_node() const {
+        return this->starting_node;
+    }
+
+    uint32_t get_size() const {
+        return (uint32_t)this->acc.size();
+    }
+
+    uint32_t symbol_of(unsigned char byte) const {
+        return this->byte2symbol[byte];
+    }
+
+    uint32_t step(uint32_t state, uint32_t symbol) const {
+        return this->table[(uint64_t)state * this->alphabet_length + symbol];
+    }
+
+    bool is_acc(uint32_t state) const {
+        return this->acc[state];
+    }
+
+    // label of the state (0 or 1 if the DFA has no labels)
+    uint32_t label_of(uint32_t state) const {
+        return (this->labels.empty() ? (uint32_t)this->acc[state] : this->labels[state]);
+    }
+
+    uint32_t current_label() const {
+        return label_of(this->current.state);
+    }
+};
+
+// Runs many DFAs over one stream in one pass.
+// Bytes are split into classes (bytes with equal symbols in all DFAs); all transition tables are stored
+// in one array with row stride = number of classes, and states are kept as premultiplied offsets of their rows.
+// The highest bit is set if the DFA has just read a symbol and came to acc state (skipped bytes don't set it).
+// So one step of all DFAs is one gather: next[i] = table[(cur[i] & ~MATCH_BIT) + class],
+// AVX2 gathers are used when CPU supports them.
+class MultiMatcher {
+
+private:
+    uint32_t classes=0; // number of byte classes
+    uint8_t byte2class[256];
+    table_vector<uint32_t> table={}; // rows of all DFAs
+    std::vector<uint32_t> starting_rows={};
+    std::vector<uint32_t> current={}; // current states of all DFAs (contiguous)
+    std::vector<char> row_acc={}; // row_acc[row / classes] is true if the state of this row is acc
+    uint64_t position=0;
+    bool use_avx2=false;
+
+public:
+    static const uint32_t MATCH_BIT = 1U << 31;
+
+    explicit MultiMatcher(const std::vector<DFA>& dfas);
+
+    void reset();
+
+    // on_match(dfa index, position) for every DFA which is in acc state after a byte
+    void feed(const char* data, size_t length, const std::function<void(uint32_t, uint64_t)>& on_match);
+
+    bool accepted(uint32_t idx) const {
+        return this->row_acc[(this->current[idx] & ~MATCH_BIT) / this->classes];
+    }
+
+    uint32_t get_count() const {
+        return (uint32_t)this->current.size();
+    }
+
+    uint32_t get_classes() const {
+        return this->classes;
+    }
+};
+
+// grep-like scan of a file: it is mmap'ed and split into chunks which are scanned in parallel.
+// In LINES mode chunks start at the beginnings of lines, so every chunk starts from starting node.
+// In POSITIONS mode the state at the start of a chunk is unknown: the chunk is simulated speculatively
+// from all states at once (equal runs are merged), then the real start states are found one chunk after another.
+// If the runs don't merge (the simulation would cost more than a few steps per byte), the chunk is
+// scanned sequentially when the end state of the previous chunk is known.
+// Returns 0 on success, 1 if the file couldn't be read. Matches are given to on_match in increasing order.
+int scan_file(const Matcher& matcher, const char* filename, uint32_t threads, const std::function<void(uint64_t)>& on_match);
+
+// scan of a file by all DFAs of MultiMatcher in one pass; returns 0 on success, 1 if the file couldn't be read
+int scan_file(MultiMatcher& matcher, const char* filename, const std::function<void(uint32_t, uint64_t)>& on_match);
+
+#endif
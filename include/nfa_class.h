@@ -2,6 +2,11 @@
 #define NFA_CLASS_H
 #include "dfa_class.h"
 
+struct language_check {
+    bool holds;
+    std::vector<uint32_t> counterexample; // shortest word which breaks the property (if !holds)
+};
+
 class NFA {
 
 private:
@@ -16,18 +21,53 @@ public:
         init(_alphabet_length, _size, _delta, _starting_nodes, _v_acc);
     }
 
+    NFA(uint32_t _alphabet_length, uint32_t _size, std::vector<std::vector<std::vector<uint32_t> > > &&_delta, std::vector<uint32_t> &&_starting_nodes, std::vector<bool> &&_v_acc) {
+        init(_alphabet_length, _size, std::move(_delta), std::move(_starting_nodes), std::move(_v_acc));
+    }
+
     explicit NFA(char* s);
 
+    NFA() {}
+
+    // edge-list text format (see text_format.h); return 0 on success, 1 on error
+    int load_from_text_file(const char* filename, uint32_t threads);
+    int save_to_text_file(const char* filename) const;
+
     void init(uint32_t _alphabet_length, uint32_t _size, std::vector<std::vector<std::vector<uint32_t> > > &_delta, std::vector<uint32_t> &_starting_nodes, std::vector<bool> &_v_acc);
 
+    // takes the tables (nothing is copied)
+    void init(uint32_t _alphabet_length, uint32_t _size, std::vector<std::vector<std::vector<uint32_t> > > &&_delta, std::vector<uint32_t> &&_starting_nodes, std::vector<bool> &&_v_acc);
+
     void print();
 
-    DFA convert2dfa(); // O(2^n * n^2)
+    DFA convert2dfa(); // O(2^n * |alphabet| * n / 8), subsets are split between threads
+
+    // L(this) ⊆ L(other)? Antichain exploration, stops at the first counterexample
+    language_check is_included_in(const NFA& other) const;
+
+    // L(this) = Σ*?
+    language_check is_universal() const;
     
     uint32_t get_size() const {
         return size;
     }
 
+    uint32_t get_alphabet_length() const {
+        return alphabet_length;
+    }
+
+    const std::vector<uint32_t>& get_transitions(uint32_t state, uint32_t a) const {
+        return delta[state][a];
+    }
+
+    const std::vector<uint32_t>& get_starting_nodes() const {
+        return starting_nodes;
+    }
+
+    bool is_accepting(uint32_t state) const {
+        return v_acc[state];
+    }
+
     bool line_complicated_initial_states() {
         return starting_nodes.size() >= 2 || starting_nodes[0] != 0;
     }
@@ -0,0 +1,42 @@
+#ifndef PACKED_FORMAT_H
+#define PACKED_FORMAT_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Compressed binary format of DFA (smaller alternative to the raw format of DFA::save_to_file):
+//
+//   char[4]  "DFAZ" ("DFAL" if DFA has labels)
+//   uint32   size, alphabet_length, starting_node
+//   uint32   sink               -- the most frequent target (EMPTY_STATE if runs are not used)
+//   uint32   states_per_block, blocks
+//   uint64   block_end[blocks]  -- end of every block (in bytes from the start of block data)
+//   uint8    acc[(size + 7) / 8] -- bits as in the raw format
+//   uint32   labels[size]       -- only in "DFAL" files
+//   block data
+//
+// States are stored one after another (all transitions of a state together), blocks of states_per_block
+// states are independent, so they are encoded and decoded in parallel.
+// Transitions of a state are a sequence of varints (LEB128):
+//   - odd token t:  (t >> 1) + 1 next symbols go to the sink;
+//   - even token t: next symbol goes to prev + unzigzag(t >> 1), where prev is the previous target
+//     of this state which is not the sink (the state itself at the start).
+// So the long runs to a dead state and targets close to the source cost about one byte.
+
+const char PACKED_MAGIC[4] = {'D', 'F', 'A', 'Z'};
+const char PACKED_LABELED_MAGIC[4] = {'D', 'F', 'A', 'L'};
+
+struct PackedHeader {
+    uint32_t size;
+    uint32_t alphabet_length;
+    uint32_t starting_node;
+    uint32_t sink;
+    uint32_t states_per_block;
+    uint32_t blocks;
+};
+
+// reads header from the beginning of the file; returns pointer after it or nullptr if it is incorrect;
+// labeled is true for "DFAL" files
+const char* parse_packed_header(const char* p, const char* end, PackedHeader& header, bool& labeled);
+
+#endif
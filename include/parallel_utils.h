@@ -0,0 +1,54 @@
+#ifndef PARALLEL_UTILS_H
+#define PARALLEL_UTILS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// simple fork-join helpers for the passes over states and transitions
+
+// calls f(j) for j = 0, ..., threads - 1 in different threads (in this thread if there is only one)
+template <typename F>
+inline void run_in_threads(uint32_t threads, F f) {
+    if (threads <= 1) { f(0); return; }
+    std::vector<std::thread> workers;
+    for (uint32_t j = 0; j < threads; ++j) workers.emplace_back(f, j);
+    for (std::thread& worker : workers) worker.join();
+}
+
+// hardware threads, but at least min_work units of `work` for each thread (and at least one thread)
+inline uint32_t threads_for(uint64_t work, uint64_t min_work) {
+    const uint64_t threads = std::min<uint64_t>(std::thread::hardware_concurrency(), work / min_work);
+    return (uint32_t)std::max<uint64_t>(1, threads);
+}
+
+// thread j of `threads` gets [range_begin(n, j), range_begin(n, j + 1))
+inline uint64_t range_begin(uint64_t n, uint32_t j, uint32_t threads) {
+    return n * j / threads;
+}
+
+// prefix[s] = value(0) + ... + value(s - 1) for s <= n; every thread sums its range, then writes prefix sums of it
+// (prefix is any vector-like container, it gets n + 1 elements)
+template <typename C, typename F>
+inline void parallel_prefix_sum(uint32_t n, uint32_t threads, C& prefix, F value) {
+    typedef typename C::value_type T;
+    prefix.assign((uint64_t)n + 1, 0);
+    std::vector<T> totals(threads + 1, 0);
+    run_in_threads(threads, [&](uint32_t j) {
+        const uint64_t to = range_begin(n, j + 1, threads);
+        for (uint64_t s = range_begin(n, j, threads); s < to; ++s) totals[j + 1] += value((uint32_t)s);
+    });
+    for (uint32_t j = 0; j < threads; ++j) totals[j + 1] += totals[j];
+    run_in_threads(threads, [&](uint32_t j) {
+        const uint64_t to = range_begin(n, j + 1, threads);
+        T sum = totals[j];
+        for (uint64_t s = range_begin(n, j, threads); s < to; ++s) {
+            prefix[s] = sum;
+            sum += value((uint32_t)s);
+        }
+    });
+    prefix[n] = totals[threads];
+}
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <ostream>
+
+// Hardware counters of phases (perf_event_open, user space only, threads started inside a phase are counted too).
+// Counters which the CPU, the kernel or perf_event_paranoid don't allow are skipped (virtual machines often
+// have no hardware counters at all, then only page faults are counted); wall time is always measured.
+// If there are more counters than hardware slots, the kernel multiplexes them and the values are scaled.
+//
+//   PerfReport report;
+//   report.begin("refinement"); ... report.end();
+//
+// begin() of the phase with the same name adds to it, begin() while another phase goes ends that phase.
+class PerfReport {
+
+private:
+    struct Counter {
+        const char* name;
+        int fd;
+    };
+
+    struct Phase {
+        std::string name;
+        uint64_t calls;
+        double seconds;
+        std::vector<double> values; // one for each counter
+    };
+
+    std::vector<Counter> counters={}; // opened counters
+    std::vector<const char*> skipped={}; // names of counters which couldn't be opened
+    std::vector<Phase> phases={};
+    int current=-1; // phase which goes now
+    std::vector<double> start_values={};
+    std::chrono::steady_clock::time_point start_time;
+
+    // scaled values of all counters now
+    void read_counters(std::vector<double>& values) const;
+
+public:
+    PerfReport();
+    ~PerfReport();
+
+    PerfReport(const PerfReport&) = delete;
+    PerfReport& operator=(const PerfReport&) = delete;
+
+    void begin(const char* name);
+    void end();
+
+    // table of phases (counters per phase, IPC and misses per 1000 instructions when they are known)
+    void print(std::ostream& out) const;
+
+    // returns 0 on success, 1 if the file couldn't be written
+    int save(const char* filename) const;
+
+    // number of counters which work
+    uint32_t available() const {
+        return (uint32_t)this->counters.size();
+    }
+};
+
+// does nothing if report is nullptr (so the code can be profiled optionally)
+inline void perf_phase(PerfReport* report, const char* name) {
+    if (report != nullptr) report->begin(name);
+}
+
+inline void perf_end(PerfReport* report) {
+    if (report != nullptr) report->end();
+}
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef TABLE_ALLOCATOR_H
+#define TABLE_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+// Memory for big tables of automata (delta, reversed delta, lists of refinement).
+// Small tables are taken by malloc. Big ones (>= LARGE_TABLE_BYTES) can be mmap'ed with huge pages
+// and with NUMA placement, if it is asked by set_table_allocation. Everything falls back to the usual
+// pages (and then to malloc) if the system doesn't allow it, so the policy is only a hint.
+// Tables are filled when they are constructed (by the thread which constructs them), so with first-touch
+// placement a whole table goes to the node of that thread; INTERLEAVE spreads big tables over all nodes.
+
+const size_t LARGE_TABLE_BYTES = 2 << 20; // one huge page
+
+enum class HugePages {
+    NONE, // usual pages
+    TRANSPARENT, // 2M aligned mmap + madvise(MADV_HUGEPAGE), kernel gives huge pages when it can
+    EXPLICIT // MAP_HUGETLB (needs reserved pages, see /proc/sys/vm/nr_hugepages), else as TRANSPARENT
+};
+
+enum class NumaPlacement {
+    FIRST_TOUCH, // default policy of the kernel: pages go to the node of the thread which constructs the table
+    INTERLEAVE // pages are spread over all online nodes (mbind with MPOL_INTERLEAVE)
+};
+
+// policy for tables allocated after the call (by all threads)
+void set_table_allocation(HugePages huge_pages, NumaPlacement placement);
+
+void* allocate_table(size_t bytes);
+void deallocate_table(void* p, size_t bytes);
+
+// Arena: while it is active in a thread, tables of this thread are cut from its chunks and deallocation
+// is free; all the memory is returned at once by release() (or destructor).
+// Frozen arena doesn't give memory anymore, but it still ignores deallocation of its own tables,
+// so they can be freed after the tables which must outlive the arena are built.
+class TableArena {
+
+private:
+    std::vector<std::pair<char*, size_t> > chunks={}; // (begin, length)
+    size_t used=0; // bytes used in the last chunk
+    bool frozen=false;
+
+public:
+    TableArena() = default;
+    ~TableArena();
+
+    TableArena(const TableArena&) = delete;
+    TableArena& operator=(const TableArena&) = delete;
+
+    void* allocate(size_t bytes);
+    bool owns(const void* p) const;
+    void release();
+
+    void freeze() {
+        this->frozen = true;
+    }
+
+    bool is_frozen() const {
+        return this->frozen;
+    }
+
+    // bytes taken from the system
+    size_t reserved() const;
+};
+
+// arena of the current thread (nullptr: usual allocation); tables from an arena must be freed before it
+void set_table_arena(TableArena* arena);
+TableArena* get_table_arena();
+
+template <typename T>
+class TableAllocator {
+
+public:
+    typedef T value_type;
+
+    TableAllocator() noexcept = default;
+    template <typename U>
+    TableAllocator(const TableAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) {
+        return (T*)allocate_table(n * sizeof(T));
+    }
+
+    void deallocate(T* p, size_t n) noexcept {
+        deallocate_table(p, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const TableAllocator<U>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const TableAllocator<U>&) const noexcept { return false; }
+};
+
+template <typename T>
+using table_vector = std::vector<T, TableAllocator<T> >;
+
+#endif
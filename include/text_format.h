@@ -0,0 +1,41 @@
+#ifndef TEXT_FORMAT_H
+#define TEXT_FORMAT_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Line-oriented edge-list format for DFA and NFA (no limit on the number of states):
+//
+//   dfa {size} {alphabet_length} {starting_node}      nfa {size} {alphabet_length}
+//   a {state}            -- state is acc               i {state}  -- starting node (NFA, any number of lines)
+//   l {state} {label}    -- label of state (DFA)       a {state}
+//   {from} {symbol} {to} -- transition                 {from} {symbol} {to}
+//   # comment
+//
+// If a DFA has "l" lines, it gets labels (see DFA::set_labels): states without "l" line have label 1 if they
+// are acc and label 0 otherwise.
+// The first line (header) must be the first non-comment line, other lines can be in any order.
+// A DFA must have exactly one transition for each (state, symbol) and at most one "l" line for each state.
+// Files are parsed in parallel: the text after the header is split into chunks at line borders.
+
+// kind of a parsed line
+enum class TextLine {
+    EMPTY, // empty line or comment
+    ACC, // "a {state}"
+    INITIAL, // "i {state}"
+    LABEL, // "l {state} {label}"
+    TRANSITION, // "{from} {symbol} {to}"
+    ERROR
+};
+
+// parses one line starting at p (without allocations), returns pointer to the start of the next line;
+// x, y, z get the numbers of the line
+const char* parse_text_line(const char* p, const char* end, TextLine& kind, uint32_t& x, uint32_t& y, uint32_t& z);
+
+// parses the header line ("dfa n k start" or "nfa n k"); returns pointer after it or nullptr if it is incorrect
+const char* parse_text_header(const char* p, const char* end, bool& is_dfa, uint32_t& size, uint32_t& alphabet_length, uint32_t& starting_node);
+
+// writes decimal x to buffer, returns pointer after the last digit
+char* write_number(char* buffer, uint32_t x);
+
+#endif
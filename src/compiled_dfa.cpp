@@ -0,0 +1,59 @@
+#include <cstdio>
+#include "compiled_dfa.h"
+#include "mapped_file.h"
+
+CompiledDFA::CompiledDFA(const DFA& dfa) {
+    const uint32_t n = dfa.get_size();
+    this->alphabet_length = dfa.get_alphabet_length();
+    const uint32_t stride = (this->alphabet_length + 2) & ~1U; // even and > alphabet_length
+    if ((uint64_t)n * stride >= ((uint64_t)1 << 32)) return; // cells are 32-bit, the table stays empty (!ok())
+    this->stride = stride;
+
+    auto cell = [this, &dfa](uint32_t s) {
+        return s * this->stride + (dfa.is_accepting(s) ? ACC_TAG : 0);
+    };
+    this->start_cell = cell(dfa.get_starting_node());
+    this->table.assign((uint64_t)n * this->stride, 0);
+    for (uint32_t a = 0; a < this->alphabet_length; ++a) {
+        for (uint32_t s = 0; s < n; ++s) this->table[cell(s) + a] = cell(dfa.get_transition(a, s));
+    }
+}
+
+int CompiledDFA::save(const char* filename) const {
+    if (!ok()) return 1;
+    FILE* file = fopen(filename, "wb");
+    if (file == nullptr) return 1;
+    const uint32_t header[4] = {this->alphabet_length, this->stride, this->start_cell, (uint32_t)this->table.size()};
+    bool correct = (fwrite(header, sizeof(header), 1, file) == 1);
+    if (correct && !this->table.empty()) correct = (fwrite(this->table.data(), sizeof(uint32_t) * this->table.size(), 1, file) == 1);
+    if (fclose(file) != 0) correct = false;
+    return (correct ? 0 : 1);
+}
+
+int CompiledDFA::load(const char* filename) {
+    MappedFile file(filename);
+    if (!file.ok()) return 1;
+    uint32_t header[4];
+    if (file.get_length() < sizeof(header)) return 1;
+    memcpy(header, file.get_data(), sizeof(header));
+    const uint32_t cells = header[3];
+    if (cells == 0 || header[1] <= header[0] || header[1] % 2 != 0 || cells % header[1] != 0 ||
+        file.get_length() != sizeof(header) + (uint64_t)cells * sizeof(uint32_t)) return 1;
+
+    table_vector<uint32_t> new_table(cells);
+    memcpy(new_table.data(), file.get_data() + sizeof(header), (uint64_t)cells * sizeof(uint32_t));
+    // every cell must point to a row which fits in the table (so matching never reads out of it)
+    auto correct_cell = [&header, cells](uint32_t x) {
+        return (uint64_t)x - (x & ACC_TAG) + header[1] <= cells && x % header[1] <= ACC_TAG;
+    };
+    if (!correct_cell(header[2])) return 1;
+    for (uint32_t x : new_table) {
+        if (!correct_cell(x)) return 1;
+    }
+
+    this->alphabet_length = header[0];
+    this->stride = header[1];
+    this->start_cell = header[2];
+    this->table.swap(new_table);
+    return 0;
+}
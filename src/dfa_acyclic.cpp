@@ -0,0 +1,166 @@
+#include "dfa_class.h"
+#include "hash_utils.h"
+
+// Minimization of acyclic DFAs in linear time (Revuz, 1992).
+// A state is "uniform" if all states reachable from it have its label (the sink after trimming, the
+// last state of bamboo); uniform states with one label are equivalent, they are leaves here.
+// Other states must form an acyclic graph. Height of a state is the length of the longest path from it
+// through non-uniform states; it depends only on the language of the state, so equivalent states have
+// the same height. Levels are processed from height 0: targets of a level are already merged,
+// so states of the level are equivalent iff they have the same signature (label, classes of targets).
+
+static const uint32_t UNVISITED = EMPTY_STATE;
+static const uint32_t IN_PROGRESS = EMPTY_STATE - 1;
+static const uint32_t UNIFORM = EMPTY_STATE - 2; // height of uniform states
+
+bool DFA::minimize_acyclic(bool debug) {
+    const uint32_t n = this->size, k = this->alphabet_length;
+
+    // post-order DFS: height of each state (or UNIFORM); a cycle through a non-uniform state means failure
+    table_vector<uint32_t> height(n, UNVISITED);
+    struct Frame {
+        uint32_t state;
+        uint32_t next_symbol;
+        uint32_t height; // 1 + max height of non-uniform targets so far (0 if there are none)
+        bool uniform; // all targets so far are uniform with the label of the state
+        bool self_loop;
+    };
+    std::vector<Frame> stack;
+    uint32_t max_height = 0;
+    for (uint32_t root = 0; root < n; ++root) {
+        if (height[root] != UNVISITED) continue;
+        height[root] = IN_PROGRESS;
+        stack.push_back({root, 0, 0, true, false});
+        while (!stack.empty()) {
+            Frame& top = stack.back();
+            if (top.next_symbol == k) {
+                if (top.self_loop && !top.uniform) return false;
+                const uint32_t s = top.state;
+                height[s] = (top.uniform ? UNIFORM : top.height);
+                if (!top.uniform && top.height > max_height) max_height = top.height;
+                stack.pop_back();
+                if (stack.empty()) break;
+                Frame& parent = stack.back();
+                if (height[s] == UNIFORM) {
+                    if (get_label(s) != get_label(parent.state)) parent.uniform = false;
+                } else {
+                    parent.uniform = false;
+                    if (height[s] + 1 > parent.height) parent.height = height[s] + 1;
+                }
+                continue;
+            }
+            const uint32_t s = top.state;
+            const uint32_t t = this->delta[top.next_symbol++][s];
+            if (t == s) {
+                top.self_loop = true;
+            } else if (height[t] == IN_PROGRESS) {
+                return false;
+            } else if (height[t] == UNVISITED) {
+                height[t] = IN_PROGRESS;
+                stack.push_back({t, 0, 0, true, false}); // top is not valid after it
+            } else if (height[t] == UNIFORM) {
+                if (get_label(t) != get_label(s)) top.uniform = false;
+            } else {
+                top.uniform = false;
+                if (height[t] + 1 > top.height) top.height = height[t] + 1;
+            }
+        }
+    }
+    std::vector<Frame>().swap(stack);
+
+    // uniform states get one class for each label
+    table_vector<uint32_t> new_idx(n);
+    std::vector<uint32_t> first_state; // class --> its first state
+    std::unordered_map<uint32_t, uint32_t> uniform_class; // label --> class
+    for (uint32_t s = 0; s < n; ++s) {
+        if (height[s] != UNIFORM) continue;
+        auto it = uniform_class.emplace(get_label(s), (uint32_t)first_state.size());
+        if (it.second) first_state.push_back(s);
+        new_idx[s] = it.first->second;
+    }
+
+    // other states are sorted by heights
+    table_vector<uint32_t> level_begin((uint64_t)max_height + 2, 0);
+    for (uint32_t s = 0; s < n; ++s) {
+        if (height[s] != UNIFORM) ++level_begin[height[s] + 1];
+    }
+    for (uint32_t h = 0; h <= max_height; ++h) level_begin[h + 1] += level_begin[h];
+    table_vector<uint32_t> level_states(level_begin[max_height + 1]);
+    {
+        table_vector<uint32_t> position(level_begin.begin(), level_begin.end() - 1);
+        for (uint32_t s = 0; s < n; ++s) {
+            if (height[s] != UNIFORM) level_states[position[height[s]]++] = s;
+        }
+    }
+    table_vector<uint32_t>().swap(height);
+
+    // signature hashing level by level: open addressing table of classes (2 slots for each state of the level at least)
+    table_vector<uint32_t> slot_class;
+    table_vector<uint64_t> class_hash; // class_hash[c - first_class] is hash of class c of the current level
+    for (uint32_t h = 0; h <= max_height; ++h) {
+        const uint32_t begin = level_begin[h], end = level_begin[h + 1];
+        uint64_t slots = 2;
+        while (slots < 2 * (uint64_t)(end - begin)) slots *= 2;
+        if (slot_class.size() < slots) slot_class.resize(slots);
+        std::fill(slot_class.begin(), slot_class.begin() + slots, EMPTY_STATE);
+        class_hash.clear();
+        const uint32_t first_class = (uint32_t)first_state.size();
+
+        for (uint32_t i = begin; i < end; ++i) {
+            const uint32_t s = level_states[i];
+            uint64_t hash = hash_mix(HASH_SEED, get_label(s));
+            for (uint32_t a = 0; a < k; ++a) hash = hash_mix(hash, new_idx[this->delta[a][s]]);
+
+            uint64_t slot = hash & (slots - 1);
+            while (true) {
+                const uint32_t c = slot_class[slot];
+                if (c == EMPTY_STATE) { // new class
+                    slot_class[slot] = (uint32_t)first_state.size();
+                    new_idx[s] = (uint32_t)first_state.size();
+                    first_state.push_back(s);
+                    class_hash.push_back(hash);
+                    break;
+                }
+                if (class_hash[c - first_class] == hash) {
+                    const uint32_t r = first_state[c];
+                    bool same = (get_label(r) == get_label(s));
+                    for (uint32_t a = 0; a < k && same; ++a) {
+                        same = (new_idx[this->delta[a][r]] == new_idx[this->delta[a][s]]);
+                    }
+                    if (same) {
+                        new_idx[s] = c;
+                        break;
+                    }
+                }
+                slot = (slot + 1) & (slots - 1);
+            }
+        }
+    }
+    table_vector<uint32_t>().swap(slot_class);
+    table_vector<uint64_t>().swap(class_hash);
+    table_vector<uint32_t>().swap(level_states);
+    table_vector<uint32_t>().swap(level_begin);
+
+    const uint32_t classes = (uint32_t)first_state.size();
+    if (debug) std::cout << "DFA is acyclic (" << max_height + 1 << " levels), " << classes << " classes\n";
+    this->iterations = 0;
+    this->minimized = true;
+    if (classes == n) return true;
+
+    std::vector<table_vector<uint32_t> > new_delta(k, table_vector<uint32_t>(classes));
+    for (uint32_t a = 0; a < k; ++a) {
+        for (uint32_t c = 0; c < classes; ++c) new_delta[a][c] = new_idx[this->delta[a][first_state[c]]];
+    }
+    std::vector<bool> new_acc(classes);
+    std::vector<uint32_t> new_labels(this->labels.empty() ? 0 : classes);
+    for (uint32_t c = 0; c < classes; ++c) {
+        new_acc[c] = this->acc[first_state[c]];
+        if (!this->labels.empty()) new_labels[c] = this->labels[first_state[c]];
+    }
+
+    forget_reversed_delta();
+    init(k, classes, new_idx[this->starting_node], std::move(new_delta), std::move(new_acc));
+    if (!new_labels.empty()) set_labels(std::move(new_labels));
+    this->minimized = true;
+    return true;
+}
@@ -1,5 +1,9 @@
+#include <thread>
 #include "dfa_class.h"
 #include "nfa_class.h"
+#include "text_format.h"
+#include "packed_format.h"
+#include "mapped_file.h"
 
 char integer2char(const uint32_t x) { // 0 <= x < 62
     assert(x < 62);
@@ -162,11 +166,68 @@ request_check correctness_of_dfa_input(char* command, char* dfa_str) {
         fclose(file);
         return {true, ""};
 
+    } else if (strcmp(command, "from_text_file") == 0 || strcmp(command, "from_nfa_text_file") == 0) {
+        // only the header is checked here, the rest of the file is checked while parsing
+        FILE* file = fopen(dfa_str, "r");
+        if (file == nullptr) {
+            return {false, "Error: when openning file"};
+        }
+        std::vector<char> beginning(1 << 16);
+        size_t length = fread(beginning.data(), 1, beginning.size(), file);
+        fclose(file);
+        bool is_dfa;
+        uint32_t _size, _alphabet_length, _starting_node;
+        const bool dfa_expected = (strcmp(command, "from_text_file") == 0);
+        if (parse_text_header(beginning.data(), beginning.data() + length, is_dfa, _size, _alphabet_length, _starting_node) == nullptr || is_dfa != dfa_expected) {
+            return {false, std::string("Error: file must start with \"") + (dfa_expected ? "dfa {size} {alphabet_length} {starting_node}" : "nfa {size} {alphabet_length}") + "\""};
+        }
+        return {true, ""};
+
+    } else if (strcmp(command, "from_packed_file") == 0) {
+        FILE* file = fopen(dfa_str, "rb");
+        if (file == nullptr) {
+            return {false, "Error: when openning file"};
+        }
+        char beginning[sizeof(PACKED_MAGIC) + sizeof(PackedHeader)];
+        size_t length = fread(beginning, 1, sizeof(beginning), file);
+        fclose(file);
+        PackedHeader header;
+        bool labeled;
+        if (parse_packed_header(beginning, beginning + length, header, labeled) == nullptr) {
+            return {false, "Error: incorrect header of compressed file"};
+        }
+        return {true, ""};
+
+    } else if (strcmp(command, "from_sorted_words") == 0) { // file with one word per line, see dictionary_builder.h
+        FILE* file = fopen(dfa_str, "r");
+        if (file == nullptr) {
+            return {false, "Error: when openning file"};
+        }
+        fclose(file);
+        return {true, ""};
+
     } else {
         return {false, "Error: Incorrect 1st argument"};
     }
 }
 
+int DFA::load_from_bin_file(const char* filename) {
+    // the file is mapped and its tables are read directly into delta and acc
+    MappedFile file(filename);
+    if (!file.ok()) return 1;
+    uint32_t header[3]; // size, alphabet_length, starting_node
+    if (file.get_length() < sizeof(header)) return 1;
+    memcpy(header, file.get_data(), sizeof(header));
+    const uint64_t table_bytes = (uint64_t)header[0] * header[1] * sizeof(uint32_t);
+    if (file.get_length() < sizeof(header) + table_bytes + ((uint64_t)header[0] + 7) / 8 || header[2] >= header[0]) return 1;
+    const uint32_t* table = (const uint32_t*)(file.get_data() + sizeof(header));
+    for (uint64_t i = 0; i < (uint64_t)header[0] * header[1]; ++i) {
+        if (table[i] >= header[0]) return 1;
+    }
+    init(header[1], header[0], header[2], table, (const uint8_t*)(table + (uint64_t)header[0] * header[1]));
+    return 0;
+}
+
 DFA::DFA(char* command, char* s) {
     if (strcmp(command, "from_dfa_string") == 0) {
         this->acc = {};
@@ -182,7 +243,7 @@ DFA::DFA(char* command, char* s) {
         uint32_t string_length = strlen(s);
         this->alphabet_length  = (string_length - 1) / this->size - 1;
         ++idx;
-        this->delta.assign(this->alphabet_length, std::vector<uint32_t>(this->size));
+        this->delta.assign(this->alphabet_length, table_vector<uint32_t>(this->size));
 
         while (idx < string_length) {
             this->delta[(idx - this->size - 1) % this->alphabet_length][(idx - this->size - 1) / this->alphabet_length] = char2integer(s[idx]);
@@ -192,7 +253,7 @@ DFA::DFA(char* command, char* s) {
     } else if (strcmp(command, "bamboo") == 0  || strcmp(command, "circle") == 0) {
         sscanf(s, "%d,%d", &(this->size), &(this->alphabet_length));
         this->acc.assign(this->size, false);
-        this->delta.assign(this->alphabet_length, std::vector<uint32_t>(this->size));
+        this->delta.assign(this->alphabet_length, table_vector<uint32_t>(this->size));
         this->acc[this->size - 1] = true;
         for (uint32_t s = 0; s < this->size - 1; ++s) {
             for (uint32_t a = 0; a < this->alphabet_length; ++a) {
@@ -208,7 +269,7 @@ DFA::DFA(char* command, char* s) {
         uint32_t _cycle_size;
         sscanf(s, "%d,%d", &(this->size), &_cycle_size);
         this->acc.assign(this->size, false);
-        this->delta.assign(this->alphabet_length, std::vector<uint32_t>(this->size));
+        this->delta.assign(this->alphabet_length, table_vector<uint32_t>(this->size));
         for (uint32_t s = 0; s < this->size - 1; ++s) {
             this->acc[s] = ((s + 1) % _cycle_size == 0);
             this->delta[0][s] = s + 1;
@@ -216,49 +277,26 @@ DFA::DFA(char* command, char* s) {
         this->acc[this->size - 1] = true;
         this->starting_node = 0;
     } else if (strcmp(command, "from_bin_file") == 0) {
-        FILE* file = fopen(s, "rb");
-        if (file == NULL) {
-            std::cerr << "couldn't open file\n";
-            return;
-        }
-
-        if (fread(&(this->size), sizeof(uint32_t), 1, file) != 1) goto error_happened;
-        if (fread(&(this->alphabet_length), sizeof(uint32_t), 1, file) != 1) goto error_happened;
-        if (fread(&(this->starting_node), sizeof(uint32_t), 1, file) != 1) goto error_happened;
-
-        this->delta.assign(this->alphabet_length, std::vector<uint32_t>(this->size));
-
-        for (uint32_t a = 0; a < this->alphabet_length; ++a) {
-            for (uint32_t i = 0; i < this->size; ++i) {
-                if (fread(&(this->delta[a][i]), sizeof(uint32_t), 1, file) != 1) {
-                    goto error_happened;
-                }
-            }
-        }
-
-        this->acc.assign(this->size, false);
-        for (uint32_t i = 0; i < this->size; i += 8) {
-            unsigned char c;
-            if (fread(&c, sizeof(unsigned char), 1, file) != 1) goto error_happened;
-            for (uint32_t j = 0; j < 8; ++j) {
-                if (i + j < this->size) {
-                    this->acc[i + j] = ((c & (1 << j)) ? true : false);
-                }
-            }
+        if (load_from_bin_file(s) != 0) {
+            std::cerr << "error while reading happened\n";
+            this->alphabet_length = 1;
+            this->size = 1;
+            this->starting_node = 0;
+            this->acc = {true};
+            this->delta = {{0}};
         }
 
-        fclose(file);
-        return;
-
-        error_happened:
-            fclose(file);
+    } else if (strcmp(command, "from_text_file") == 0 || strcmp(command, "from_packed_file") == 0) {
+        const uint32_t threads = std::thread::hardware_concurrency();
+        const bool text = (strcmp(command, "from_text_file") == 0);
+        if ((text ? load_from_text_file(s, threads) : load_from_packed_file(s, threads)) != 0) {
             std::cerr << "error while reading happened\n";
             this->alphabet_length = 1;
             this->size = 1;
             this->starting_node = 0;
             this->acc = {true};
             this->delta = {{0}};
-
+        }
     } else {
         this->alphabet_length = 1;
         this->size = 1;
@@ -0,0 +1,358 @@
+#include <algorithm>
+#include "dfa_class.h"
+#include "external_sort.h"
+
+// Out-of-core minimization.
+// The DFA is never loaded in RAM: transitions are streamed from the binary file (format of DFA::save_to_file)
+// and the current partition (block of every state) lives in a temporary file.
+// One round of Moore's refinement:
+//   1) for each char a: sort pairs (delta(s, a), s) by target and join them with the blocks file,
+//      so we get (s, a, block(delta(s, a))) without random access to the blocks;
+//   2) sort these triples by (s, a) and glue them with block(s) into a signature of s;
+//   3) sort signatures, equal signatures get equal new block numbers;
+//   4) sort (s, new_block) by s and write the new blocks file.
+// Rounds stop when the number of blocks doesn't change.
+// All sorters share the RAM budget given by mem_limit.
+
+static const uint64_t HEADER_BYTES = 3 * sizeof(uint32_t);
+
+uint64_t parse_memory_size(const char* s) {
+    char* end = nullptr;
+    unsigned long long value = strtoull(s, &end, 10);
+    if (end == s) return 0;
+    uint64_t multiplier = 1;
+    if (*end == 'K' || *end == 'k') multiplier = 1ULL << 10;
+    else if (*end == 'M' || *end == 'm') multiplier = 1ULL << 20;
+    else if (*end == 'G' || *end == 'g') multiplier = 1ULL << 30;
+    else if (*end != '\0') return 0;
+    if (*end != '\0' && *(end + 1) != '\0') return 0;
+    return (uint64_t)value * multiplier;
+}
+
+// reads acc/rej bits of all states one by one
+class AccBitsReader {
+private:
+    FILE* file;
+    std::vector<unsigned char> data;
+    size_t pos=0;
+    size_t length=0;
+    uint32_t bit=8;
+    unsigned char cur=0;
+public:
+    AccBitsReader(FILE* _file, uint64_t offset_in_bytes, uint64_t buffer_bytes) : file(_file), data(buffer_bytes ? buffer_bytes : 1) {
+        fseeko(this->file, (off_t)offset_in_bytes, SEEK_SET);
+    }
+    bool next(bool& x) {
+        if (this->bit == 8) {
+            if (this->pos == this->length) {
+                this->length = fread(this->data.data(), 1, this->data.size(), this->file);
+                this->pos = 0;
+                if (this->length == 0) return false;
+            }
+            this->cur = this->data[this->pos++];
+            this->bit = 0;
+        }
+        x = ((this->cur >> this->bit) & 1);
+        ++this->bit;
+        return true;
+    }
+};
+
+// pushes (s, a, block(delta(s, a))) for all states and chars into `out`
+static bool join_successor_blocks(FILE* file, FILE* blocks, uint32_t size, uint32_t alphabet_length,
+                                  uint64_t sorter_budget, uint64_t io_words, ExternalSorter& out) {
+    for (uint32_t a = 0; a < alphabet_length; ++a) {
+        ExternalSorter by_target(2, 1, sorter_budget);
+        WordReader delta_reader(file, HEADER_BYTES + (uint64_t)a * size * sizeof(uint32_t), size, io_words);
+        for (uint32_t s = 0; s < size; ++s) {
+            uint32_t record[2];
+            if (!delta_reader.next(record[0])) return false;
+            record[1] = s;
+            if (!by_target.push(record)) return false;
+        }
+        if (!by_target.finish()) return false;
+
+        WordReader blocks_reader(blocks, 0, size, io_words);
+        uint32_t cur_state = 0, cur_block = 0;
+        if (!blocks_reader.next(cur_block)) return false;
+        uint32_t record[2];
+        while (by_target.next(record)) {
+            while (cur_state < record[0]) { // targets are sorted, so we only go forward in blocks file
+                if (!blocks_reader.next(cur_block)) return false;
+                ++cur_state;
+            }
+            const uint32_t triple[3] = {record[1], a, cur_block};
+            if (!out.push(triple)) return false;
+        }
+    }
+    return out.finish();
+}
+
+// the DFA of the binary file and its stable partition (block of every state is in the blocks file)
+struct ExternalPartition {
+    FILE* file=nullptr;
+    FILE* blocks=nullptr;
+    uint32_t size=0;
+    uint32_t alphabet_length=0;
+    uint32_t starting_node=0;
+    uint32_t colors=0;
+    uint32_t rounds=0;
+    uint64_t acc_offset=0;
+    uint64_t sorter_budget=0;
+    uint64_t io_words=0;
+
+    ~ExternalPartition() {
+        if (this->blocks != nullptr) fclose(this->blocks);
+        if (this->file != nullptr) fclose(this->file);
+    }
+};
+
+// Moore's refinement until the partition is stable; returns 0 on success, 1 on errors (they are printed)
+static int refine_partition(char* filename, uint64_t mem_limit, bool debug, ExternalPartition& p) {
+    p.file = fopen(filename, "rb");
+    if (p.file == nullptr) {
+        std::cerr << "couldn't open file\n";
+        return 1;
+    }
+    FILE* file = p.file;
+    uint32_t size, alphabet_length, starting_node;
+    if (fread(&size, sizeof(uint32_t), 1, file) != 1 || fread(&alphabet_length, sizeof(uint32_t), 1, file) != 1 ||
+        fread(&starting_node, sizeof(uint32_t), 1, file) != 1 || size == 0 || alphabet_length == 0) {
+        std::cerr << "error while reading happened\n";
+        return 1;
+    }
+    p.size = size;
+    p.alphabet_length = alphabet_length;
+    p.starting_node = starting_node;
+    const uint64_t acc_offset = p.acc_offset = HEADER_BYTES + (uint64_t)alphabet_length * size * sizeof(uint32_t);
+
+    // at most 3 sorters are alive at the same time, the rest of the budget is for I/O buffers
+    const uint64_t sorter_budget = p.sorter_budget = mem_limit / 4;
+    const uint64_t io_words = p.io_words = mem_limit / 16 / sizeof(uint32_t);
+
+    FILE* blocks = p.blocks = tmpfile();
+    if (blocks == nullptr) {
+        std::cerr << "couldn't create temporary file\n";
+        return 1;
+    }
+
+    bool io_error = false;
+    // initial partition: acc states and rej states (acc bits are read twice, so they are not kept in RAM)
+    uint32_t& colors = p.colors;
+    {
+        bool has_acc = false, has_rej = false;
+        {
+            AccBitsReader acc_reader(file, acc_offset, io_words * sizeof(uint32_t));
+            for (uint32_t s = 0; s < size; ++s) {
+                bool x;
+                if (!acc_reader.next(x)) { io_error = true; break; }
+                if (x) has_acc = true;
+                else has_rej = true;
+            }
+        }
+        AccBitsReader acc_reader(file, acc_offset, io_words * sizeof(uint32_t));
+        WordWriter writer(blocks, io_words);
+        for (uint32_t s = 0; s < size && !io_error; ++s) {
+            bool x;
+            if (!acc_reader.next(x) || !writer.put(x ? 0 : (has_acc ? 1 : 0))) io_error = true;
+        }
+        if (!writer.flush()) io_error = true;
+        colors = (uint32_t)has_acc + (uint32_t)has_rej;
+    }
+
+    uint32_t& round = p.rounds;
+    while (!io_error) {
+        ExternalSorter by_state(3, 2, sorter_budget);
+        if (!join_successor_blocks(file, blocks, size, alphabet_length, sorter_budget, io_words, by_state)) { io_error = true; break; }
+
+        ExternalSorter by_signature(alphabet_length + 2, alphabet_length + 1, sorter_budget);
+        {
+            WordReader blocks_reader(blocks, 0, size, io_words);
+            std::vector<uint32_t> signature(alphabet_length + 2);
+            uint32_t triple[3];
+            for (uint32_t s = 0; s < size && !io_error; ++s) {
+                if (!blocks_reader.next(signature[0])) { io_error = true; break; }
+                for (uint32_t a = 0; a < alphabet_length; ++a) {
+                    if (!by_state.next(triple)) { io_error = true; break; }
+                    signature[a + 1] = triple[2];
+                }
+                signature[alphabet_length + 1] = s;
+                if (!by_signature.push(signature.data())) io_error = true;
+            }
+            if (io_error || !by_signature.finish()) { io_error = true; break; }
+        }
+
+        ExternalSorter new_blocks(2, 1, sorter_budget);
+        uint32_t new_colors = 0;
+        {
+            std::vector<uint32_t> signature(alphabet_length + 2), prev_signature(alphabet_length + 2);
+            while (by_signature.next(signature.data())) {
+                if (new_colors == 0 || !std::equal(signature.begin(), signature.begin() + alphabet_length + 1, prev_signature.begin())) {
+                    ++new_colors;
+                    prev_signature.swap(signature);
+                    const uint32_t pair[2] = {prev_signature[alphabet_length + 1], new_colors - 1};
+                    if (!new_blocks.push(pair)) { io_error = true; break; }
+                } else {
+                    const uint32_t pair[2] = {signature[alphabet_length + 1], new_colors - 1};
+                    if (!new_blocks.push(pair)) { io_error = true; break; }
+                }
+            }
+            if (io_error || !new_blocks.finish()) { io_error = true; break; }
+        }
+
+        ++round;
+        if (debug) std::cout << "ROUND " << round << ": " << new_colors << " blocks\n";
+
+        if (new_colors == colors) break; // partition is stable
+
+        rewind(blocks);
+        WordWriter writer(blocks, io_words);
+        uint32_t pair[2];
+        while (new_blocks.next(pair)) {
+            if (!writer.put(pair[1])) { io_error = true; break; }
+        }
+        if (!writer.flush()) io_error = true;
+        colors = new_colors;
+    }
+
+    if (io_error) {
+        std::cerr << "error while reading happened\n";
+        return 1;
+    }
+    return 0;
+}
+
+int external_minimization(char* filename, uint64_t mem_limit, bool debug, DFA& result) {
+    ExternalPartition p;
+    if (refine_partition(filename, mem_limit, debug, p) != 0) return 1;
+    const uint32_t alphabet_length = p.alphabet_length, colors = p.colors;
+
+    // the quotient DFA is built in RAM, it must fit in the budget too (otherwise it is saved by external_minimization_to_file)
+    if ((uint64_t)colors * alphabet_length * sizeof(uint32_t) + colors / 8 > mem_limit) {
+        std::cerr << "quotient DFA (" << colors << " states) doesn't fit in the memory limit\n";
+        return 1;
+    }
+    std::vector<table_vector<uint32_t> > new_delta(alphabet_length, table_vector<uint32_t>(colors, 0));
+    std::vector<bool> new_acc(colors, false);
+    uint32_t new_starting_node = 0;
+
+    bool io_error = false;
+    ExternalSorter by_state(3, 2, p.sorter_budget);
+    if (!join_successor_blocks(p.file, p.blocks, p.size, alphabet_length, p.sorter_budget, p.io_words, by_state)) io_error = true;
+    WordReader blocks_reader(p.blocks, 0, p.size, p.io_words);
+    AccBitsReader acc_reader(p.file, p.acc_offset, p.io_words);
+    uint32_t triple[3];
+    for (uint32_t s = 0; s < p.size && !io_error; ++s) {
+        uint32_t block;
+        bool x;
+        if (!blocks_reader.next(block) || !acc_reader.next(x)) { io_error = true; break; }
+        new_acc[block] = x;
+        if (s == p.starting_node) new_starting_node = block;
+        for (uint32_t a = 0; a < alphabet_length; ++a) {
+            if (!by_state.next(triple)) { io_error = true; break; }
+            new_delta[a][block] = triple[2];
+        }
+    }
+    if (io_error) {
+        std::cerr << "error while reading happened\n";
+        return 1;
+    }
+
+    if (debug) {
+        std::cout << "EXTERNAL MINIMIZATION FINISHED: " << p.rounds << " rounds\n";
+        std::cout << "Quotient DFA has " << colors << " states\n";
+    }
+    result = DFA(alphabet_length, colors, new_starting_node, std::move(new_delta), std::move(new_acc));
+    return 0;
+}
+
+int external_minimization_to_file(char* filename, uint64_t mem_limit, bool debug, char* out_filename) {
+    ExternalPartition p;
+    if (refine_partition(filename, mem_limit, debug, p) != 0) return 1;
+    const uint32_t alphabet_length = p.alphabet_length, colors = p.colors;
+
+    // every state gives the row of its block: (a, block, block of target) and (block, acc) are sorted
+    // by block and the repeated rows (equal, because the partition is stable) are skipped while writing
+    bool io_error = false;
+    ExternalSorter quotient_delta(3, 2, p.sorter_budget);
+    ExternalSorter quotient_acc(2, 1, p.sorter_budget);
+    uint32_t new_starting_node = 0;
+    {
+        ExternalSorter by_state(3, 2, p.sorter_budget);
+        if (!join_successor_blocks(p.file, p.blocks, p.size, alphabet_length, p.sorter_budget, p.io_words, by_state)) io_error = true;
+        WordReader blocks_reader(p.blocks, 0, p.size, p.io_words);
+        AccBitsReader acc_reader(p.file, p.acc_offset, p.io_words);
+        uint32_t triple[3];
+        for (uint32_t s = 0; s < p.size && !io_error; ++s) {
+            uint32_t block;
+            bool x;
+            if (!blocks_reader.next(block) || !acc_reader.next(x)) { io_error = true; break; }
+            if (s == p.starting_node) new_starting_node = block;
+            const uint32_t pair[2] = {block, (uint32_t)x};
+            if (!quotient_acc.push(pair)) { io_error = true; break; }
+            for (uint32_t a = 0; a < alphabet_length; ++a) {
+                if (!by_state.next(triple)) { io_error = true; break; }
+                const uint32_t row[3] = {a, block, triple[2]};
+                if (!quotient_delta.push(row)) { io_error = true; break; }
+            }
+        }
+    }
+    if (io_error || !quotient_delta.finish() || !quotient_acc.finish()) {
+        std::cerr << "error while reading happened\n";
+        return 1;
+    }
+
+    // the same format as DFA::save_to_file
+    FILE* out = fopen(out_filename, "wb");
+    if (out == nullptr) {
+        std::cerr << "couldn't open " << out_filename << "\n";
+        return 1;
+    }
+    const uint32_t header[3] = {colors, alphabet_length, new_starting_node};
+    if (fwrite(header, sizeof(uint32_t), 3, out) != 3) io_error = true;
+    {
+        WordWriter writer(out, p.io_words);
+        uint64_t written = 0;
+        uint32_t row[3], prev_row[3] = {0, 0, 0};
+        while (!io_error && quotient_delta.next(row)) {
+            if (written != 0 && row[0] == prev_row[0] && row[1] == prev_row[1]) continue;
+            if (row[0] != written / colors || row[1] != written % colors || !writer.put(row[2])) io_error = true;
+            std::copy(row, row + 3, prev_row);
+            ++written;
+        }
+        if (!writer.flush() || written != (uint64_t)colors * alphabet_length) io_error = true;
+    }
+    {
+        std::vector<unsigned char> bytes;
+        bytes.reserve(p.io_words * sizeof(uint32_t) + 1);
+        uint32_t written = 0;
+        uint32_t pair[2];
+        unsigned char cur = 0;
+        while (!io_error && quotient_acc.next(pair)) {
+            if (pair[0] < written) continue; // the block is already written
+            if (pair[0] != written) { io_error = true; break; }
+            if (pair[1] != 0) cur |= (unsigned char)(1 << (written % 8));
+            ++written;
+            if (written % 8 == 0 || written == colors) {
+                bytes.push_back(cur);
+                cur = 0;
+            }
+            if (bytes.size() > p.io_words * sizeof(uint32_t) || written == colors) {
+                if (fwrite(bytes.data(), 1, bytes.size(), out) != bytes.size()) io_error = true;
+                bytes.clear();
+            }
+        }
+        if (written != colors) io_error = true;
+    }
+    if (fclose(out) != 0) io_error = true;
+    if (io_error) {
+        std::cerr << "error happened when writing " << out_filename << "\n";
+        return 1;
+    }
+
+    if (debug) {
+        std::cout << "EXTERNAL MINIMIZATION FINISHED: " << p.rounds << " rounds\n";
+        std::cout << "Quotient DFA has " << colors << " states\n";
+    }
+    return 0;
+}
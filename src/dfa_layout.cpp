@@ -0,0 +1,89 @@
+#include <algorithm>
+#include "dfa_class.h"
+
+// After minimization numbers of states are numbers of blocks (in the order of their creation),
+// so states which are used together are far from each other in delta. Here states get new numbers
+// in the order of BFS or DFS from the starting node, or by the number of visits on sample words.
+
+std::vector<uint32_t> DFA::traversal_order(StateOrder order) const {
+    std::vector<uint32_t> result;
+    result.reserve(this->size);
+    std::vector<char> visited(this->size, 0);
+    visited[this->starting_node] = 1;
+
+    if (order == StateOrder::DFS) { // preorder, symbols are taken in increasing order
+        std::vector<std::pair<uint32_t, uint32_t> > stack = {{this->starting_node, 0}}; // (state, next symbol)
+        result.push_back(this->starting_node);
+        while (!stack.empty()) {
+            std::pair<uint32_t, uint32_t>& top = stack.back();
+            if (top.second == this->alphabet_length) {
+                stack.pop_back();
+                continue;
+            }
+            const uint32_t next = this->delta[top.second++][top.first];
+            if (!visited[next]) {
+                visited[next] = 1;
+                result.push_back(next);
+                stack.push_back({next, 0});
+            }
+        }
+    } else { // BFS, the result itself is the queue
+        result.push_back(this->starting_node);
+        for (size_t i = 0; i < result.size(); ++i) {
+            for (uint32_t a = 0; a < this->alphabet_length; ++a) {
+                const uint32_t next = this->delta[a][result[i]];
+                if (!visited[next]) {
+                    visited[next] = 1;
+                    result.push_back(next);
+                }
+            }
+        }
+    }
+
+    // unreachable states (if they weren't deleted) go to the end
+    for (uint32_t s = 0; s < this->size; ++s) {
+        if (!visited[s]) result.push_back(s);
+    }
+    return result;
+}
+
+void DFA::renumber_states(StateOrder order, const std::vector<std::vector<uint32_t> >& samples) {
+    std::vector<uint32_t> old_order = traversal_order(order == StateOrder::DFS ? StateOrder::DFS : StateOrder::BFS);
+
+    if (order == StateOrder::HOTNESS) { // the most visited states first, others keep BFS order
+        std::vector<uint64_t> visits(this->size, 0);
+        for (const std::vector<uint32_t>& word : samples) {
+            uint32_t q_cur = this->starting_node;
+            ++visits[q_cur];
+            for (uint32_t c : word) {
+                if (c >= this->alphabet_length) break;
+                q_cur = this->delta[c][q_cur];
+                ++visits[q_cur];
+            }
+        }
+        std::stable_sort(old_order.begin(), old_order.end(), [&visits](uint32_t x, uint32_t y) {
+            return visits[x] > visits[y];
+        });
+    }
+
+    std::vector<uint32_t> new_idx(this->size);
+    for (uint32_t i = 0; i < this->size; ++i) new_idx[old_order[i]] = i;
+
+    std::vector<table_vector<uint32_t> > new_delta(this->alphabet_length, table_vector<uint32_t>(this->size));
+    std::vector<bool> new_acc(this->size);
+    std::vector<uint32_t> new_labels(this->labels.size());
+    for (uint32_t i = 0; i < this->size; ++i) {
+        const uint32_t s = old_order[i];
+        for (uint32_t a = 0; a < this->alphabet_length; ++a) new_delta[a][i] = new_idx[this->delta[a][s]];
+        new_acc[i] = this->acc[s];
+        if (!this->labels.empty()) new_labels[i] = this->labels[s];
+    }
+
+    this->starting_node = new_idx[this->starting_node];
+    this->delta = std::move(new_delta);
+    this->acc = std::move(new_acc);
+    this->labels = std::move(new_labels);
+
+    // reversed delta (if it was constructed) is not correct now
+    forget_reversed_delta();
+}
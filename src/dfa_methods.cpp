@@ -1,4 +1,8 @@
 #include "dfa_class.h"
+#include "perf_counters.h"
+#include "parallel_utils.h"
+#include <thread>
+#include <algorithm>
 
 void DFA::init(uint32_t _alphabet_length, uint32_t _size, uint32_t _starting_node,
                std::vector<std::vector<uint32_t> > &table, std::vector<bool> &v_acc) {
@@ -12,11 +16,59 @@ void DFA::init(uint32_t _alphabet_length, uint32_t _size, uint32_t _starting_nod
     for (uint32_t i = 0; i < _alphabet_length; ++i) {
         assert(table[i].size() == _size);
     }
-    this->delta = table;
+    this->delta.assign(_alphabet_length, {});
+    for (uint32_t i = 0; i < _alphabet_length; ++i) this->delta[i].assign(table[i].begin(), table[i].end());
 
     // getting information about the states: acc or rej they are
     assert(v_acc.size() == this->size);
     this->acc = v_acc;
+    this->labels.clear();
+}
+
+void DFA::init(uint32_t _alphabet_length, uint32_t _size, uint32_t _starting_node,
+               std::vector<table_vector<uint32_t> > &&table, std::vector<bool> &&v_acc) {
+    assert(table.size() == _alphabet_length);
+    for (uint32_t i = 0; i < _alphabet_length; ++i) {
+        assert(table[i].size() == _size);
+    }
+    assert(v_acc.size() == _size);
+    this->size = _size;
+    this->alphabet_length = _alphabet_length;
+    this->starting_node = _starting_node;
+    this->delta = std::move(table);
+    this->acc = std::move(v_acc);
+    this->labels.clear();
+}
+
+void DFA::init(uint32_t _alphabet_length, uint32_t _size, uint32_t _starting_node,
+               std::vector<std::vector<uint32_t> > &&table, std::vector<bool> &&v_acc) {
+    assert(table.size() == _alphabet_length);
+    std::vector<table_vector<uint32_t> > own_table(_alphabet_length);
+    for (uint32_t i = 0; i < _alphabet_length; ++i) {
+        assert(table[i].size() == _size);
+        own_table[i].assign(table[i].begin(), table[i].end());
+        std::vector<uint32_t>().swap(table[i]);
+    }
+    init(_alphabet_length, _size, _starting_node, std::move(own_table), std::move(v_acc));
+}
+
+void DFA::init(uint32_t _alphabet_length, uint32_t _size, uint32_t _starting_node, const uint32_t* table, const uint8_t* acc_bits) {
+    std::vector<table_vector<uint32_t> > own_table(_alphabet_length);
+    for (uint32_t a = 0; a < _alphabet_length; ++a) own_table[a].assign(table + (uint64_t)a * _size, table + (uint64_t)(a + 1) * _size);
+    std::vector<bool> v_acc(_size);
+    for (uint32_t s = 0; s < _size; ++s) v_acc[s] = (acc_bits[s / 8] >> (s % 8)) & 1;
+    init(_alphabet_length, _size, _starting_node, std::move(own_table), std::move(v_acc));
+}
+
+void DFA::set_labels(const std::vector<uint32_t> &_labels) {
+    set_labels(std::vector<uint32_t>(_labels));
+}
+
+void DFA::set_labels(std::vector<uint32_t> &&_labels) {
+    assert(_labels.size() == this->size);
+    this->labels = std::move(_labels);
+    for (uint32_t s = 0; s < this->size; ++s) this->acc[s] = (this->labels[s] != 0);
+    this->minimized = false;
 }
 
 void DFA::print_table() const {
@@ -58,7 +110,9 @@ void DFA::print_table() const {
             while (next_copy >= 10) {next_copy /= 10; --spaces;}
             std::cout << "|" << std::string(spaces, ' ') << this->delta[i][node] << ' ';
         }
-        std::cout << "| " << (this->acc[node] ? "ACC" : "REJ") << '\n';
+        std::cout << "| " << (this->acc[node] ? "ACC" : "REJ");
+        if (!this->labels.empty() && this->acc[node]) std::cout << ' ' << this->labels[node];
+        std::cout << '\n';
         std::cout << std::string(spaces_per_cell * (this->alphabet_length + 1) + this->alphabet_length + 7, '=') << '\n';
     }
 }
@@ -72,6 +126,12 @@ bool DFA::check_string(std::vector<uint32_t> &str) const {
         return this->acc[q_cur];
 }
 
+uint32_t DFA::classify_string(std::vector<uint32_t> &str) const {
+    uint32_t q_cur = this->starting_node;
+    for (uint32_t c : str) q_cur = this->delta[c][q_cur];
+    return get_label(q_cur);
+}
+
 void DFA::delete_unreachable_states() {
     if (this->deleted_unreachable_states) return;
     // we will color all states in 3 colors:
@@ -114,13 +174,15 @@ void DFA::delete_unreachable_states() {
     }
 
     // new delta function and in
-    std::vector<std::vector<uint32_t> > new_delta(this->alphabet_length, std::vector<uint32_t>(new_size));
+    std::vector<table_vector<uint32_t> > new_delta(this->alphabet_length, table_vector<uint32_t>(new_size));
     std::vector<bool> new_v_acc(new_size);
+    std::vector<uint32_t> new_labels(this->labels.empty() ? 0 : new_size);
 
 
     for (uint32_t i = 0; i < this->size; ++i) {
         if (colors[i] == 2) { // if state is visited
             new_v_acc[node2new_idx[i]] = this->acc[i];
+            if (!this->labels.empty()) new_labels[node2new_idx[i]] = this->labels[i];
             for (uint32_t a = 0; a < this->alphabet_length; ++a) {
                 new_delta[a][node2new_idx[i]] = node2new_idx[this->delta[a][i]];
             }
@@ -131,135 +193,329 @@ void DFA::delete_unreachable_states() {
     this->starting_node = node2new_idx[this->starting_node];
     this->delta = std::move(new_delta);
     this->acc = std::move(new_v_acc);
+    this->labels = std::move(new_labels);
 
     this->deleted_unreachable_states = true;
 }
 
 
-void DFA::construct_reversed_delta() {
-    if (this->constructed_reversed_delta) return;
+// swap with empty vector really frees the memory (clear() doesn't)
+template <typename T>
+static void release(T& container) {
+    T().swap(container);
+}
 
-    // reversed delta will be a vector of size*alphabet_length (instead of vector<vector<vector>>>)
-    // for each state s and char a reversed_delta_lengths[a][s] is number of states t: delta(t, a) = s
-    // reversed_delta[addresses_for_reversed_delta[a][s]], reversed_delta[addresses_for_reversed_delta[a][s] + 1], ...
-    // ..., reversed_delta[addresses_for_reversed_delta[a][s] + reversed_delta_lengths[a][s] - 1] are all states t
-    // such as delta(t, a) = s
-    this->addresses_for_reversed_delta.assign(this->alphabet_length, std::vector<uint32_t>(this->size, 0));
-    this->reversed_delta.assign(this->size * this->alphabet_length, 0);
-    std::vector<std::vector<uint32_t> > reversed_delta_lengths(this->alphabet_length, std::vector<uint32_t>(this->size, 0));
+static const uint64_t MIN_TRANSITIONS_PER_THREAD = 1 << 20;
 
+void DFA::construct_reversed_delta(uint32_t threads) {
+    if (this->constructed_reversed_delta) return;
+    const uint64_t transitions = (uint64_t)this->size * this->alphabet_length;
+    threads = std::min<uint64_t>({(uint64_t)threads, this->alphabet_length, transitions / MIN_TRANSITIONS_PER_THREAD});
+    if (threads > 1) {
+        construct_reversed_delta_parallel(threads);
+        return;
+    }
+
+    // 1st pass: number of incoming transitions and incoming pairs of every state
+    // (symbols go in increasing order, so transitions to one state by one symbol are seen one after another)
+    std::vector<uint32_t> last_symbol(this->size, EMPTY_STATE);
+    std::vector<uint32_t> position(this->size + 1, 0); // in_degree at first
+    this->pair_begin.assign(this->size + 1, 0);
     for (uint32_t a = 0; a < this->alphabet_length; ++a) {
         for (uint32_t s = 0; s < this->size; ++s) {
-            ++reversed_delta_lengths[a][this->delta[a][s]];
+            const uint32_t t = this->delta[a][s];
+            ++position[t + 1];
+            if (last_symbol[t] != a) {
+                last_symbol[t] = a;
+                ++this->pair_begin[t + 1];
+            }
         }
     }
+    for (uint32_t s = 0; s < this->size; ++s) {
+        position[s + 1] += position[s];
+        this->pair_begin[s + 1] += this->pair_begin[s];
+    }
 
-    uint32_t cur = 0;
+    // 2nd pass in the same order: transitions to t are put at position[t], each new symbol starts a new pair of t
+    const uint32_t pairs = this->pair_begin[this->size];
+    this->pair_symbol.assign(pairs, 0);
+    this->reversed_begin.assign(pairs + 1, 0);
+    this->reversed_delta.assign(this->size * this->alphabet_length, 0);
+    std::vector<uint32_t> next_pair(this->pair_begin.begin(), this->pair_begin.end() - 1);
+    last_symbol.assign(this->size, EMPTY_STATE);
     for (uint32_t a = 0; a < this->alphabet_length; ++a) {
         for (uint32_t s = 0; s < this->size; ++s) {
-            this->addresses_for_reversed_delta[a][s] = cur;
-            cur += reversed_delta_lengths[a][s];
+            const uint32_t t = this->delta[a][s];
+            if (last_symbol[t] != a) {
+                last_symbol[t] = a;
+                const uint32_t p = next_pair[t]++;
+                this->pair_symbol[p] = a;
+                this->reversed_begin[p] = position[t];
+            }
+            this->reversed_delta[position[t]++] = s;
         }
     }
+    this->reversed_begin[pairs] = this->size * this->alphabet_length;
 
-    std::vector<std::vector<uint32_t> > addresses_for_put = this->addresses_for_reversed_delta;
+    this->constructed_reversed_delta = true;
+}
 
-    for (uint32_t s = 0; s < this->size; ++s) {
-        for (uint32_t a = 0; a < this->alphabet_length; ++a) {
-            const uint32_t address_to_put = addresses_for_put[a][this->delta[a][s]];
-            this->reversed_delta[address_to_put] = s;
-            ++addresses_for_put[a][delta[a][s]];
+void DFA::construct_reversed_delta_parallel(uint32_t threads) {
+    const uint32_t n = this->size;
+    const uint64_t m = (uint64_t)n * this->alphabet_length;
+    // thread j takes transitions x in [range_begin(m, j), range_begin(m, j + 1)), x = a * n + s is (a, s) in the order
+    // of the serial version; reversed_delta keeps x until the pairs are found, then it becomes s
+    std::vector<std::vector<uint32_t> > count(threads); // count[j][t]: transitions of thread j to t, then where it writes them
+    run_in_threads(threads, [&](uint32_t j) {
+        count[j].assign(n, 0);
+        const uint64_t from = range_begin(m, j, threads), to = range_begin(m, j + 1, threads);
+        uint32_t a = (uint32_t)(from / n), s = (uint32_t)(from % n);
+        for (uint64_t x = from; x < to; ++x) {
+            ++count[j][this->delta[a][s]];
+            if (++s == n) { s = 0; ++a; }
         }
-    }
+    });
+
+    // in_degree[t], then offsets of threads inside transitions to t
+    std::vector<uint32_t> in_degree(n);
+    run_in_threads(threads, [&](uint32_t j) {
+        const uint32_t to = (uint32_t)range_begin(n, j + 1, threads);
+        for (uint32_t t = (uint32_t)range_begin(n, j, threads); t < to; ++t) {
+            uint32_t sum = 0;
+            for (uint32_t i = 0; i < threads; ++i) {
+                const uint32_t c = count[i][t];
+                count[i][t] = sum;
+                sum += c;
+            }
+            in_degree[t] = sum;
+        }
+    });
+    std::vector<uint32_t> position;
+    parallel_prefix_sum(n, threads, position, [&](uint32_t t) { return in_degree[t]; });
+
+    // stable scatter: ranges of threads go in the order of transitions, so sources of t stay sorted by (a, s)
+    this->reversed_delta.assign(m, 0);
+    run_in_threads(threads, [&](uint32_t j) {
+        std::vector<uint32_t>& offset = count[j];
+        const uint64_t from = range_begin(m, j, threads), to = range_begin(m, j + 1, threads);
+        uint32_t a = (uint32_t)(from / n), s = (uint32_t)(from % n);
+        for (uint64_t x = from; x < to; ++x) {
+            const uint32_t t = this->delta[a][s];
+            this->reversed_delta[position[t] + offset[t]++] = (uint32_t)x;
+            if (++s == n) { s = 0; ++a; }
+        }
+        std::vector<uint32_t>().swap(offset);
+    });
+
+    // pairs of t are the runs of one symbol in its sorted sources (in_degree becomes the number of pairs)
+    run_in_threads(threads, [&](uint32_t j) {
+        const uint32_t to = (uint32_t)range_begin(n, j + 1, threads);
+        for (uint32_t t = (uint32_t)range_begin(n, j, threads); t < to; ++t) {
+            uint32_t pairs = 0;
+            uint64_t next_symbol_start = 0;
+            for (uint32_t i = position[t]; i < position[t + 1]; ++i) {
+                if (this->reversed_delta[i] >= next_symbol_start) {
+                    ++pairs;
+                    next_symbol_start = (this->reversed_delta[i] / n + 1) * (uint64_t)n;
+                }
+            }
+            in_degree[t] = pairs;
+        }
+    });
+    parallel_prefix_sum(n, threads, this->pair_begin, [&](uint32_t t) { return in_degree[t]; });
+    std::vector<uint32_t>().swap(in_degree);
+
+    const uint32_t pairs = this->pair_begin[n];
+    this->pair_symbol.assign(pairs, 0);
+    this->reversed_begin.assign(pairs + 1, 0);
+    run_in_threads(threads, [&](uint32_t j) {
+        const uint32_t to = (uint32_t)range_begin(n, j + 1, threads);
+        for (uint32_t t = (uint32_t)range_begin(n, j, threads); t < to; ++t) {
+            uint32_t p = this->pair_begin[t], a = 0;
+            uint64_t next_symbol_start = 0;
+            for (uint32_t i = position[t]; i < position[t + 1]; ++i) {
+                const uint32_t x = this->reversed_delta[i];
+                if (x >= next_symbol_start) {
+                    a = x / n;
+                    next_symbol_start = (a + 1) * (uint64_t)n;
+                    this->pair_symbol[p] = a;
+                    this->reversed_begin[p++] = i;
+                }
+                this->reversed_delta[i] = x - a * n;
+            }
+        }
+    });
+    this->reversed_begin[pairs] = (uint32_t)m;
 
     this->constructed_reversed_delta = true;
 }
 
 
+uint32_t DFA::create_B_cap(const uint32_t a, const uint32_t block) {
+    uint32_t cap;
+    if (!this->free_B_caps.empty()) {
+        cap = this->free_B_caps.back();
+        this->free_B_caps.pop_back();
+    } else {
+        cap = (uint32_t)this->B_cap_first.size();
+        this->B_cap_first.push_back(EMPTY_STATE);
+        this->B_cap_lengths.push_back(0);
+        this->B_cap_symbol.push_back(0);
+        this->B_cap_next_of_block.push_back(EMPTY_STATE);
+        this->B_cap_in_L.push_back(false);
+    }
+    this->B_cap_first[cap] = EMPTY_STATE;
+    this->B_cap_lengths[cap] = 0;
+    this->B_cap_symbol[cap] = a;
+    this->B_cap_in_L[cap] = false;
+    this->B_cap_next_of_block[cap] = this->block_first_B_cap[block];
+    this->block_first_B_cap[block] = cap;
+    return cap;
+}
+
+void DFA::collect_B_caps_of_block(const uint32_t block) {
+    uint32_t prev = EMPTY_STATE;
+    uint32_t cap = this->block_first_B_cap[block];
+    while (cap != EMPTY_STATE) {
+        const uint32_t next = this->B_cap_next_of_block[cap];
+        if (this->B_cap_lengths[cap] == 0 && !this->B_cap_in_L[cap]) { // all its pairs went to other blocks
+            if (prev == EMPTY_STATE) this->block_first_B_cap[block] = next;
+            else this->B_cap_next_of_block[prev] = next;
+            this->free_B_caps.push_back(cap);
+        } else {
+            this->old_B_cap_of_symbol[this->B_cap_symbol[cap]] = cap;
+            prev = cap;
+        }
+        cap = next;
+    }
+}
+
+void DFA::forget_B_caps_of_block(const uint32_t block, table_vector<uint32_t>& B_cap_of_symbol) {
+    for (uint32_t cap = this->block_first_B_cap[block]; cap != EMPTY_STATE; cap = this->B_cap_next_of_block[cap]) {
+        B_cap_of_symbol[this->B_cap_symbol[cap]] = EMPTY_STATE;
+    }
+}
+
+
 void DFA::color_acc_and_rej_in_2_colors() {
     // size >= 2
-    this->next_B_cap.assign(this->alphabet_length, std::vector<uint32_t>(this->size, EMPTY_STATE));
-    this->prev_B_cap.assign(this->alphabet_length, std::vector<uint32_t>(this->size, EMPTY_STATE));
-    
-    this->block2first_state_in_it.assign(this->size, EMPTY_STATE); // 0 --> EMPTY_STATE; 1 --> EMPTY_STATE
-    this->block_and_char2first_B_cap.assign(this->alphabet_length, std::vector<uint32_t>(this->size, EMPTY_STATE));
+    const bool use_B_caps = (this->refinement_mode == RefinementMode::SYMBOL);
+    this->L.clear();
+    this->iterations = 0;
+    if (use_B_caps) {
+        this->next_B_cap.assign(this->pair_begin[this->size], EMPTY_STATE);
+        this->prev_B_cap.assign(this->pair_begin[this->size], EMPTY_STATE);
+        this->B_cap_first.clear();
+        this->B_cap_lengths.clear();
+        this->B_cap_symbol.clear();
+        this->B_cap_next_of_block.clear();
+        this->B_cap_in_L.clear();
+        this->free_B_caps.clear();
+        // every nonempty B_cap has its own pair, so usually there are less B_caps than pairs
+        this->B_cap_first.reserve(this->pair_begin[this->size]);
+        this->B_cap_lengths.reserve(this->pair_begin[this->size]);
+        this->B_cap_symbol.reserve(this->pair_begin[this->size]);
+        this->B_cap_next_of_block.reserve(this->pair_begin[this->size]);
+        this->B_cap_in_L.reserve(this->pair_begin[this->size]);
+        this->block_first_B_cap.assign(this->size, EMPTY_STATE);
+        this->old_B_cap_of_symbol.assign(this->alphabet_length, EMPTY_STATE);
+        this->new_B_cap_of_symbol.assign(this->alphabet_length, EMPTY_STATE);
+    } else {
+        this->block_in_L.assign(this->size, false);
+        this->symbol_sources_begin.assign(this->alphabet_length + 1, 0);
+    }
 
-    // for color v and char a B_cap_lengths[a][v] is number of states s,
-    // such as s is colored in v-th color and is reachable by symbol a (exists state t: delta(t, a) = s)
-    this->B_cap_lengths.assign(this->alphabet_length, std::vector<uint32_t>(this->size, 0));
+    this->block2first_state_in_it.assign(this->size, EMPTY_STATE); // 0 --> EMPTY_STATE; 1 --> EMPTY_STATE
     this->states_info.assign(this->size, {UINT32_MAX, EMPTY_STATE, EMPTY_STATE});
-
-    uint32_t last_acc = EMPTY_STATE; uint32_t last_rej = EMPTY_STATE; // last acc and rej states during iteration
+    this->is_sep_state.assign(this->size, false);
     this->block_lengths.assign(size, 0);
 
-    std::vector<uint32_t> last0(this->alphabet_length, EMPTY_STATE), last1(this->alphabet_length, EMPTY_STATE); // for B_cap(B(0), a) and B_cap(B(1), a) for each a in alphabet
-    for (uint32_t s = 0; s < this->size; ++s) {
-        if (this->acc[s]) {
-            ++this->block_lengths[0];
-            for (uint32_t a = 0; a < this->alphabet_length; ++a) {
-                if (get_reversed_delta_length(a, s)) { // possible to get to s by a
-                    ++this->B_cap_lengths[a][0]; // counter of acc states in which it's possible to get with a
-                    this->prev_B_cap[a][s] = last0[a];
-                    if (last0[a] == EMPTY_STATE) {
-                        this->block_and_char2first_B_cap[a][0] = s;
-                    } else {
-                        this->next_B_cap[a][last0[a]] = s;
-                    }
-                    last0[a] = s;
-                }
-            }
+    // acc states have color 0, rej --- color 1; with labels every label has its color
+    // (in order of the first state with it, so DFA with labels 1 and 0 is colored as without labels)
+    if (this->labels.empty()) {
+        for (uint32_t s = 0; s < this->size; ++s) this->states_info[s].block = (this->acc[s] ? 0 : 1);
+        this->colors = 2;
+    } else {
+        std::unordered_map<uint32_t, uint32_t> label2block;
+        for (uint32_t s = 0; s < this->size; ++s) {
+            auto it = label2block.emplace(this->labels[s], (uint32_t)label2block.size()).first;
+            this->states_info[s].block = it->second;
+        }
+        this->colors = (uint32_t)label2block.size();
+    }
+    if (this->prepartition_rounds > 0) {
+        perf_phase(this->perf_report, "prepartition");
+        refine_by_signatures(this->prepartition_rounds);
+        perf_phase(this->perf_report, "initial partition");
+    }
 
-            this->states_info[s].prev_state_of_same_block = last_acc;
-            if (last_acc == EMPTY_STATE) {
-                this->block2first_state_in_it[0] = s;
-            } else {
-                this->states_info[last_acc].next_state_of_same_block = s;
-            }
-            this->states_info[s].block = 0; // acc have color 0
-            last_acc = s;
-        } else {
-            ++this->block_lengths[1];
-            for (uint32_t a = 0; a < this->alphabet_length; ++a) {
-                if (get_reversed_delta_length(a, s)) { // possible to get to s by a:
-                    ++this->B_cap_lengths[a][1];
-                    this->prev_B_cap[a][s] = last1[a];
-                    if (last1[a] == EMPTY_STATE) {
-                        this->block_and_char2first_B_cap[a][1] = s;
-                    } else {
-                        this->next_B_cap[a][last1[a]] = s;
-                    }
-                    last1[a] = s;
-                }
+    // states are taken block by block (counting sort), so B_caps of the current block are in old_B_cap_of_symbol
+    std::vector<uint32_t> block_begin(this->colors + 1, 0);
+    for (uint32_t s = 0; s < this->size; ++s) ++block_begin[this->states_info[s].block + 1];
+    for (uint32_t b = 0; b < this->colors; ++b) block_begin[b + 1] += block_begin[b];
+    std::vector<uint32_t> states_by_block(this->size);
+    for (uint32_t s = 0; s < this->size; ++s) states_by_block[block_begin[this->states_info[s].block]++] = s;
+
+    // new_B_cap_of_symbol: the biggest B_cap of every symbol (it doesn't go to L)
+    uint32_t first = 0;
+    for (uint32_t block = 0; block < this->colors; ++block) {
+        uint32_t last_state = EMPTY_STATE;
+        for (; first < block_begin[block]; ++first) {
+            const uint32_t s = states_by_block[first];
+            ++this->block_lengths[block];
+            for (uint32_t p = this->pair_begin[s]; use_B_caps && p < this->pair_begin[s + 1]; ++p) { // possible to get to s by pair_symbol[p]
+                const uint32_t a = this->pair_symbol[p];
+                if (this->old_B_cap_of_symbol[a] == EMPTY_STATE) this->old_B_cap_of_symbol[a] = create_B_cap(a, block);
+                const uint32_t cap = this->old_B_cap_of_symbol[a];
+                this->next_B_cap[p] = this->B_cap_first[cap];
+                if (this->B_cap_first[cap] != EMPTY_STATE) this->prev_B_cap[this->B_cap_first[cap]] = p;
+                this->B_cap_first[cap] = p;
+                ++this->B_cap_lengths[cap];
             }
 
-            this->states_info[s].prev_state_of_same_block = last_rej;
-            if (last_rej == EMPTY_STATE) {
-                this->block2first_state_in_it[1] = s;
+            this->states_info[s].prev_state_of_same_block = last_state;
+            if (last_state == EMPTY_STATE) {
+                this->block2first_state_in_it[block] = s;
             } else {
-                this->states_info[last_rej].next_state_of_same_block = s;                
+                this->states_info[last_state].next_state_of_same_block = s;
             }
-            this->states_info[s].block = 1;
-            last_rej = s;
+            last_state = s;
         }
+        if (!use_B_caps) continue;
+        for (uint32_t cap = this->block_first_B_cap[block]; cap != EMPTY_STATE; cap = this->B_cap_next_of_block[cap]) {
+            uint32_t& biggest = this->new_B_cap_of_symbol[this->B_cap_symbol[cap]];
+            if (biggest == EMPTY_STATE || this->B_cap_lengths[cap] >= this->B_cap_lengths[biggest]) biggest = cap;
+        }
+        forget_B_caps_of_block(block, this->old_B_cap_of_symbol);
     }
 
-    if (last_acc != EMPTY_STATE) this->states_info[last_acc].next_state_of_same_block = EMPTY_STATE; // at least one acc found
-    if (last_rej != EMPTY_STATE) this->states_info[last_rej].next_state_of_same_block = EMPTY_STATE; // at least one rej found
-    
-    this->info_L.assign(this->alphabet_length, std::vector<bool>(this->size, false));
-    for (uint32_t a = 0; a < this->alphabet_length; ++a) {
-        if (this->B_cap_lengths[a][0] <= this->B_cap_lengths[a][1]) {
-            this->L.push(std::make_pair(a, 0));
-            this->info_L[a][0] = true;
-        } else {
-            this->L.push(std::make_pair(a, 1));
-            this->info_L[a][1] = true;
+    if (!use_B_caps) { // all blocks except the biggest one are splitters for all symbols
+        uint32_t biggest = 0;
+        for (uint32_t block = 1; block < this->colors; ++block) {
+            if (this->block_lengths[block] >= this->block_lengths[biggest]) biggest = block;
+        }
+        for (uint32_t block = 0; block < this->colors; ++block) {
+            if (block == biggest) continue;
+            this->L.push(block, this->block_lengths[block]);
+            this->block_in_L[block] = true;
         }
+        return;
     }
-    
-    this->colors = 2;
+
+    // for every symbol a all B_caps (B, a) except the biggest one go to L
+    // (for 2 blocks it is the smaller of B_cap(0, a) and B_cap(1, a); if one is empty, there is nothing to split by)
+    for (uint32_t block = 0; block < this->colors; ++block) {
+        for (uint32_t cap = this->block_first_B_cap[block]; cap != EMPTY_STATE; cap = this->B_cap_next_of_block[cap]) {
+            if (this->new_B_cap_of_symbol[this->B_cap_symbol[cap]] == cap) continue;
+            this->L.push(cap, this->B_cap_lengths[cap]);
+            this->B_cap_in_L[cap] = true;
+        }
+    }
+    this->new_B_cap_of_symbol.assign(this->alphabet_length, EMPTY_STATE);
+
 }
 
+// old_B_cap_of_symbol must have B_caps of the block of s, new_B_cap_of_symbol --- B_caps of new_block
 void DFA::extract_state_to_new_block(const uint32_t s, const uint32_t new_block) {
     const uint32_t old_block = this->states_info[s].block;
     const uint32_t old_prev = this->states_info[s].prev_state_of_same_block;
@@ -284,62 +540,102 @@ void DFA::extract_state_to_new_block(const uint32_t s, const uint32_t new_block)
         this->states_info[new_next].prev_state_of_same_block = s;
     }
     
-    for (uint32_t c = 0; c < this->alphabet_length; ++c) {
-        if (get_reversed_delta_length(c, s)) {
-            --this->B_cap_lengths[c][old_block];
-            ++this->B_cap_lengths[c][new_block];
-
-            if (this->prev_B_cap[c][s] != EMPTY_STATE) {
-                this->next_B_cap[c][this->prev_B_cap[c][s]] = this->next_B_cap[c][s];
-            } else {
-                this->block_and_char2first_B_cap[c][old_block] = this->next_B_cap[c][s];
-            }
+    // in BLOCK mode there are no B_caps
+    for (uint32_t p = this->pair_begin[s]; this->refinement_mode == RefinementMode::SYMBOL && p < this->pair_begin[s + 1]; ++p) {
+        const uint32_t c = this->pair_symbol[p];
+        const uint32_t old_cap = this->old_B_cap_of_symbol[c];
+        --this->B_cap_lengths[old_cap];
+
+        if (this->prev_B_cap[p] != EMPTY_STATE) {
+            this->next_B_cap[this->prev_B_cap[p]] = this->next_B_cap[p];
+        } else {
+            this->B_cap_first[old_cap] = this->next_B_cap[p];
+        }
 
-            if (this->next_B_cap[c][s] != EMPTY_STATE) {
-                this->prev_B_cap[c][this->next_B_cap[c][s]] = this->prev_B_cap[c][s];
-            }
+        if (this->next_B_cap[p] != EMPTY_STATE) {
+            this->prev_B_cap[this->next_B_cap[p]] = this->prev_B_cap[p];
+        }
 
-            this->next_B_cap[c][s] = this->block_and_char2first_B_cap[c][new_block];
-            this->prev_B_cap[c][s] = EMPTY_STATE;
-            
-            if (this->block_and_char2first_B_cap[c][new_block] != EMPTY_STATE) {
-                this->prev_B_cap[c][this->block_and_char2first_B_cap[c][new_block]] = s;
-            }
+        if (this->new_B_cap_of_symbol[c] == EMPTY_STATE) this->new_B_cap_of_symbol[c] = create_B_cap(c, new_block);
+        const uint32_t new_cap = this->new_B_cap_of_symbol[c];
+        ++this->B_cap_lengths[new_cap];
 
-            this->block_and_char2first_B_cap[c][new_block] = s;
+        this->next_B_cap[p] = this->B_cap_first[new_cap];
+        this->prev_B_cap[p] = EMPTY_STATE;
+        if (this->B_cap_first[new_cap] != EMPTY_STATE) {
+            this->prev_B_cap[this->B_cap_first[new_cap]] = p;
         }
+        this->B_cap_first[new_cap] = p;
     }
 
     this->states_info[s].block = new_block;                        
 }
 
 
+void DFA::add_sep_state(const uint32_t sep_state) {
+    this->sep_states.push_back(sep_state);
+    this->is_sep_state[sep_state] = true;
+
+    const uint32_t sep_state_color = this->states_info[sep_state].block;
+    if (this->blocks_info.find(sep_state_color) == this->blocks_info.end()) {
+        this->blocks_info[sep_state_color] = {1, EMPTY_STATE, false, 0};
+    } else {
+        ++this->blocks_info[sep_state_color].states2extract;
+    }
+}
+
 bool DFA::minimize_iteration() {
     if (this->colors == this->size || this->L.empty()) return true; // number of blocks == size => nothing to minimize
 
-    const std::pair<uint32_t, uint32_t>& extracted_pair = this->L.front();
-    this->L.pop();
-    const uint32_t a = extracted_pair.first;
-    const uint32_t i = extracted_pair.second;
+    const uint32_t splitter = this->L.pop();
+    ++this->iterations;
 
-    
-    uint32_t state_i = this->block_and_char2first_B_cap[a][i];
-    while (state_i != EMPTY_STATE) {
-        for (uint32_t t = this->addresses_for_reversed_delta[a][state_i]; t < next_address_for_reversed_delta(a, state_i); ++t) {
-            const uint32_t sep_state = this->reversed_delta[t]; // delta(sep_state, a) in B(i)
-            this->sep_states.push_back(sep_state);
-            
-            const uint32_t sep_state_color = this->states_info[sep_state].block;
-            if (this->blocks_info.find(sep_state_color) == this->blocks_info.end()) {
-                this->blocks_info[sep_state_color] = {1, EMPTY_STATE};
-            } else {
-                ++this->blocks_info[sep_state_color].states2extract;
+    if (this->refinement_mode == RefinementMode::SYMBOL) {
+        this->B_cap_in_L[splitter] = false;
+        for (uint32_t p = this->B_cap_first[splitter]; p != EMPTY_STATE; p = this->next_B_cap[p]) {
+            for (uint32_t t = this->reversed_begin[p]; t < this->reversed_begin[p + 1]; ++t) {
+                add_sep_state(this->reversed_delta[t]); // delta(sep_state, a) in B(i)
             }
         }
+        split_blocks();
+        return false;
+    }
 
-        state_i = this->next_B_cap[a][state_i];
+    // BLOCK mode: sources of all transitions to the block are read once and grouped by symbols
+    // (by counting sort: pairs of the states give the number of sources for each symbol)
+    this->block_in_L[splitter] = false;
+    table_vector<uint32_t>& begin = this->symbol_sources_begin;
+    for (uint32_t s = this->block2first_state_in_it[splitter]; s != EMPTY_STATE; s = this->states_info[s].next_state_of_same_block) {
+        for (uint32_t p = this->pair_begin[s]; p < this->pair_begin[s + 1]; ++p) {
+            begin[this->pair_symbol[p] + 1] += this->reversed_begin[p + 1] - this->reversed_begin[p];
+        }
+    }
+    for (uint32_t a = 0; a < this->alphabet_length; ++a) begin[a + 1] += begin[a];
+    this->splitter_sources.resize(begin[this->alphabet_length]);
+    for (uint32_t s = this->block2first_state_in_it[splitter]; s != EMPTY_STATE; s = this->states_info[s].next_state_of_same_block) {
+        for (uint32_t p = this->pair_begin[s]; p < this->pair_begin[s + 1]; ++p) {
+            uint32_t& place = begin[this->pair_symbol[p]];
+            for (uint32_t t = this->reversed_begin[p]; t < this->reversed_begin[p + 1]; ++t) {
+                this->splitter_sources[place++] = this->reversed_delta[t];
+            }
+        }
     }
+    // now begin[a] is the end of sources of a (and the start of sources of a + 1)
 
+    // splitting by (a, splitter) for every symbol a; splitter itself may be divided by previous symbols,
+    // but its states were read before, so we split by the old block (which is a union of the new ones)
+    for (uint32_t a = 0; a < this->alphabet_length; ++a) {
+        const uint32_t from = (a == 0 ? 0 : begin[a - 1]);
+        if (from == begin[a]) continue;
+        for (uint32_t i = from; i < begin[a]; ++i) add_sep_state(this->splitter_sources[i]);
+        split_blocks();
+    }
+    std::fill(begin.begin(), begin.end(), 0);
+    return false;
+}
+
+void DFA::split_blocks() {
+    uint32_t sorted_sep_states_length = 0;
     for (auto& block_info : this->blocks_info) {
         const uint32_t block = block_info.first;
         const uint32_t new_block_size = block_info.second.states2extract;
@@ -349,133 +645,340 @@ bool DFA::minimize_iteration() {
         } else {
             new_block = this->colors;
             ++this->colors;
+            this->sep_blocks.push_back(block);
 
             if (this->block_lengths[block] < 2 * new_block_size) {
+                // most of the states are separated, so it's cheaper to move the other states
+                // (we can't check the block of delta(s, a) here: block i itself might be already divided)
+                if (this->refinement_mode == RefinementMode::SYMBOL) collect_B_caps_of_block(block);
                 uint32_t s = this->block2first_state_in_it[block];
                 while (s != EMPTY_STATE) {
                     const uint32_t next_state = this->states_info[s].next_state_of_same_block;
-                    if (this->states_info[this->delta[a][s]].block != i) {
+                    if (!this->is_sep_state[s]) {
                         extract_state_to_new_block(s, new_block);
                     }
                     s = next_state;            
                 }
+                if (this->refinement_mode == RefinementMode::SYMBOL) {
+                    forget_B_caps_of_block(block, this->old_B_cap_of_symbol);
+                    forget_B_caps_of_block(new_block, this->new_B_cap_of_symbol);
+                }
 
                 this->block_lengths[new_block] = block_lengths[block] - new_block_size;
                 this->block_lengths[block] = new_block_size;
-                new_block = EMPTY_STATE;
+                block_info.second.extract_sep_states = false;
             } else {
                 this->block_lengths[block] -= new_block_size;
                 this->block_lengths[new_block] = new_block_size;
-                this->sep_blocks.push_back(block);
+                block_info.second.extract_sep_states = true;
+                block_info.second.sep_states_begin = sorted_sep_states_length;
+                sorted_sep_states_length += new_block_size;
             }
         }
     }
 
+    // sep_states are grouped by blocks, so B_caps of one block are collected once
+    this->sorted_sep_states.resize(sorted_sep_states_length);
     for (const uint32_t sep_state: this->sep_states) {
-        const uint32_t new_block = this->blocks_info[this->states_info[sep_state].block].new_color;
-        if (new_block != EMPTY_STATE) {
-            extract_state_to_new_block(sep_state, new_block);
+        this->is_sep_state[sep_state] = false;
+        info& block_info = this->blocks_info[this->states_info[sep_state].block];
+        if (block_info.new_color != EMPTY_STATE && block_info.extract_sep_states) {
+            this->sorted_sep_states[block_info.sep_states_begin++] = sep_state;
+        }
+    }
+    for (const uint32_t block : this->sep_blocks) {
+        const info& block_info = this->blocks_info[block];
+        if (!block_info.extract_sep_states) continue;
+        if (this->refinement_mode == RefinementMode::SYMBOL) collect_B_caps_of_block(block);
+        for (uint32_t i = block_info.sep_states_begin - block_info.states2extract; i < block_info.sep_states_begin; ++i) {
+            extract_state_to_new_block(this->sorted_sep_states[i], block_info.new_color);
+        }
+        if (this->refinement_mode == RefinementMode::SYMBOL) {
+            forget_B_caps_of_block(block, this->old_B_cap_of_symbol);
+            forget_B_caps_of_block(block_info.new_color, this->new_B_cap_of_symbol);
         }
     }
 
-
-    for (uint32_t c = 0; c < this->alphabet_length; ++c) {
+    if (this->refinement_mode == RefinementMode::BLOCK) { // new block or the smaller part goes to L for all symbols
         for (auto j : this->sep_blocks) {
-            uint32_t new_color = this->blocks_info[j].new_color;
+            const uint32_t new_color = this->blocks_info[j].new_color;
+            const uint32_t smaller = (this->block_in_L[j] || this->block_lengths[new_color] <= this->block_lengths[j] ? new_color : j);
+            this->L.push(smaller, this->block_lengths[smaller]);
+            this->block_in_L[smaller] = true;
+        }
+    }
 
-            if (this->info_L[c][j]) {
-                this->L.push(std::make_pair(c, new_color));
-                this->info_L[c][new_color] = true;
+    // B_caps of new blocks are nonempty; B_cap(j, c) which is empty can't split anything
+    for (auto j : this->sep_blocks) {
+        if (this->refinement_mode == RefinementMode::BLOCK) break;
+        const uint32_t new_color = this->blocks_info[j].new_color;
+        collect_B_caps_of_block(j);
+        for (uint32_t new_cap = this->block_first_B_cap[new_color]; new_cap != EMPTY_STATE; new_cap = this->B_cap_next_of_block[new_cap]) {
+            const uint32_t old_cap = this->old_B_cap_of_symbol[this->B_cap_symbol[new_cap]];
+            if (old_cap == EMPTY_STATE) continue;
+
+            if (this->B_cap_in_L[old_cap] || this->B_cap_lengths[new_cap] <= this->B_cap_lengths[old_cap]) {
+                this->L.push(new_cap, this->B_cap_lengths[new_cap]);
+                this->B_cap_in_L[new_cap] = true;
             } else {
-                if (this->B_cap_lengths[c][new_color] <= this->B_cap_lengths[c][j]) {
-                    this->L.push(std::make_pair(c, new_color));
-                    this->info_L[c][new_color] = true;
-                } else {
-                    this->L.push(std::make_pair(c, j));
-                    this->info_L[c][j] = true;
-                }
+                this->L.push(old_cap, this->B_cap_lengths[old_cap]);
+                this->B_cap_in_L[old_cap] = true;
             }
         }
+        forget_B_caps_of_block(j, this->old_B_cap_of_symbol);
     }
 
     this->sep_blocks.clear();
     this->sep_states.clear();
-    this->blocks_info.clear();
-
-    return false;
+    // clear() of unordered_map takes O(buckets): after a splitter which touched many blocks it would be slow forever
+    if (this->blocks_info.bucket_count() > 64 * (this->blocks_info.size() + 16)) std::unordered_map<uint32_t, info>().swap(this->blocks_info);
+    else this->blocks_info.clear();
 }
 
-void DFA::minimization(bool debug) {
-    if (this->minimized) {
-        if (debug) std::cout << "Already minimized\n";
-        return;
-    }
-
-    if (!this->deleted_unreachable_states) {
-        if (debug) std::cout << "DELETING UNREACHABLE STATES...\n";
-        delete_unreachable_states();
+bool DFA::start_minimization(bool debug) {
+    if (!this->trimmed_states) {
+        if (debug) std::cout << "DELETING UNREACHABLE AND DEAD STATES...\n";
+        perf_phase(this->perf_report, "trim");
+        trim_states(std::thread::hardware_concurrency());
+        perf_end(this->perf_report);
+        if (debug) std::cout << "It has " << this->size << " states after trimming\n";
     }
 
     if (this->size < 2) {
         if (debug) std::cout << "Size is " << this->size << ", sowe don't need to minimize\n";
-        return;
+        this->minimized = true;
+        return true;
+    }
+
+    // if all states are acc (or all are rej, or all have one label), they are all equivalent:
+    // color_acc_and_rej_in_2_colors needs at least 2 kinds
+    bool all_states_same_type = true;
+    for (uint32_t s = 1; s < this->size && all_states_same_type; ++s) {
+        if (get_label(s) != get_label(0)) all_states_same_type = false;
+    }
+    if (all_states_same_type) {
+        std::vector<table_vector<uint32_t> > one_state_delta(this->alphabet_length, table_vector<uint32_t>(1, 0));
+        std::vector<bool> one_state_acc(1, this->acc[0]);
+        std::vector<uint32_t> one_state_label(this->labels.empty() ? 0 : 1, get_label(0));
+        init(this->alphabet_length, 1, 0, std::move(one_state_delta), std::move(one_state_acc));
+        if (!one_state_label.empty()) set_labels(std::move(one_state_label));
+        this->minimized = true;
+        if (debug) std::cout << "All states are " << (this->acc[0] ? "ACC" : "REJ") << ", DFA has 1 state now\n";
+        return true;
     }
 
+    if (this->unary_fast_path && this->alphabet_length == 1) {
+        perf_phase(this->perf_report, "unary");
+        minimize_unary(debug);
+        perf_end(this->perf_report);
+        if (debug) std::cout << "It has " << this->size << " states now\n";
+        return true;
+    }
+
+    if (this->acyclic_fast_path) {
+        perf_phase(this->perf_report, "acyclic");
+        const bool done = minimize_acyclic(debug);
+        perf_end(this->perf_report);
+        if (done) {
+            if (debug) std::cout << "It has " << this->size << " states now\n";
+            return true;
+        }
+        if (debug) std::cout << "DFA has cycles\n";
+    }
+
+    // in arena mode all tables of refinement are cut from one arena, it is freed at once at the end
+    // (it is kept in the DFA, so time-sliced minimization can go on in another thread)
+    if (this->arena_mode) this->refinement_arena = std::make_shared<TableArena>();
+    TableArena* outer_arena = get_table_arena();
+    if (this->refinement_arena) set_table_arena(this->refinement_arena.get());
+
     if (!this->constructed_reversed_delta) {
         if (debug) std::cout << "CONSTRUCTING REVERSED DELTA\n";
-        construct_reversed_delta();
+        perf_phase(this->perf_report, "reversed delta");
+        construct_reversed_delta(std::thread::hardware_concurrency());
     }
 
-    if (debug) std::cout << "MINIMIZATION STARTED...\n";    
+    if (debug) std::cout << "MINIMIZATION STARTED...\n";
+    perf_phase(this->perf_report, "initial partition");
     color_acc_and_rej_in_2_colors();
+    perf_end(this->perf_report);
 
+    set_table_arena(outer_arena);
+    this->refining = true;
+    return false;
+}
+
+void DFA::finish_minimization(bool debug) {
+    TableArena* outer_arena = get_table_arena();
+    if (this->refinement_arena) set_table_arena(this->refinement_arena.get());
+
+    // only blocks of states are needed to build the quotient DFA
+    perf_phase(this->perf_report, "quotient");
+    forget_refinement();
+    if (this->refinement_arena) this->refinement_arena->freeze(); // the new DFA must outlive the arena
+
+    if (this->colors == this->size) {
+        this->minimized = true;
+        if (this->arena_mode) forget_reversed_delta(); // it may be in the arena
+        release(this->states_info);
+        release(this->block2first_state_in_it);
+    } else {
+        // if dfa became smaller, these fields are not correct< so delete them
+        forget_reversed_delta();
+
+        std::vector<table_vector<uint32_t> > new_delta(this->alphabet_length, table_vector<uint32_t>(this->colors));
+        std::vector<bool> new_acc(this->colors);
+
+        for (uint32_t a = 0; a < this->alphabet_length; ++a) {
+            for (uint32_t s = 0; s < this->colors; ++s) {
+                new_delta[a][s] = this->states_info[this->delta[a][this->block2first_state_in_it[s]]].block;
+            }
+        }
+
+        std::vector<uint32_t> new_labels(this->labels.empty() ? 0 : this->colors);
+        for (uint32_t s = 0; s < this->colors; ++s) {
+            new_acc[s] = this->acc[this->block2first_state_in_it[s]];
+            if (!this->labels.empty()) new_labels[s] = this->labels[this->block2first_state_in_it[s]];
+        }
+
+        const uint32_t new_starting_node = this->states_info[this->starting_node].block;
+        release(this->states_info);
+        release(this->block2first_state_in_it);
+        init(this->alphabet_length, this->colors, new_starting_node, std::move(new_delta), std::move(new_acc));
+        if (!new_labels.empty()) set_labels(std::move(new_labels));
+        this->minimized = true;
+    }
+    set_table_arena(outer_arena);
+    this->refinement_arena = nullptr;
+    this->refining = false;
+    perf_end(this->perf_report);
+
+    if (debug) {
+        std::cout << "DFA UPDATED\n";
+        std::cout << "It has " << size << " states now\n";
+    }
+}
+
+void DFA::minimization(bool debug) {
+    if (this->minimized) {
+        if (debug) std::cout << "Already minimized\n";
+        return;
+    }
+    if (!this->refining && start_minimization(debug)) return;
+
+    TableArena* outer_arena = get_table_arena();
+    if (this->refinement_arena) set_table_arena(this->refinement_arena.get());
+    perf_phase(this->perf_report, "refinement");
     bool finish = false;
     uint32_t it = 0;
     while (!finish) {
         finish = minimize_iteration();
         ++it;
     }
+    perf_end(this->perf_report);
+    set_table_arena(outer_arena);
 
     if (debug) {
         std::cout << "MINIMIZATION FINISHED SUCCESSFULLY\n";
         std::cout << it << " iterations happened\n";
         std::cout << "UPDATING DFA...\n";
     }
+    finish_minimization(debug);
+}
 
-    if (this->colors == this->size) {
-        this->minimized = true;
-        if (debug) {
-            std::cout << "DFA UPDATED\n";
-            std::cout << "It has " << size << " states now\n";
-        }
-        return;
-    }
+static const uint64_t BUDGET_CHECK_INTERVAL = 64; // iterations between checks of time and cancel
 
-    std::vector<std::vector<uint32_t> > new_delta(this->alphabet_length, std::vector<uint32_t>(this->colors));
-    std::vector<bool> new_acc(this->colors);
+MinimizationStatus DFA::minimization_step(const MinimizationBudget& budget, const std::function<void(const MinimizationProgress&)>& progress,
+                                          const std::atomic<bool>* cancel) {
+    const auto start = std::chrono::steady_clock::now();
+    auto cancelled = [cancel]() {
+        return cancel != nullptr && cancel->load(std::memory_order_relaxed);
+    };
+    auto out_of_time = [&budget, &start]() {
+        return budget.seconds > 0 && std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() >= budget.seconds;
+    };
 
-    for (uint32_t a = 0; a < this->alphabet_length; ++a) {
-        for (uint32_t s = 0; s < this->colors; ++s) {
-            new_delta[a][s] = this->states_info[this->delta[a][this->block2first_state_in_it[s]]].block;
+    MinimizationStatus status = MinimizationStatus::DONE;
+    if (this->minimized) {
+        status = MinimizationStatus::DONE;
+    } else if (cancelled()) {
+        cancel_minimization();
+        status = MinimizationStatus::CANCELLED;
+    } else if (this->refining || !start_minimization(false)) {
+        TableArena* outer_arena = get_table_arena();
+        if (this->refinement_arena) set_table_arena(this->refinement_arena.get());
+        perf_phase(this->perf_report, "refinement");
+        uint64_t done = 0;
+        status = (out_of_time() ? MinimizationStatus::PAUSED : MinimizationStatus::DONE);
+        while (status == MinimizationStatus::DONE && !minimize_iteration()) {
+            ++done;
+            if (budget.iterations != 0 && done >= budget.iterations) status = MinimizationStatus::PAUSED;
+            if (done % BUDGET_CHECK_INTERVAL == 0) {
+                if (cancelled()) status = MinimizationStatus::CANCELLED;
+                else if (out_of_time()) status = MinimizationStatus::PAUSED;
+            }
         }
-    }
+        perf_end(this->perf_report);
+        set_table_arena(outer_arena);
 
-    for (uint32_t s = 0; s < this->colors; ++s) {
-        new_acc[s] = this->acc[this->block2first_state_in_it[s]];
+        if (status == MinimizationStatus::CANCELLED) cancel_minimization();
+        else if (status == MinimizationStatus::DONE) finish_minimization(false);
     }
 
-    init(this->alphabet_length, this->colors, this->states_info[this->starting_node].block, new_delta, new_acc);
-    this->minimized = true;
+    if (progress) progress(get_minimization_progress());
+    return status;
+}
+
+void DFA::cancel_minimization() {
+    if (!this->refining) return;
+    TableArena* outer_arena = get_table_arena();
+    if (this->refinement_arena) set_table_arena(this->refinement_arena.get());
+    forget_refinement();
+    forget_reversed_delta();
+    release(this->states_info);
+    release(this->block2first_state_in_it);
+    std::unordered_map<uint32_t, info>().swap(this->blocks_info);
+    set_table_arena(outer_arena);
+    this->refinement_arena = nullptr;
+    this->refining = false;
+}
+
+MinimizationProgress DFA::get_minimization_progress() const {
+    if (this->minimized) return {this->size, this->size, 0, this->iterations};
+    if (!this->refining) return {0, this->size, 0, 0};
+    return {this->colors, this->size, (uint64_t)this->L.size(), this->iterations};
+}
+
 
-    // if dfa became smaller, these fields are not correct< so delete them
+void DFA::forget_reversed_delta() {
     this->constructed_reversed_delta = false;
-    this->addresses_for_reversed_delta.clear();
-    this->reversed_delta.clear();
+    release(this->pair_begin);
+    release(this->pair_symbol);
+    release(this->reversed_begin);
+    release(this->reversed_delta);
+}
 
-    if (debug) {
-        std::cout << "DFA UPDATED\n";
-        std::cout << "It has " << size << " states now\n";
-    }
+void DFA::forget_refinement() {
+    release(this->next_B_cap);
+    release(this->prev_B_cap);
+    release(this->B_cap_first);
+    release(this->B_cap_lengths);
+    release(this->B_cap_symbol);
+    release(this->B_cap_next_of_block);
+    release(this->B_cap_in_L);
+    release(this->free_B_caps);
+    release(this->block_first_B_cap);
+    release(this->old_B_cap_of_symbol);
+    release(this->new_B_cap_of_symbol);
+    this->L.clear();
+    release(this->block_in_L);
+    release(this->symbol_sources_begin);
+    release(this->splitter_sources);
+    release(this->sep_blocks);
+    release(this->sep_states);
+    release(this->sorted_sep_states);
+    release(this->is_sep_state);
+    release(this->block_lengths);
 }
 
 
@@ -493,12 +996,12 @@ void DFA::print_current_classes_of_equality() const {
             s = this->states_info[s].next_state_of_same_block;
         }
         std::cout << '\n';
-        for (uint32_t a = 0; a < this->alphabet_length; ++a) {
-            std::cout << a << "-reachable: ";
-            uint32_t s_it = this->block_and_char2first_B_cap[a][block];
-            while (s_it != EMPTY_STATE) {
+        for (uint32_t cap = this->block_first_B_cap[block]; cap != EMPTY_STATE; cap = this->B_cap_next_of_block[cap]) {
+            std::cout << this->B_cap_symbol[cap] << "-reachable: ";
+            for (uint32_t p = this->B_cap_first[cap]; p != EMPTY_STATE; p = this->next_B_cap[p]) {
+                // state of pair p
+                const uint32_t s_it = (uint32_t)(std::upper_bound(this->pair_begin.begin(), this->pair_begin.end(), p) - this->pair_begin.begin()) - 1;
                 std::cout << s_it << ' ';
-                s_it = this->next_B_cap[a][s_it];
             }
             std::cout << '\n';
         }
@@ -542,6 +1045,21 @@ int DFA::save_to_file(char* filename) const {
 }
 
 
+DFA& DFA::operator=(DFA&& other) noexcept {
+    // member-wise assignment would free the tables of a paused minimization without its arena,
+    // so this DFA is destroyed (it cancels the minimization) and constructed again
+    if (this != &other) {
+        this->~DFA();
+        new (this) DFA(std::move(other));
+    }
+    return *this;
+}
+
+DFA& DFA::operator=(const DFA& other) {
+    if (this != &other) *this = DFA(other);
+    return *this;
+}
+
 bool DFA::operator==(const DFA& other) const {
     // we compare only minimized DFAs
     if (!this->minimized || !this->minimized) return false;
@@ -569,7 +1087,7 @@ bool DFA::operator==(const DFA& other) const {
 
     for (uint32_t i = 0; i < this->size; ++i) {
         if (dict[i] == EMPTY_STATE) return false;
-        if (this->acc[i] != other.acc[dict[i]]) return false;
+        if (this->get_label(i) != other.get_label(dict[i])) return false;
     }
 
     return true;
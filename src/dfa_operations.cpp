@@ -0,0 +1,118 @@
+#include "dfa_class.h"
+
+// Product of two DFAs over the same alphabet.
+// Only pairs (p, q) reachable from (starting_node, other.starting_node) are built,
+// so the size of the result is the number of reachable pairs, not |A|*|B|.
+// Pairs are interned in a flat open-addressing hash table: pair --> index of the state in product.
+
+namespace {
+
+class PairTable {
+private:
+    static constexpr uint64_t EMPTY_KEY = UINT64_MAX; // (p, q) with p, q < EMPTY_STATE never gives this key
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> values;
+    uint64_t mask;
+    uint64_t used=0;
+
+    static uint64_t hash(uint64_t key) { // splitmix64 finalizer
+        key ^= key >> 30; key *= 0xbf58476d1ce4e5b9ULL;
+        key ^= key >> 27; key *= 0x94d049bb133111ebULL;
+        key ^= key >> 31;
+        return key;
+    }
+
+    void grow() {
+        std::vector<uint64_t> old_keys = std::move(this->keys);
+        std::vector<uint32_t> old_values = std::move(this->values);
+        this->keys.assign(old_keys.size() * 2, EMPTY_KEY);
+        this->values.assign(old_keys.size() * 2, 0);
+        this->mask = this->keys.size() - 1;
+        for (size_t i = 0; i < old_keys.size(); ++i) {
+            if (old_keys[i] == EMPTY_KEY) continue;
+            uint64_t pos = hash(old_keys[i]) & this->mask;
+            while (this->keys[pos] != EMPTY_KEY) pos = (pos + 1) & this->mask;
+            this->keys[pos] = old_keys[i];
+            this->values[pos] = old_values[i];
+        }
+    }
+
+public:
+    explicit PairTable(uint64_t expected) {
+        uint64_t capacity = 16;
+        while (capacity < 2 * expected) capacity *= 2;
+        this->keys.assign(capacity, EMPTY_KEY);
+        this->values.assign(capacity, 0);
+        this->mask = capacity - 1;
+    }
+
+    // returns index of pair (p, q); if it is new, it gets index new_value and `inserted` becomes true
+    uint32_t find_or_insert(uint32_t p, uint32_t q, uint32_t new_value, bool& inserted) {
+        const uint64_t key = ((uint64_t)p << 32) | q;
+        uint64_t pos = hash(key) & this->mask;
+        while (this->keys[pos] != EMPTY_KEY) {
+            if (this->keys[pos] == key) { inserted = false; return this->values[pos]; }
+            pos = (pos + 1) & this->mask;
+        }
+        this->keys[pos] = key;
+        this->values[pos] = new_value;
+        inserted = true;
+        if (2 * (++this->used) > this->keys.size()) grow(); // load factor <= 1/2
+        return new_value;
+    }
+};
+
+}
+
+DFA DFA::product(const DFA& other, ProductType type) const {
+    assert(this->alphabet_length == other.alphabet_length);
+
+    PairTable table((uint64_t)this->size + other.size);
+    std::vector<std::pair<uint32_t, uint32_t> > pairs; // pairs[i] is the pair of product state i (BFS order)
+    std::vector<table_vector<uint32_t> > new_delta(this->alphabet_length);
+
+    bool inserted;
+    table.find_or_insert(this->starting_node, other.starting_node, 0, inserted);
+    pairs.push_back(std::make_pair(this->starting_node, other.starting_node));
+
+    for (size_t cur = 0; cur < pairs.size(); ++cur) {
+        const uint32_t p = pairs[cur].first;
+        const uint32_t q = pairs[cur].second;
+        for (uint32_t a = 0; a < this->alphabet_length; ++a) {
+            const uint32_t next_p = this->delta[a][p];
+            const uint32_t next_q = other.delta[a][q];
+            assert(pairs.size() < EMPTY_STATE); // product must have < 2^32 - 1 states
+            const uint32_t idx = table.find_or_insert(next_p, next_q, (uint32_t)pairs.size(), inserted);
+            if (inserted) pairs.push_back(std::make_pair(next_p, next_q));
+            new_delta[a].push_back(idx);
+        }
+    }
+
+    const uint32_t new_size = (uint32_t)pairs.size();
+    std::vector<bool> new_acc(new_size);
+    for (uint32_t s = 0; s < new_size; ++s) {
+        const bool acc1 = this->acc[pairs[s].first];
+        const bool acc2 = other.acc[pairs[s].second];
+        switch (type) {
+            case ProductType::INTERSECTION: new_acc[s] = acc1 && acc2; break;
+            case ProductType::UNION: new_acc[s] = acc1 || acc2; break;
+            case ProductType::DIFFERENCE: new_acc[s] = acc1 && !acc2; break;
+        }
+    }
+
+    DFA result(this->alphabet_length, new_size, 0, std::move(new_delta), std::move(new_acc));
+    result.deleted_unreachable_states = true; // all states of the product are reachable by construction
+    return result;
+}
+
+DFA DFA::intersect(const DFA& other) const {
+    return product(other, ProductType::INTERSECTION);
+}
+
+DFA DFA::unite(const DFA& other) const {
+    return product(other, ProductType::UNION);
+}
+
+DFA DFA::difference(const DFA& other) const {
+    return product(other, ProductType::DIFFERENCE);
+}
@@ -0,0 +1,55 @@
+#include "dfa_class.h"
+#include "hash_utils.h"
+#include "parallel_utils.h"
+
+// Pre-partition for Hopcroft's algorithm: a few rounds of Moore's algorithm with hashing.
+// In one round state s gets the key (block of s, hash of blocks of delta(s, a) for all a), states with equal
+// keys get one new block. Equivalent states always have equal keys, so no class is split; the block of s is
+// a part of the key, so blocks are only split (and stay inside labels). A collision of hashes only keeps two
+// states together, then Hopcroft's algorithm splits them. So the result of minimization is the same.
+
+static const uint32_t MIN_STATES_PER_THREAD = 1 << 16;
+
+void DFA::refine_by_signatures(uint32_t rounds) {
+    const uint32_t n = this->size, k = this->alphabet_length;
+    const uint32_t threads = threads_for(n, MIN_STATES_PER_THREAD);
+
+    table_vector<uint64_t> signature(n);
+    // open addressing table of keys: slot --> (block, signature, new block)
+    uint64_t slots = 2;
+    while (slots < 2 * (uint64_t)n) slots *= 2;
+    table_vector<uint32_t> slot_block(slots), slot_new_block(slots);
+    table_vector<uint64_t> slot_signature(slots);
+
+    for (uint32_t round = 0; round < rounds && this->colors < n; ++round) {
+        // signatures are computed in parallel (blocks are only read here)
+        run_in_threads(threads, [&](uint32_t j) {
+            const uint64_t to = range_begin(n, j + 1, threads);
+            for (uint64_t s = range_begin(n, j, threads); s < to; ++s) {
+                uint64_t h = HASH_SEED;
+                for (uint32_t a = 0; a < k; ++a) h = hash_mix(h, this->states_info[this->delta[a][s]].block);
+                signature[s] = h;
+            }
+        });
+
+        std::fill(slot_new_block.begin(), slot_new_block.end(), EMPTY_STATE);
+        uint32_t new_colors = 0;
+        for (uint32_t s = 0; s < n; ++s) {
+            const uint32_t block = this->states_info[s].block;
+            uint64_t slot = hash_mix(signature[s], block) & (slots - 1);
+            while (slot_new_block[slot] != EMPTY_STATE && (slot_block[slot] != block || slot_signature[slot] != signature[s])) {
+                slot = (slot + 1) & (slots - 1);
+            }
+            if (slot_new_block[slot] == EMPTY_STATE) {
+                slot_block[slot] = block;
+                slot_signature[slot] = signature[s];
+                slot_new_block[slot] = new_colors++;
+            }
+            this->states_info[s].block = slot_new_block[slot];
+        }
+
+        const bool changed = (new_colors != this->colors);
+        this->colors = new_colors;
+        if (!changed) break; // the partition is stable (up to collisions)
+    }
+}
@@ -0,0 +1,361 @@
+#include <cerrno>
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "dfa_server.h"
+#include "nfa_class.h"
+#include "dictionary_builder.h"
+
+static const int POLL_MILLISECONDS = 200; // how often idle connections check that the server stops
+static const double MINIMIZATION_SLICE_SECONDS = 0.01; // the DFA is locked for minimization at most so long at once
+
+int read_dfa(char* command, char* s, DFA& result) {
+    const uint32_t threads = std::thread::hardware_concurrency();
+    if (strcmp(command, "from_nfa_string") == 0) {
+        NFA nfa(s);
+        result = nfa.convert2dfa();
+        return 0;
+    }
+    if (strcmp(command, "from_nfa_text_file") == 0) {
+        NFA nfa;
+        if (nfa.load_from_text_file(s, threads) != 0) return 1;
+        result = nfa.convert2dfa();
+        return 0;
+    }
+    if (strcmp(command, "from_sorted_words") == 0) return build_dictionary(s, result);
+    if (strcmp(command, "from_bin_file") == 0) return result.load_from_bin_file(s);
+    if (strcmp(command, "from_text_file") == 0) return result.load_from_text_file(s, threads);
+    if (strcmp(command, "from_packed_file") == 0) return result.load_from_packed_file(s, threads);
+    result = DFA(command, s);
+    return 0;
+}
+
+uint64_t dfa_memory(const DFA& dfa) {
+    const uint64_t size = dfa.get_size();
+    return size * dfa.get_alphabet_length() * sizeof(uint32_t) + (size + 7) / 8 + (dfa.has_labels() ? size * sizeof(uint32_t) : 0);
+}
+
+// commands which read files
+static bool reads_file(const std::string& command) {
+    return command == "from_sorted_words" || (command.compare(0, 5, "from_") == 0 && command.size() > 10 &&
+        command.compare(command.size() - 5, 5, "_file") == 0);
+}
+
+// " {mtime in ns} {size}" of the file (so a changed file is loaded again), empty if there is no such file
+static std::string file_stamp(const std::string& filename) {
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0) return "";
+    return ' ' + std::to_string((uint64_t)info.st_mtim.tv_sec * 1000000000ULL + (uint64_t)info.st_mtim.tv_nsec) + ' ' + std::to_string((uint64_t)info.st_size);
+}
+
+// sends all bytes; false if the connection is broken
+static bool send_all(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        const ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += (size_t)n;
+    }
+    return true;
+}
+
+static int connect_to(const char* socket_path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) return -1;
+    strcpy(address.sun_path, socket_path);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+DFAServer::DFAServer(const char* _socket_path, uint32_t _workers, uint64_t _cache_limit)
+    : socket_path(_socket_path), workers(std::max<uint32_t>(1, _workers)), cache_limit(_cache_limit) {}
+
+DFAServer::~DFAServer() {
+    if (this->listen_fd >= 0) close(this->listen_fd);
+}
+
+std::shared_ptr<DFAServer::Entry> DFAServer::find(const std::string& name) {
+    std::lock_guard<std::mutex> guard(this->cache_lock);
+    auto it = this->cache.find(name);
+    if (it == this->cache.end()) return nullptr;
+    this->recent.splice(this->recent.begin(), this->recent, it->second->recent_position);
+    return it->second;
+}
+
+void DFAServer::insert(const std::string& name, const std::shared_ptr<Entry>& entry) {
+    std::lock_guard<std::mutex> guard(this->cache_lock);
+    auto it = this->cache.find(name);
+    if (it != this->cache.end()) {
+        this->cached_bytes -= it->second->bytes;
+        this->recent.erase(it->second->recent_position);
+        it->second->cached = false;
+        this->cache.erase(it);
+    }
+    this->recent.push_front(name);
+    entry->recent_position = this->recent.begin();
+    entry->cached = true;
+    this->cache[name] = entry;
+    this->cached_bytes += entry->bytes;
+    evict();
+}
+
+void DFAServer::update_bytes(const std::shared_ptr<Entry>& entry, uint64_t bytes) {
+    std::lock_guard<std::mutex> guard(this->cache_lock);
+    if (!entry->cached) return;
+    this->cached_bytes = this->cached_bytes - entry->bytes + bytes;
+    entry->bytes = bytes;
+    evict();
+}
+
+void DFAServer::evict() {
+    // DFAs which are used by other requests now are freed when they are done
+    while (this->cached_bytes > this->cache_limit && this->cache.size() > 1) {
+        auto it = this->cache.find(this->recent.back());
+        this->cached_bytes -= it->second->bytes;
+        it->second->cached = false;
+        this->cache.erase(it);
+        this->recent.pop_back();
+        ++this->evictions;
+    }
+}
+
+std::string DFAServer::handle(const std::string& request) {
+    std::istringstream in(request);
+    std::vector<std::string> words;
+    std::string word;
+    while (in >> word) words.push_back(word);
+    if (words.empty()) return "error empty request";
+    const std::string& op = words[0];
+    std::ostringstream out;
+
+    if (op == "load" && words.size() == 4) {
+        const std::string& name = words[1];
+        std::string command = words[2], argument = words[3];
+        const std::string source = command + ' ' + argument + (reads_file(command) ? file_stamp(argument) : "");
+        std::shared_ptr<Entry> entry = find(name);
+        if (entry != nullptr && entry->source == source) {
+            std::shared_lock<std::shared_mutex> reading(entry->lock);
+            {
+                std::lock_guard<std::mutex> guard(this->cache_lock);
+                ++this->hits;
+            }
+            out << "ok " << name << " cached, " << entry->dfa.get_size() << " states";
+            return out.str();
+        }
+        {
+            std::lock_guard<std::mutex> guard(this->cache_lock);
+            ++this->misses;
+        }
+        request_check check = correctness_of_dfa_input(&command[0], &argument[0]);
+        if (!check.accepted) return "error " + (check.error.compare(0, 7, "Error: ") == 0 ? check.error.substr(7) : check.error);
+        if (reads_file(command) && access(argument.c_str(), R_OK) != 0) return "error couldn't open " + argument;
+
+        DFA dfa((char*)"", (char*)""); // 1 state, replaced by the loaded DFA
+        if (read_dfa(&command[0], &argument[0], dfa) != 0) return "error couldn't read " + argument;
+        entry = std::make_shared<Entry>(source, std::move(dfa));
+        entry->bytes = dfa_memory(entry->dfa);
+        out << "ok " << name << " loaded, " << entry->dfa.get_size() << " states, alphabet " << entry->dfa.get_alphabet_length();
+        insert(name, entry);
+        return out.str();
+    }
+
+    if (op == "minimize" && words.size() == 2) {
+        std::shared_ptr<Entry> entry = find(words[1]);
+        if (entry == nullptr) return "error no DFA " + words[1];
+        // minimization goes in time slices, between them the DFA is unlocked for matching (refinement doesn't change
+        // delta); it is cancelled if the server stops
+        auto start = std::chrono::high_resolution_clock::now();
+        std::unique_lock<std::shared_mutex> writing(entry->lock);
+        MinimizationStatus status;
+        while ((status = entry->dfa.minimization_step({MINIMIZATION_SLICE_SECONDS, 0}, nullptr, &this->stopping)) == MinimizationStatus::PAUSED) {
+            writing.unlock();
+            std::this_thread::yield();
+            writing.lock();
+        }
+        if (status == MinimizationStatus::CANCELLED) return "error minimization is cancelled, the server stops";
+        std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start;
+        const uint64_t bytes = dfa_memory(entry->dfa);
+        out << "ok " << words[1] << ' ' << entry->dfa.get_size() << " states, " << entry->dfa.get_iterations()
+            << " iterations, " << duration.count() << " seconds";
+        writing.unlock();
+        update_bytes(entry, bytes);
+        return out.str();
+    }
+
+    if (op == "match" && (words.size() == 2 || words.size() == 3)) {
+        std::shared_ptr<Entry> entry = find(words[1]);
+        if (entry == nullptr) return "error no DFA " + words[1];
+        std::vector<uint32_t> symbols;
+        if (words.size() == 3) {
+            for (char c : words[2]) {
+                if (!(('0' <= c && c <= '9') || ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z'))) return "error symbols must be 0-9a-zA-Z";
+                symbols.push_back(char2integer(c));
+            }
+        }
+        std::shared_lock<std::shared_mutex> reading(entry->lock);
+        for (uint32_t c : symbols) {
+            if (c >= entry->dfa.get_alphabet_length()) return "error symbol out of the alphabet";
+        }
+        if (entry->dfa.has_labels()) {
+            out << "ok label " << entry->dfa.classify_string(symbols);
+            return out.str();
+        }
+        return (entry->dfa.check_string(symbols) ? "ok accepted" : "ok rejected");
+    }
+
+    if (op == "compare" && words.size() == 3) {
+        std::shared_ptr<Entry> first = find(words[1]), second = find(words[2]);
+        if (first == nullptr) return "error no DFA " + words[1];
+        if (second == nullptr) return "error no DFA " + words[2];
+        if (first == second) return "ok equal";
+        // == works with minimized DFAs; minimization is done once, later it returns at once
+        for (const std::shared_ptr<Entry>& entry : {first, second}) {
+            std::unique_lock<std::shared_mutex> writing(entry->lock);
+            while (entry->dfa.minimization_step({MINIMIZATION_SLICE_SECONDS, 0}, nullptr, &this->stopping) == MinimizationStatus::PAUSED) {
+                writing.unlock();
+                std::this_thread::yield();
+                writing.lock();
+            }
+            if (this->stopping) return "error minimization is cancelled, the server stops";
+            const uint64_t bytes = dfa_memory(entry->dfa);
+            writing.unlock();
+            update_bytes(entry, bytes);
+        }
+        std::shared_lock<std::shared_mutex> reading_first(first->lock), reading_second(second->lock);
+        if (first->dfa.get_alphabet_length() != second->dfa.get_alphabet_length()) return "error automata have different alphabets";
+        return (first->dfa == second->dfa ? "ok equal" : "ok different");
+    }
+
+    if (op == "drop" && words.size() == 2) {
+        std::lock_guard<std::mutex> guard(this->cache_lock);
+        auto it = this->cache.find(words[1]);
+        if (it == this->cache.end()) return "error no DFA " + words[1];
+        this->cached_bytes -= it->second->bytes;
+        this->recent.erase(it->second->recent_position);
+        it->second->cached = false;
+        this->cache.erase(it);
+        return "ok";
+    }
+
+    if (op == "stats" && words.size() == 1) {
+        std::lock_guard<std::mutex> guard(this->cache_lock);
+        out << "ok " << this->cache.size() << " DFAs, " << this->cached_bytes << " of " << this->cache_limit << " bytes, "
+            << this->hits << " hits, " << this->misses << " misses, " << this->evictions << " evictions";
+        return out.str();
+    }
+
+    if (op == "shutdown" && words.size() == 1) {
+        this->stopping = true;
+        shutdown(this->listen_fd, SHUT_RDWR); // accept() returns with an error
+        return "ok";
+    }
+
+    return "error unknown request (load, minimize, match, compare, drop, stats, shutdown)";
+}
+
+void DFAServer::serve_connection(int fd) {
+    std::string buffer;
+    char chunk[1 << 16];
+    while (!this->stopping) {
+        pollfd waiting = {fd, POLLIN, 0};
+        const int ready = poll(&waiting, 1, POLL_MILLISECONDS);
+        if (ready < 0 && errno != EINTR) return;
+        if (ready <= 0) continue;
+        const ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        buffer.append(chunk, (size_t)n);
+
+        size_t begin = 0, end;
+        while ((end = buffer.find('\n', begin)) != std::string::npos) {
+            if (!send_all(fd, handle(buffer.substr(begin, end - begin)) + '\n')) return;
+            begin = end + 1;
+        }
+        buffer.erase(0, begin);
+    }
+}
+
+void DFAServer::work() {
+    while (true) {
+        int fd;
+        {
+            std::unique_lock<std::mutex> guard(this->queue_lock);
+            this->queue_ready.wait(guard, [this]() { return !this->connections.empty() || this->stopping; });
+            if (this->connections.empty()) return;
+            fd = this->connections.front();
+            this->connections.pop_front();
+        }
+        serve_connection(fd);
+        close(fd);
+    }
+}
+
+int DFAServer::run() {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (this->socket_path.size() >= sizeof(address.sun_path)) return 1;
+    strcpy(address.sun_path, this->socket_path.c_str());
+    unlink(this->socket_path.c_str()); // socket of a previous server
+
+    this->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (this->listen_fd < 0) return 1;
+    if (bind(this->listen_fd, (sockaddr*)&address, sizeof(address)) != 0 || listen(this->listen_fd, 64) != 0) return 1;
+
+    std::vector<std::thread> pool;
+    for (uint32_t j = 0; j < this->workers; ++j) pool.emplace_back(&DFAServer::work, this);
+    while (!this->stopping) {
+        const int fd = accept(this->listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        std::lock_guard<std::mutex> guard(this->queue_lock);
+        this->connections.push_back(fd);
+        this->queue_ready.notify_one();
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(this->queue_lock);
+        this->stopping = true;
+        this->queue_ready.notify_all();
+    }
+    for (std::thread& worker : pool) worker.join();
+    close(this->listen_fd);
+    this->listen_fd = -1;
+    unlink(this->socket_path.c_str());
+    return 0;
+}
+
+int ask_server(const char* socket_path, const std::string& request, std::string& reply) {
+    const int fd = connect_to(socket_path);
+    if (fd < 0) return 1;
+    reply.clear();
+    if (!send_all(fd, request + '\n')) {
+        close(fd);
+        return 1;
+    }
+    char chunk[4096];
+    while (reply.find('\n') == std::string::npos) {
+        const ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        reply.append(chunk, (size_t)n);
+    }
+    close(fd);
+    const size_t end = reply.find('\n');
+    if (end == std::string::npos) return 1;
+    reply.resize(end);
+    return 0;
+}
@@ -0,0 +1,160 @@
+#include <thread>
+#include "dfa_class.h"
+#include "parallel_utils.h"
+
+// Trimming before minimization: states unreachable from the starting node are deleted,
+// reachable states which can't reach any acc state (dead states) are merged into one sink.
+// Both searches are level-synchronous BFS with bitmaps of visited states; big levels are split between threads.
+
+static const uint64_t MIN_PARALLEL_WORK = 1 << 16; // levels with less transitions to check are done by one thread
+
+static inline bool is_set(const std::vector<uint64_t>& bitmap, uint32_t s) {
+    return (bitmap[s / 64] >> (s % 64)) & 1;
+}
+
+// sets the bit of s; true if it wasn't set before (exactly one thread gets true)
+// atomic instructions are used only if other threads work with the bitmap too
+static inline bool claim(std::vector<uint64_t>& bitmap, uint32_t s, bool shared) {
+    const uint64_t bit = 1ULL << (s % 64);
+    if (!shared) {
+        if (bitmap[s / 64] & bit) return false;
+        bitmap[s / 64] |= bit;
+        return true;
+    }
+    if (__atomic_load_n(&bitmap[s / 64], __ATOMIC_RELAXED) & bit) return false;
+    return !(__atomic_fetch_or(&bitmap[s / 64], bit, __ATOMIC_RELAXED) & bit);
+}
+
+// returns x and adds 1 to it
+template <typename T>
+static inline T fetch_increment(T& x, bool shared) {
+    return (shared ? __atomic_fetch_add(&x, 1, __ATOMIC_RELAXED) : x++);
+}
+
+// states of frontier must be already claimed in visited; for_each_neighbour(s, f) calls f(t) for every neighbour t of s
+template <typename N>
+static void frontier_bfs(std::vector<uint32_t> frontier, std::vector<uint64_t>& visited,
+                         uint32_t threads, uint32_t degree, N for_each_neighbour) {
+    std::vector<std::vector<uint32_t> > next(threads);
+    while (!frontier.empty()) {
+        const uint32_t level_threads = ((uint64_t)frontier.size() * degree < MIN_PARALLEL_WORK ? 1 : threads);
+        run_in_threads(level_threads, [&](uint32_t j) {
+            next[j].clear();
+            const uint64_t to = range_begin(frontier.size(), j + 1, level_threads);
+            for (uint64_t i = range_begin(frontier.size(), j, level_threads); i < to; ++i) {
+                for_each_neighbour(frontier[i], [&](uint32_t t) {
+                    if (claim(visited, t, level_threads > 1)) next[j].push_back(t);
+                });
+            }
+        });
+        frontier.clear();
+        for (uint32_t j = 0; j < level_threads; ++j) frontier.insert(frontier.end(), next[j].begin(), next[j].end());
+    }
+}
+
+void DFA::trim_states(uint32_t threads) {
+    if (this->trimmed_states) return;
+    if (threads == 0) threads = 1;
+    const uint32_t n = this->size, k = this->alphabet_length;
+    if (n < (uint64_t)threads * 1024) threads = 1; // not worth starting threads
+
+    // forward search (it isn't needed if unreachable states were deleted before)
+    std::vector<uint64_t> reachable((n + 63) / 64, 0);
+    if (this->deleted_unreachable_states) {
+        for (uint32_t s = 0; s < n; ++s) reachable[s / 64] |= 1ULL << (s % 64);
+    } else {
+        claim(reachable, this->starting_node, false);
+        frontier_bfs({this->starting_node}, reachable, threads, k, [this, k](uint32_t s, auto visit) {
+            for (uint32_t a = 0; a < k; ++a) visit(this->delta[a][s]);
+        });
+    }
+
+    // reversed transitions of reachable states (CSR: sources of t are in_edges[in_begin[t]..in_begin[t + 1]))
+    std::vector<uint32_t> in_degree(n, 0);
+    run_in_threads(threads, [&](uint32_t j) {
+        const uint64_t to = range_begin(n, j + 1, threads);
+        for (uint64_t s = range_begin(n, j, threads); s < to; ++s) {
+            if (!is_set(reachable, (uint32_t)s)) continue;
+            for (uint32_t a = 0; a < k; ++a) fetch_increment(in_degree[this->delta[a][s]], threads > 1);
+        }
+    });
+    std::vector<uint64_t> in_begin;
+    parallel_prefix_sum(n, threads, in_begin, [&](uint32_t s) { return (uint64_t)in_degree[s]; });
+    std::vector<uint32_t> in_edges(in_begin[n]);
+    std::vector<uint64_t> in_position(in_begin.begin(), in_begin.end() - 1);
+    run_in_threads(threads, [&](uint32_t j) {
+        const uint64_t to = range_begin(n, j + 1, threads);
+        for (uint64_t s = range_begin(n, j, threads); s < to; ++s) {
+            if (!is_set(reachable, (uint32_t)s)) continue;
+            for (uint32_t a = 0; a < k; ++a) {
+                in_edges[fetch_increment(in_position[this->delta[a][s]], threads > 1)] = (uint32_t)s;
+            }
+        }
+    });
+    std::vector<uint32_t>().swap(in_degree);
+    std::vector<uint64_t>().swap(in_position);
+
+    // backward search from reachable acc states
+    std::vector<uint64_t> alive((n + 63) / 64, 0);
+    std::vector<uint32_t> frontier;
+    for (uint32_t s = 0; s < n; ++s) {
+        if (this->acc[s] && is_set(reachable, s) && claim(alive, s, false)) frontier.push_back(s);
+    }
+    frontier_bfs(std::move(frontier), alive, threads, k, [&](uint32_t t, auto visit) {
+        for (uint64_t i = in_begin[t]; i < in_begin[t + 1]; ++i) visit(in_edges[i]);
+    });
+    std::vector<uint32_t>().swap(in_edges);
+    std::vector<uint64_t>().swap(in_begin);
+
+    this->deleted_unreachable_states = true;
+    this->trimmed_states = true;
+
+    if (!is_set(alive, this->starting_node)) { // the language is empty
+        std::vector<table_vector<uint32_t> > one_state_delta(k, table_vector<uint32_t>(1, 0));
+        std::vector<bool> one_state_acc(1, false);
+        const bool had_labels = !this->labels.empty();
+        init(k, 1, 0, std::move(one_state_delta), std::move(one_state_acc));
+        if (had_labels) set_labels({0});
+        return;
+    }
+
+    // alive states are reachable; they keep their order, dead reachable states go to the sink (the last state)
+    std::vector<uint32_t> new_idx;
+    parallel_prefix_sum(n, threads, new_idx, [&](uint32_t s) { return (uint32_t)is_set(alive, s); });
+    const uint32_t alive_count = new_idx[n];
+    uint32_t reachable_count = 0;
+    for (uint64_t word : reachable) reachable_count += __builtin_popcountll(word);
+    if (alive_count == n) return; // nothing to trim
+
+    const bool need_sink = (reachable_count > alive_count);
+    const uint32_t sink = alive_count;
+    const uint32_t new_size = alive_count + (need_sink ? 1 : 0);
+
+    std::vector<table_vector<uint32_t> > new_delta(k, table_vector<uint32_t>(new_size, sink));
+    run_in_threads(threads, [&](uint32_t j) {
+        const uint64_t to = range_begin(n, j + 1, threads);
+        for (uint64_t s = range_begin(n, j, threads); s < to; ++s) {
+            if (!is_set(alive, (uint32_t)s)) continue;
+            for (uint32_t a = 0; a < k; ++a) {
+                const uint32_t t = this->delta[a][s];
+                new_delta[a][new_idx[s]] = (is_set(alive, t) ? new_idx[t] : sink);
+            }
+        }
+    });
+    std::vector<bool> new_acc(new_size, false);
+    std::vector<uint32_t> new_labels(this->labels.empty() ? 0 : new_size, 0); // the sink has label 0
+    for (uint32_t s = 0; s < n; ++s) {
+        if (!is_set(alive, s)) continue;
+        new_acc[new_idx[s]] = this->acc[s];
+        if (!this->labels.empty()) new_labels[new_idx[s]] = this->labels[s];
+    }
+
+    this->size = new_size;
+    this->starting_node = new_idx[this->starting_node];
+    this->delta = std::move(new_delta);
+    this->acc = std::move(new_acc);
+    this->labels = std::move(new_labels);
+
+    // reversed delta (if it was constructed) is not correct now
+    forget_reversed_delta();
+}
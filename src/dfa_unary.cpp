@@ -0,0 +1,71 @@
+#include "dfa_class.h"
+
+// Minimization of DFAs with one symbol in O(n). Such DFA is a "lasso": the path from the starting node
+// goes through the tail (positions 0, ..., tail - 1) and then around the cycle (positions tail, ..., n - 1).
+// Labels along the cycle are a cyclic word; its smallest period p is found by the prefix function (KMP),
+// cycle positions i and i + p are equivalent and there are no other equivalences on the cycle.
+// A tail position is equivalent to a cycle one only if the next position is too, so the merged part
+// of the tail is its suffix: it is found going back from the cycle while labels agree.
+
+bool DFA::minimize_unary(bool debug) {
+    if (this->alphabet_length != 1) return false;
+    const uint32_t n = this->size;
+
+    // positions of states along the path (all states are reachable after trimming)
+    table_vector<uint32_t> position(n, EMPTY_STATE);
+    table_vector<uint32_t> word; // labels along the path
+    word.reserve(n);
+    uint32_t s = this->starting_node;
+    while (position[s] == EMPTY_STATE) {
+        position[s] = (uint32_t)word.size();
+        word.push_back(get_label(s));
+        s = this->delta[0][s];
+    }
+    const uint32_t length = (uint32_t)word.size(); // n if the DFA is trimmed
+    const uint32_t tail = position[s], cycle = length - tail;
+    table_vector<uint32_t>().swap(position);
+
+    // prefix function of the cycle word: the smallest period divides the cycle length or it is the cycle itself
+    uint32_t period = cycle;
+    {
+        table_vector<uint32_t> prefix(cycle, 0);
+        for (uint32_t i = 1; i < cycle; ++i) {
+            uint32_t k = prefix[i - 1];
+            while (k > 0 && word[tail + i] != word[tail + k]) k = prefix[k - 1];
+            if (word[tail + i] == word[tail + k]) ++k;
+            prefix[i] = k;
+        }
+        if (cycle % (cycle - prefix[cycle - 1]) == 0) period = cycle - prefix[cycle - 1];
+    }
+
+    // class on the cycle of position i (i >= tail, or a merged position of the tail)
+    auto cycle_class = [tail, period](uint32_t i) {
+        return (uint32_t)(((int64_t)i - tail) % period + period) % period;
+    };
+    uint32_t merged = tail; // positions merged, tail, ..., tail - 1 are equivalent to cycle positions
+    while (merged > 0 && word[merged - 1] == word[tail + cycle_class(merged - 1)]) --merged;
+
+    // positions 0, ..., merged - 1 keep their numbers, cycle class c becomes merged + c
+    const uint32_t classes = merged + period;
+    if (debug) std::cout << "DFA is unary: tail " << tail << ", cycle " << cycle << ", period " << period << ", " << classes << " classes\n";
+    this->iterations = 0;
+    this->minimized = true;
+    if (classes == n) return true;
+
+    std::vector<table_vector<uint32_t> > new_delta(1, table_vector<uint32_t>(classes));
+    std::vector<bool> new_acc(classes);
+    std::vector<uint32_t> new_labels(this->labels.empty() ? 0 : classes);
+    for (uint32_t c = 0; c < classes; ++c) {
+        const uint32_t i = (c < merged ? c : tail + c - merged); // position of a state of the class
+        new_delta[0][c] = (c + 1 < merged ? c + 1 : merged + cycle_class(c < merged ? c + 1 : i + 1));
+        new_acc[c] = (word[i] != 0);
+        if (!new_labels.empty()) new_labels[c] = word[i];
+    }
+    const uint32_t new_start = (merged > 0 ? 0 : merged + cycle_class(0));
+
+    forget_reversed_delta();
+    init(1, classes, new_start, std::move(new_delta), std::move(new_acc));
+    if (!new_labels.empty()) set_labels(std::move(new_labels));
+    this->minimized = true;
+    return true;
+}
@@ -0,0 +1,144 @@
+#include "dictionary_builder.h"
+#include "mapped_file.h"
+
+size_t DictionaryBuilder::StateHash::operator()(uint32_t q) const {
+    const DictionaryBuilder& b = *this->builder;
+    uint64_t h = (b.final_state[q] ? 0x9E3779B97F4A7C15ULL : 0);
+    for (uint64_t i = b.edge_begin[q]; i < b.edge_begin[q + 1]; ++i) {
+        h = (h ^ b.edge_symbol[i]) * 0x100000001B3ULL;
+        h = (h ^ b.edge_target[i]) * 0x100000001B3ULL;
+    }
+    return (size_t)(h ^ (h >> 29));
+}
+
+bool DictionaryBuilder::StateEqual::operator()(uint32_t q, uint32_t r) const {
+    const DictionaryBuilder& b = *this->builder;
+    if (b.final_state[q] != b.final_state[r]) return false;
+    const uint64_t length = b.edge_begin[q + 1] - b.edge_begin[q];
+    if (length != b.edge_begin[r + 1] - b.edge_begin[r]) return false;
+    for (uint64_t i = 0; i < length; ++i) {
+        if (b.edge_symbol[b.edge_begin[q] + i] != b.edge_symbol[b.edge_begin[r] + i]) return false;
+        if (b.edge_target[b.edge_begin[q] + i] != b.edge_target[b.edge_begin[r] + i]) return false;
+    }
+    return true;
+}
+
+DictionaryBuilder::DictionaryBuilder(uint32_t _alphabet_length)
+    : alphabet_length(_alphabet_length), states(1024, StateHash{this}, StateEqual{this}), path(1, PathState{false, {}}) {}
+
+uint32_t DictionaryBuilder::freeze(uint32_t depth) {
+    PathState& state = this->path[depth];
+    std::sort(state.edges.begin(), state.edges.end());
+
+    // the state is put at the end of the registered ones; if there is an equivalent state, it is taken back
+    const uint32_t q = (uint32_t)this->final_state.size();
+    this->final_state.push_back(state.final);
+    for (const std::pair<uint32_t, uint32_t>& edge : state.edges) {
+        this->edge_symbol.push_back(edge.first);
+        this->edge_target.push_back(edge.second);
+    }
+    this->edge_begin.push_back(this->edge_symbol.size());
+
+    auto found = this->states.insert(q);
+    if (found.second) return q;
+    this->final_state.pop_back();
+    this->edge_begin.pop_back();
+    this->edge_symbol.resize(this->edge_begin.back());
+    this->edge_target.resize(this->edge_begin.back());
+    return *found.first;
+}
+
+void DictionaryBuilder::freeze_path(uint32_t depth) {
+    while (this->path.size() > depth + 1) {
+        const uint32_t q = freeze((uint32_t)this->path.size() - 1);
+        this->path.pop_back();
+        this->path.back().edges.back().second = q;
+    }
+}
+
+int DictionaryBuilder::add_word(const std::vector<uint32_t>& word) {
+    uint32_t prefix = 0;
+    while (prefix < word.size() && prefix < this->last_word.size() && word[prefix] == this->last_word[prefix]) ++prefix;
+    if (this->words > 0 && prefix == word.size() && prefix == this->last_word.size()) return 0; // repeated word
+
+    for (uint32_t i = prefix; i < word.size(); ++i) {
+        if (this->alphabet_length != 0 && word[i] >= this->alphabet_length) return 1;
+    }
+    // the branch by word[prefix] must be new, otherwise an earlier word went there and it may be registered
+    if (prefix < word.size()) {
+        for (const std::pair<uint32_t, uint32_t>& edge : this->path[prefix].edges) {
+            if (edge.first == word[prefix]) return 1;
+        }
+    }
+
+    freeze_path(prefix);
+    for (uint32_t i = prefix; i < word.size(); ++i) {
+        this->path.back().edges.push_back({word[i], EMPTY_STATE});
+        this->path.push_back(PathState{false, {}});
+        if (word[i] > this->max_symbol) this->max_symbol = word[i];
+    }
+    this->path.back().final = true;
+    this->last_word = word;
+    ++this->words;
+    return 0;
+}
+
+DFA DictionaryBuilder::finish() {
+    const uint32_t k = (this->alphabet_length != 0 ? this->alphabet_length : this->max_symbol + 1);
+    if (this->words == 0) { // empty language: one rej state
+        std::vector<table_vector<uint32_t> > one_state_delta(k, table_vector<uint32_t>(1, 0));
+        DFA result(k, 1, 0, std::move(one_state_delta), std::vector<bool>(1, false));
+        result.minimized = true;
+        return result;
+    }
+
+    freeze_path(0);
+    const uint32_t root = freeze(0);
+
+    // all missing transitions go to the sink (every registered state can reach a final one, so it is needed once)
+    const uint32_t n = (uint32_t)this->final_state.size();
+    const uint32_t sink = n;
+    std::vector<table_vector<uint32_t> > delta(k, table_vector<uint32_t>(n + 1, sink));
+    std::vector<bool> acc(n + 1, false);
+    for (uint32_t q = 0; q < n; ++q) {
+        acc[q] = this->final_state[q];
+        for (uint64_t i = this->edge_begin[q]; i < this->edge_begin[q + 1]; ++i) delta[this->edge_symbol[i]][q] = this->edge_target[i];
+    }
+
+    // the builder is empty again
+    this->states.clear();
+    std::vector<uint64_t>(1, 0).swap(this->edge_begin);
+    std::vector<uint32_t>().swap(this->edge_symbol);
+    std::vector<uint32_t>().swap(this->edge_target);
+    std::vector<char>().swap(this->final_state);
+    this->path.assign(1, PathState{false, {}});
+    this->last_word.clear();
+    this->words = 0;
+    this->max_symbol = 0;
+
+    DFA result(k, n + 1, root, std::move(delta), std::move(acc));
+    // registered states are reachable (each was registered as a child of the path) and pairwise inequivalent
+    result.deleted_unreachable_states = true;
+    result.trimmed_states = true;
+    result.minimized = true;
+    return result;
+}
+
+int build_dictionary(const char* filename, DFA& result) {
+    MappedFile file(filename);
+    if (!file.ok()) return 1;
+    DictionaryBuilder builder(0);
+    std::vector<uint32_t> word;
+    const char* end = file.get_data() + file.get_length();
+    for (const char* p = file.get_data(); p <= end; ++p) {
+        if (p == end || *p == '\n') {
+            if (!word.empty() && builder.add_word(word) != 0) return 1;
+            word.clear();
+            continue;
+        }
+        const char c = *p;
+        if (('0' <= c && c <= '9') || ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z')) word.push_back(char2integer(c));
+    }
+    result = builder.finish();
+    return 0;
+}
@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <cstring>
+#include "external_sort.h"
+
+ExternalSorter::ExternalSorter(uint32_t _width, uint32_t _key_width, uint64_t mem_limit) {
+    this->width = _width;
+    this->key_width = _key_width;
+    // every record in RAM costs width words + 1 word in `order` + 1 word in the temporary buffer of stable_sort;
+    // indices in `order` are uint32_t, so a run has less than 2^32 records
+    this->records_per_run = mem_limit / (sizeof(uint32_t) * (this->width + 2));
+    this->records_per_run = std::min<uint64_t>(std::max<uint64_t>(this->records_per_run, 1), UINT32_MAX);
+    this->fan_in = (uint32_t)std::max<uint64_t>(2, std::min<uint64_t>(MAX_FAN_IN, this->records_per_run / MIN_RECORDS_PER_READER));
+}
+
+ExternalSorter::~ExternalSorter() {
+    for (FILE* run : this->runs) fclose(run);
+}
+
+bool ExternalSorter::less(const uint32_t* x, const uint32_t* y) const {
+    for (uint32_t i = 0; i < this->key_width; ++i) {
+        if (x[i] != y[i]) return x[i] < y[i];
+    }
+    return false;
+}
+
+void ExternalSorter::sort_buffer() {
+    const uint64_t records = this->buffer.size() / this->width;
+    this->order.resize(records);
+    for (uint64_t i = 0; i < records; ++i) this->order[i] = (uint32_t)i;
+    const uint32_t* data = this->buffer.data();
+    const uint32_t w = this->width;
+    std::stable_sort(this->order.begin(), this->order.end(), [this, data, w](uint32_t x, uint32_t y) {
+        return less(data + (uint64_t)x * w, data + (uint64_t)y * w);
+    });
+}
+
+void ExternalSorter::release_buffer() {
+    std::vector<uint32_t>().swap(this->buffer);
+    std::vector<uint32_t>().swap(this->order);
+}
+
+bool ExternalSorter::spill_run() {
+    sort_buffer();
+    FILE* run = tmpfile();
+    if (run == nullptr) return false;
+    this->runs.push_back(run);
+    this->levels.push_back(0);
+    for (uint32_t idx : this->order) {
+        if (fwrite(this->buffer.data() + (uint64_t)idx * this->width, sizeof(uint32_t), this->width, run) != this->width) return false;
+    }
+    rewind(run);
+    this->buffer.clear();
+    this->order.clear();
+
+    // levels of runs don't increase from left to right, so equal levels are at the end
+    while (this->runs.size() >= this->fan_in && this->levels[this->runs.size() - this->fan_in] == this->levels.back()) {
+        release_buffer(); // it is allocated again by the next run
+        if (!merge_runs(this->runs.size() - this->fan_in, this->runs.size())) return false;
+    }
+    return true;
+}
+
+bool ExternalSorter::push(const uint32_t* record) {
+    if (this->finished) return false;
+    this->buffer.insert(this->buffer.end(), record, record + this->width);
+    if (this->buffer.size() / this->width >= this->records_per_run) {
+        return spill_run();
+    }
+    return true;
+}
+
+bool ExternalSorter::refill(RunReader& reader) {
+    size_t got = fread(reader.data.data(), sizeof(uint32_t) * this->width, this->records_per_reader, reader.file);
+    reader.records = got;
+    reader.pos = 0;
+    return got != 0;
+}
+
+void ExternalSorter::sift_down(size_t idx) {
+    const size_t n = this->heap.size();
+    while (true) {
+        size_t smallest = idx;
+        for (size_t child = 2 * idx + 1; child <= 2 * idx + 2 && child < n; ++child) {
+            const RunReader& c = this->readers[this->heap[child]];
+            const RunReader& s = this->readers[this->heap[smallest]];
+            if (less(c.data.data() + c.pos * this->width, s.data.data() + s.pos * this->width) ||
+                (!less(s.data.data() + s.pos * this->width, c.data.data() + c.pos * this->width) && this->heap[child] < this->heap[smallest])) {
+                smallest = child;
+            }
+        }
+        if (smallest == idx) return;
+        std::swap(this->heap[idx], this->heap[smallest]);
+        idx = smallest;
+    }
+}
+
+void ExternalSorter::sift_up(size_t idx) {
+    while (idx > 0) {
+        size_t parent = (idx - 1) / 2;
+        const RunReader& c = this->readers[this->heap[idx]];
+        const RunReader& p = this->readers[this->heap[parent]];
+        const bool smaller = less(c.data.data() + c.pos * this->width, p.data.data() + p.pos * this->width) ||
+            (!less(p.data.data() + p.pos * this->width, c.data.data() + c.pos * this->width) && this->heap[idx] < this->heap[parent]);
+        if (!smaller) return;
+        std::swap(this->heap[idx], this->heap[parent]);
+        idx = parent;
+    }
+}
+
+void ExternalSorter::start_merge(size_t first, size_t last, uint64_t shares) {
+    this->records_per_reader = this->records_per_run / shares;
+    if (this->records_per_reader == 0) this->records_per_reader = 1;
+
+    this->readers.resize(last - first);
+    this->heap.clear();
+    for (size_t r = 0; r < this->readers.size(); ++r) {
+        this->readers[r].file = this->runs[first + r];
+        this->readers[r].data.assign(this->records_per_reader * this->width, 0);
+        if (refill(this->readers[r])) {
+            this->heap.push_back((uint32_t)r);
+            sift_up(this->heap.size() - 1);
+        }
+    }
+}
+
+bool ExternalSorter::pop(uint32_t* record) {
+    if (this->heap.empty()) return false;
+    RunReader& top = this->readers[this->heap[0]];
+    memcpy(record, top.data.data() + top.pos * this->width, sizeof(uint32_t) * this->width);
+    ++top.pos;
+    if (top.pos == top.records && !refill(top)) {
+        this->heap[0] = this->heap.back();
+        this->heap.pop_back();
+    }
+    if (!this->heap.empty()) sift_down(0);
+    return true;
+}
+
+bool ExternalSorter::merge_runs(size_t first, size_t last) {
+    FILE* merged = tmpfile();
+    if (merged == nullptr) return false;
+    start_merge(first, last, last - first + 1); // one share is for the output buffer
+    bool correct = true;
+    {
+        WordWriter writer(merged, this->records_per_reader * this->width);
+        std::vector<uint32_t> record(this->width);
+        while (pop(record.data())) {
+            for (uint32_t x : record) correct = correct && writer.put(x);
+        }
+        correct = correct && writer.flush();
+    }
+    this->readers.clear();
+    if (!correct) {
+        fclose(merged);
+        return false;
+    }
+    rewind(merged);
+
+    uint32_t level = 0;
+    for (size_t r = first; r < last; ++r) {
+        fclose(this->runs[r]);
+        level = std::max(level, this->levels[r] + 1);
+    }
+    this->runs[first] = merged;
+    this->levels[first] = level;
+    this->runs.erase(this->runs.begin() + first + 1, this->runs.begin() + last);
+    this->levels.erase(this->levels.begin() + first + 1, this->levels.begin() + last);
+    return true;
+}
+
+bool ExternalSorter::finish() {
+    if (this->finished) return true;
+    this->finished = true;
+
+    if (this->runs.empty()) { // everything fits in RAM, nothing to merge
+        sort_buffer();
+        this->next_in_memory = 0;
+        return true;
+    }
+    if (!this->buffer.empty() && !spill_run()) return false;
+    release_buffer();
+
+    // passes over groups of fan_in neighbouring runs (so the order of equal records is kept)
+    while (this->runs.size() > this->fan_in) {
+        for (size_t first = 0; first + 1 < this->runs.size(); ++first) {
+            if (!merge_runs(first, std::min<size_t>(first + this->fan_in, this->runs.size()))) return false;
+        }
+    }
+    // the last merge is streamed to next(), the memory budget is shared by read buffers of all runs
+    start_merge(0, this->runs.size(), this->runs.size());
+    return true;
+}
+
+bool ExternalSorter::next(uint32_t* record) {
+    if (!this->finished) return false;
+
+    if (this->runs.empty()) {
+        if (this->next_in_memory >= this->order.size()) return false;
+        memcpy(record, this->buffer.data() + (uint64_t)this->order[this->next_in_memory] * this->width, sizeof(uint32_t) * this->width);
+        ++this->next_in_memory;
+        return true;
+    }
+    return pop(record);
+}
+
+
+WordReader::WordReader(FILE* _file, uint64_t offset_in_bytes, uint64_t words, uint64_t buffer_words) {
+    this->file = _file;
+    this->left = words;
+    if (buffer_words == 0) buffer_words = 1;
+    this->data.assign(buffer_words, 0);
+    fseeko(this->file, (off_t)offset_in_bytes, SEEK_SET);
+}
+
+bool WordReader::next(uint32_t& x) {
+    if (this->pos == this->length) {
+        if (this->left == 0) return false;
+        size_t to_read = (this->left < this->data.size() ? this->left : this->data.size());
+        this->length = fread(this->data.data(), sizeof(uint32_t), to_read, this->file);
+        this->pos = 0;
+        if (this->length == 0) { this->left = 0; return false; }
+        this->left -= this->length;
+    }
+    x = this->data[this->pos++];
+    return true;
+}
+
+WordWriter::WordWriter(FILE* _file, uint64_t buffer_words) {
+    this->file = _file;
+    this->capacity = (buffer_words == 0 ? 1 : buffer_words);
+    this->data.reserve(this->capacity);
+}
+
+bool WordWriter::put(uint32_t x) {
+    this->data.push_back(x);
+    if (this->data.size() == this->capacity) return flush();
+    return true;
+}
+
+bool WordWriter::flush() {
+    if (this->data.empty()) return true;
+    bool ok = (fwrite(this->data.data(), sizeof(uint32_t), this->data.size(), this->file) == this->data.size());
+    this->data.clear();
+    return ok;
+}
@@ -0,0 +1,202 @@
+#include "lazy_matcher.h"
+#include "mapped_file.h"
+
+static uint64_t subset_hash(const uint64_t* subset, uint32_t words) {
+    uint64_t h = 0x9E3779B97F4A7C15ULL;
+    for (uint32_t i = 0; i < words; ++i) {
+        h = (h ^ subset[i]) * 0x100000001B3ULL;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+LazyMatcher::LazyMatcher(const NFA& nfa, MatchMode _mode, uint64_t memory_limit) {
+    this->alphabet_length = nfa.get_alphabet_length();
+    this->mode = _mode;
+    const uint32_t n = nfa.get_size();
+    this->words = (n + 63) / 64;
+
+    this->target_begin.assign((uint64_t)n * this->alphabet_length + 1, 0);
+    for (uint32_t q = 0; q < n; ++q) {
+        for (uint32_t a = 0; a < this->alphabet_length; ++a) {
+            const std::vector<uint32_t>& t = nfa.get_transitions(q, a);
+            this->targets.insert(this->targets.end(), t.begin(), t.end());
+            this->target_begin[(uint64_t)q * this->alphabet_length + a + 1] = this->targets.size();
+        }
+    }
+    this->start_subset.assign(this->words, 0);
+    this->acc_subset.assign(this->words, 0);
+    for (uint32_t q : nfa.get_starting_nodes()) this->start_subset[q / 64] |= 1ULL << (q % 64);
+    for (uint32_t q = 0; q < n; ++q) {
+        if (nfa.is_accepting(q)) this->acc_subset[q / 64] |= 1ULL << (q % 64);
+    }
+
+    for (uint32_t b = 0; b < 256; ++b) {
+        this->byte2symbol[b] = byte_to_symbol(b, this->alphabet_length);
+    }
+
+    // one state takes its subset, its row of transitions, acc flag and 2-4 slots
+    const uint64_t state_bytes = (uint64_t)this->words * sizeof(uint64_t) + (uint64_t)this->alphabet_length * sizeof(uint32_t) + 1 + 4 * sizeof(uint32_t);
+    this->max_states = (uint32_t)std::min<uint64_t>(std::max<uint64_t>(2, memory_limit / state_bytes), 1U << 30);
+    uint64_t slot_count = 2;
+    while (slot_count < 2 * (uint64_t)this->max_states) slot_count *= 2;
+    this->slots.assign(slot_count, EMPTY_STATE);
+    this->subsets.reserve((uint64_t)this->max_states * this->words);
+    this->next.reserve((uint64_t)this->max_states * this->alphabet_length);
+    this->state_acc.reserve(this->max_states);
+    this->scratch.assign(this->words, 0);
+
+    reset();
+}
+
+void LazyMatcher::clear_cache() {
+    this->subsets.clear();
+    this->next.clear();
+    this->state_acc.clear();
+    std::fill(this->slots.begin(), this->slots.end(), EMPTY_STATE);
+    this->start_state = EMPTY_STATE;
+    this->symbols_since_flush = 0;
+}
+
+void LazyMatcher::flush() {
+    clear_cache();
+    ++this->stats.flushes;
+}
+
+uint32_t LazyMatcher::find_or_add(bool may_give_up) {
+    const uint64_t mask = this->slots.size() - 1;
+    uint64_t slot = subset_hash(this->scratch.data(), this->words) & mask;
+    while (this->slots[slot] != EMPTY_STATE) {
+        const uint32_t d = this->slots[slot];
+        if (std::equal(this->scratch.begin(), this->scratch.end(), this->subsets.begin() + (uint64_t)d * this->words)) return d;
+        slot = (slot + 1) & mask;
+    }
+
+    if (this->state_acc.size() == this->max_states) {
+        // thrashing: states are built faster than they are used
+        if (may_give_up && this->symbols_since_flush < MIN_SYMBOLS_PER_STATE * this->max_states) return EMPTY_STATE;
+        flush();
+        slot = subset_hash(this->scratch.data(), this->words) & mask;
+    }
+    const uint32_t d = (uint32_t)this->state_acc.size();
+    this->slots[slot] = d;
+    this->subsets.insert(this->subsets.end(), this->scratch.begin(), this->scratch.end());
+    this->next.resize(this->next.size() + this->alphabet_length, EMPTY_STATE);
+    this->state_acc.push_back(subset_acc(this->scratch.data()));
+    ++this->stats.states;
+    return d;
+}
+
+void LazyMatcher::step_subset(const uint64_t* subset, uint32_t a) {
+    std::fill(this->scratch.begin(), this->scratch.end(), 0);
+    for (uint32_t i = 0; i < this->words; ++i) {
+        for (uint64_t bits = subset[i]; bits != 0; bits &= bits - 1) {
+            const uint64_t q = (uint64_t)i * 64 + __builtin_ctzll(bits);
+            const uint64_t end = this->target_begin[q * this->alphabet_length + a + 1];
+            for (uint64_t j = this->target_begin[q * this->alphabet_length + a]; j < end; ++j) {
+                this->scratch[this->targets[j] / 64] |= 1ULL << (this->targets[j] % 64);
+            }
+        }
+    }
+}
+
+bool LazyMatcher::subset_acc(const uint64_t* subset) const {
+    for (uint32_t i = 0; i < this->words; ++i) {
+        if (subset[i] & this->acc_subset[i]) return true;
+    }
+    return false;
+}
+
+uint32_t LazyMatcher::cached_start() {
+    if (this->start_state == EMPTY_STATE) {
+        this->scratch = this->start_subset;
+        this->start_state = find_or_add(false);
+    }
+    return this->start_state;
+}
+
+void LazyMatcher::restart() {
+    if (this->simulation_left > 0) {
+        this->current_subset = this->start_subset;
+    } else {
+        this->current = cached_start();
+    }
+}
+
+void LazyMatcher::reset() {
+    this->position = 0;
+    this->line = 1;
+    this->line_reported = false;
+    this->simulation_left = 0;
+    restart();
+}
+
+bool LazyMatcher::accepted() const {
+    return (this->simulation_left > 0 ? subset_acc(this->current_subset.data()) : this->state_acc[this->current] != 0);
+}
+
+void LazyMatcher::feed(const char* data, size_t length, const std::function<void(uint64_t)>& on_match) {
+    const uint32_t k = this->alphabet_length;
+    for (size_t i = 0; i < length; ++i) {
+        const unsigned char b = (unsigned char)data[i];
+        ++this->position;
+        if (this->mode == MatchMode::LINES && b == '\n') {
+            ++this->line;
+            this->line_reported = false;
+            restart();
+            continue;
+        }
+        const uint32_t symbol = this->byte2symbol[b];
+        if (symbol == UNMAPPED_BYTE) continue;
+
+        bool acc;
+        if (this->simulation_left == 0) {
+            const uint64_t row = (uint64_t)this->current * k + symbol;
+            if (this->next[row] != EMPTY_STATE) {
+                ++this->stats.hits;
+                this->current = this->next[row];
+            } else {
+                ++this->stats.misses;
+                step_subset(this->subsets.data() + (uint64_t)this->current * this->words, symbol);
+                const uint64_t flushes = this->stats.flushes;
+                const uint32_t target = find_or_add(true);
+                if (target == EMPTY_STATE) { // the NFA is simulated for a while
+                    this->current_subset = this->scratch;
+                    this->simulation_left = MIN_SYMBOLS_PER_STATE * this->max_states;
+                } else {
+                    if (this->stats.flushes == flushes) this->next[row] = target; // the row is gone after flush
+                    this->current = target;
+                }
+            }
+            ++this->symbols_since_flush;
+            acc = (this->simulation_left > 0 ? subset_acc(this->current_subset.data()) : this->state_acc[this->current] != 0);
+        } else {
+            step_subset(this->current_subset.data(), symbol);
+            this->current_subset.swap(this->scratch);
+            ++this->stats.simulated;
+            acc = subset_acc(this->current_subset.data());
+            if (--this->simulation_left == 0) { // the cache is tried again from the current subset (it isn't a flush)
+                clear_cache();
+                this->scratch = this->current_subset;
+                this->current = find_or_add(false);
+            }
+        }
+
+        if (acc) {
+            if (this->mode == MatchMode::POSITIONS) {
+                on_match(this->position);
+            } else if (!this->line_reported) {
+                on_match(this->line);
+                this->line_reported = true;
+            }
+        }
+    }
+}
+
+int scan_file(LazyMatcher& matcher, const char* filename, const std::function<void(uint64_t)>& on_match) {
+    MappedFile file(filename);
+    if (!file.ok()) return 1;
+    matcher.reset();
+    matcher.feed(file.get_data(), file.get_length(), on_match);
+    return 0;
+}
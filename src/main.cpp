@@ -3,15 +3,132 @@
 #include <string.h>
 #include <vector>
 #include <chrono>
+#include <thread>
+#include <random>
+#include <memory>
 #include "dfa_class.h"
 #include "nfa_class.h"
+#include "matcher.h"
+#include "mapped_file.h"
+#include "perf_counters.h"
+#include "dictionary_builder.h"
+#include "dfa_server.h"
+#include "lazy_matcher.h"
+#include "compiled_dfa.h"
 
 
+// words from file (one word of symbols 0-9a-zA-Z per line); empty if the file can't be read
+static std::vector<std::vector<uint32_t> > read_words(const char* filename) {
+    std::vector<std::vector<uint32_t> > words;
+    FILE* file = fopen(filename, "r");
+    if (file == nullptr) return words;
+    std::vector<uint32_t> word;
+    int c;
+    while ((c = fgetc(file)) != EOF) {
+        if (c == '\n') {
+            words.push_back(word);
+            word.clear();
+        } else if (('0' <= c && c <= '9') || ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z')) {
+            word.push_back(char2integer((char)c));
+        }
+    }
+    if (!word.empty()) words.push_back(word);
+    fclose(file);
+    return words;
+}
+
+// random words (with fixed seed) to measure speed of check_string when there is no profile
+static std::vector<std::vector<uint32_t> > random_words(uint32_t alphabet_length, uint32_t count, uint32_t length) {
+    std::mt19937 generator(2024);
+    std::vector<std::vector<uint32_t> > words(count, std::vector<uint32_t>(length));
+    for (std::vector<uint32_t>& word : words) {
+        for (uint32_t& c : word) c = generator() % alphabet_length;
+    }
+    return words;
+}
+
+// symbols per second of check_string on the words
+static double matching_throughput(const DFA& dfa, std::vector<std::vector<uint32_t> >& words) {
+    uint64_t symbols = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (std::vector<uint32_t>& word : words) {
+        for (uint32_t c : word) {
+            if (c >= dfa.get_alphabet_length()) return 0; // profile for another alphabet
+        }
+        dfa.check_string(word);
+        symbols += word.size();
+    }
+    std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start;
+    return symbols / std::max(duration.count(), 1e-9);
+}
+
+// the same for the compiled table (the words are checked in the same order)
+static double matching_throughput(const CompiledDFA& compiled, std::vector<std::vector<uint32_t> >& words) {
+    uint64_t symbols = 0;
+    volatile uint64_t accepted = 0; // so that the checks are not thrown away
+    auto start = std::chrono::high_resolution_clock::now();
+    for (std::vector<uint32_t>& word : words) {
+        for (uint32_t c : word) {
+            if (c >= compiled.get_alphabet_length()) return 0;
+        }
+        accepted += compiled.check_string(word);
+        symbols += word.size();
+    }
+    std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start;
+    return symbols / std::max(duration.count(), 1e-9);
+}
+
+// serve {socket} [--workers {number}] [--cache-limit {size}]
+static int run_server(int argc, char* argv[]) {
+    uint32_t workers = std::max<uint32_t>(1, std::thread::hardware_concurrency());
+    uint64_t cache_limit = 1ULL << 30;
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--workers") == 0) {
+            if (i + 1 >= argc || sscanf(argv[i + 1], "%u", &workers) != 1 || workers == 0) {
+                std::cout << "Error: --workers needs a positive number\n";
+                return 0;
+            }
+            ++i;
+        } else if (strcmp(argv[i], "--cache-limit") == 0) {
+            if (i + 1 >= argc || (cache_limit = parse_memory_size(argv[i + 1])) == 0) {
+                std::cout << "Error: --cache-limit needs a size, for example 512M\n";
+                return 0;
+            }
+            ++i;
+        }
+    }
+    DFAServer server(argv[2], workers, cache_limit);
+    std::cout << "Serving on " << argv[2] << " (" << workers << " workers)" << std::endl;
+    if (server.run() != 0) std::cout << "Error: couldn't listen on " << argv[2] << '\n';
+    return 0;
+}
+
+// client {socket} [{request}]: one request from arguments, or one request per line of stdin
+static int run_client(int argc, char* argv[]) {
+    std::string request, reply;
+    if (argc > 3) {
+        request = argv[3];
+        for (int i = 4; i < argc; i++) request += std::string(" ") + argv[i];
+    }
+    while (argc > 3 || std::getline(std::cin, request)) {
+        if (ask_server(argv[2], request, reply) != 0) {
+            std::cout << "Error: no server on " << argv[2] << '\n';
+            return 0;
+        }
+        std::cout << reply << std::endl;
+        if (argc > 3) break;
+    }
+    return 0;
+}
 
 int main(int argc, char *argv[]) {
     if (argc == 1) {
         std::cout << "no input\n";
         return 0;
+    } else if (argc >= 3 && strcmp(argv[1], "serve") == 0) {
+        return run_server(argc, argv);
+    } else if (argc >= 3 && strcmp(argv[1], "client") == 0) {
+        return run_client(argc, argv);
     } else if (argc < 3) {
         std::cout << "at least 2 parameters required\n";
     }
@@ -22,37 +139,372 @@ int main(int argc, char *argv[]) {
         return 0;
     }
 
-    DFA new_dfa(argv[1], argv[2]); /// ???
-    if (strcmp(argv[1], "from_nfa_string") == 0) {
-        NFA new_nfa(argv[2]);
-        new_dfa = new_nfa.convert2dfa();
-    }
-
     bool need_to_save = false;
     if (argc >= 5 && strcmp(argv[3], "save_to_bin_file") == 0) {
         need_to_save = true;
     }
+    bool need_to_save_text = false;
+    if (argc >= 5 && strcmp(argv[3], "save_to_text_file") == 0) {
+        need_to_save_text = true;
+    }
+    bool need_to_save_packed = false;
+    if (argc >= 5 && strcmp(argv[3], "save_to_packed_file") == 0) {
+        need_to_save_packed = true;
+    }
+    bool need_to_save_compiled = false;
+    if (argc >= 5 && strcmp(argv[3], "save_to_compiled_file") == 0) {
+        need_to_save_compiled = true;
+    }
 
     bool debug_flag = false; // debug gives some more information about minimizing
     bool time_counter_flag = false;
     bool print_table_at_the_end = true;
+    uint64_t mem_limit = 0; // 0 means that DFA is minimized in RAM
+    uint64_t lazy_limit = 0; // memory of lazy DFA cache for --grep with NFA (0: NFA is converted to DFA)
+    int operation_idx = 0; // index of --intersect/--unite/--difference in argv (0 if there is no operation)
+    int inclusion_idx = 0; // index of --included-in in argv
+    bool universality_check = false;
+    int grep_idx = 0; // index of --grep in argv
+    int grep_all_idx = 0; // index of --grep-all in argv
+    bool grep_lines = false;
+    bool grep_count_only = false;
+    uint32_t grep_threads = std::thread::hardware_concurrency();
+    int renumber_idx = 0; // index of --renumber in argv
+    int profile_idx = 0; // index of --profile in argv
+    RefinementMode refinement_mode = RefinementMode::SYMBOL;
+    QueuePolicy queue_policy = QueuePolicy::FIFO;
+    HugePages huge_pages = HugePages::NONE;
+    NumaPlacement placement = NumaPlacement::FIRST_TOUCH;
+    bool arena_mode = false;
+    bool acyclic_fast_path = true;
+    bool unary_fast_path = true;
+    bool compiled_benchmark = false;
+    double progress_interval = 0; // seconds between progress reports of minimization (0: no reports)
+    uint32_t prepartition_rounds = 0;
+    int perf_idx = 0; // index of --perf in argv
     for (int i = 3; i < argc; i++) {
         if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--time") == 0) time_counter_flag = true;
         else if (strcmp(argv[i], "-nd") == 0 || strcmp(argv[i], "--no-debug") == 0) debug_flag = false;
         else if (strcmp(argv[i], "-np") == 0 || strcmp(argv[i], "--no-print") == 0) print_table_at_the_end = false;
+        else if (strcmp(argv[i], "--mem-limit") == 0) {
+            if (i + 1 >= argc || (mem_limit = parse_memory_size(argv[i + 1])) == 0) {
+                std::cout << "Error: --mem-limit needs a size, for example 512M\n";
+                return 0;
+            }
+            ++i;
+        } else if (strcmp(argv[i], "--lazy") == 0) { // --lazy {size}: --grep by NFA with lazily built DFA states
+            if (i + 1 >= argc || (lazy_limit = parse_memory_size(argv[i + 1])) == 0) {
+                std::cout << "Error: --lazy needs a size of the cache, for example 64M\n";
+                return 0;
+            }
+            ++i;
+        } else if (strcmp(argv[i], "--intersect") == 0 || strcmp(argv[i], "--unite") == 0 || strcmp(argv[i], "--difference") == 0) {
+            // second automaton is given by 2 arguments, the same way as the first one
+            if (i + 2 >= argc) {
+                std::cout << "Error: " << argv[i] << " needs 2 arguments (like 1st and 2nd arguments)\n";
+                return 0;
+            }
+            request_check other_check = correctness_of_dfa_input(argv[i + 1], argv[i + 2]);
+            if (!other_check.accepted) {
+                std::cout << other_check.error << '\n';
+                return 0;
+            }
+            operation_idx = i;
+            i += 2;
+        } else if (strcmp(argv[i], "--included-in") == 0) {
+            if (i + 1 >= argc || strcmp(argv[1], "from_nfa_string") != 0 || !correctness_of_dfa_input((char*)"from_nfa_string", argv[i + 1]).accepted) {
+                std::cout << "Error: --included-in needs nfa strings in 2nd argument and after the flag\n";
+                return 0;
+            }
+            inclusion_idx = i;
+            ++i;
+        } else if (strcmp(argv[i], "--grep") == 0) { // --grep {file}: report positions (or lines) where DFA accepts
+            if (i + 1 >= argc) {
+                std::cout << "Error: --grep needs a file name\n";
+                return 0;
+            }
+            grep_idx = i;
+            ++i;
+        } else if (strcmp(argv[i], "--grep-all") == 0) { // --grep-all {file with lines "{command} {string}"}
+            if (i + 1 >= argc) {
+                std::cout << "Error: --grep-all needs a file name\n";
+                return 0;
+            }
+            grep_all_idx = i;
+            ++i;
+        } else if (strcmp(argv[i], "--lines") == 0) grep_lines = true;
+        else if (strcmp(argv[i], "--count") == 0) grep_count_only = true;
+        else if (strcmp(argv[i], "--threads") == 0) {
+            if (i + 1 >= argc || sscanf(argv[i + 1], "%u", &grep_threads) != 1 || grep_threads == 0) {
+                std::cout << "Error: --threads needs a positive number\n";
+                return 0;
+            }
+            ++i;
+        } else if (strcmp(argv[i], "--universal") == 0) {
+            if (strcmp(argv[1], "from_nfa_string") != 0) {
+                std::cout << "Error: --universal works only with from_nfa_string\n";
+                return 0;
+            }
+            universality_check = true;
+        } else if (strcmp(argv[i], "--renumber") == 0) { // --renumber bfs|dfs|hot
+            if (i + 1 >= argc || (strcmp(argv[i + 1], "bfs") != 0 && strcmp(argv[i + 1], "dfs") != 0 && strcmp(argv[i + 1], "hot") != 0)) {
+                std::cout << "Error: --renumber needs an order: bfs, dfs or hot\n";
+                return 0;
+            }
+            renumber_idx = i;
+            ++i;
+        } else if (strcmp(argv[i], "--splitters") == 0) { // --splitters symbol|block
+            if (i + 1 < argc && strcmp(argv[i + 1], "symbol") == 0) refinement_mode = RefinementMode::SYMBOL;
+            else if (i + 1 < argc && strcmp(argv[i + 1], "block") == 0) refinement_mode = RefinementMode::BLOCK;
+            else {
+                std::cout << "Error: --splitters needs a mode: symbol or block\n";
+                return 0;
+            }
+            ++i;
+        } else if (strcmp(argv[i], "--queue") == 0) { // --queue fifo|lifo|smallest
+            if (i + 1 < argc && strcmp(argv[i + 1], "fifo") == 0) queue_policy = QueuePolicy::FIFO;
+            else if (i + 1 < argc && strcmp(argv[i + 1], "lifo") == 0) queue_policy = QueuePolicy::LIFO;
+            else if (i + 1 < argc && strcmp(argv[i + 1], "smallest") == 0) queue_policy = QueuePolicy::SMALLEST_FIRST;
+            else {
+                std::cout << "Error: --queue needs a policy: fifo, lifo or smallest\n";
+                return 0;
+            }
+            ++i;
+        } else if (strcmp(argv[i], "--huge-pages") == 0) { // --huge-pages transparent|explicit
+            if (i + 1 < argc && strcmp(argv[i + 1], "transparent") == 0) huge_pages = HugePages::TRANSPARENT;
+            else if (i + 1 < argc && strcmp(argv[i + 1], "explicit") == 0) huge_pages = HugePages::EXPLICIT;
+            else {
+                std::cout << "Error: --huge-pages needs a kind: transparent or explicit\n";
+                return 0;
+            }
+            ++i;
+        } else if (strcmp(argv[i], "--numa") == 0) { // --numa first-touch|interleave
+            if (i + 1 < argc && strcmp(argv[i + 1], "first-touch") == 0) placement = NumaPlacement::FIRST_TOUCH;
+            else if (i + 1 < argc && strcmp(argv[i + 1], "interleave") == 0) placement = NumaPlacement::INTERLEAVE;
+            else {
+                std::cout << "Error: --numa needs a placement: first-touch or interleave\n";
+                return 0;
+            }
+            ++i;
+        } else if (strcmp(argv[i], "--arena") == 0) arena_mode = true;
+        else if (strcmp(argv[i], "--no-acyclic") == 0) acyclic_fast_path = false; // Hopcroft's algorithm for acyclic DFAs too
+        else if (strcmp(argv[i], "--no-unary") == 0) unary_fast_path = false; // Hopcroft's algorithm for one symbol too
+        else if (strcmp(argv[i], "--progress") == 0) { // --progress {seconds}: minimization in time slices with reports
+            if (i + 1 >= argc || sscanf(argv[i + 1], "%lf", &progress_interval) != 1 || progress_interval <= 0) {
+                std::cout << "Error: --progress needs a positive number of seconds\n";
+                return 0;
+            }
+            ++i;
+        }
+        else if (strcmp(argv[i], "--compiled") == 0) compiled_benchmark = true; // check_string against the compiled table
+        else if (strcmp(argv[i], "--prepartition") == 0) { // --prepartition {rounds}: signature hashing before Hopcroft
+            if (i + 1 >= argc || sscanf(argv[i + 1], "%u", &prepartition_rounds) != 1) {
+                std::cout << "Error: --prepartition needs a number of rounds\n";
+                return 0;
+            }
+            ++i;
+        }
+        else if (strcmp(argv[i], "--perf") == 0) { // --perf {report file}: hardware counters of phases
+            if (i + 1 >= argc) {
+                std::cout << "Error: --perf needs a file name for the report\n";
+                return 0;
+            }
+            perf_idx = i;
+            ++i;
+        }
+        else if (strcmp(argv[i], "--profile") == 0) { // --profile {file with sample words}
+            if (i + 1 >= argc) {
+                std::cout << "Error: --profile needs a file name\n";
+                return 0;
+            }
+            profile_idx = i;
+            ++i;
+        }
+    }
+
+    // tables are allocated by this policy from now on (so it must be set before reading the DFA)
+    set_table_allocation(huge_pages, placement);
+
+    if (renumber_idx != 0 && strcmp(argv[renumber_idx + 1], "hot") == 0 && profile_idx == 0) {
+        std::cout << "Error: --renumber hot needs sample words (--profile {file})\n";
+        return 0;
+    }
+
+    if (grep_all_idx != 0 && (grep_idx == 0 || grep_lines)) {
+        std::cout << "Error: --grep-all works only together with --grep (without --lines)\n";
+        return 0;
+    }
+
+    // language checks work on NFA directly (without convert2dfa), so we don't minimize anything
+    if (inclusion_idx != 0 || universality_check) {
+        NFA nfa(argv[2]);
+        language_check result = {true, {}};
+        if (inclusion_idx != 0) {
+            NFA other_nfa(argv[inclusion_idx + 1]);
+            if (other_nfa.get_alphabet_length() != nfa.get_alphabet_length()) {
+                std::cout << "Error: automata have different alphabets\n";
+                return 0;
+            }
+            result = nfa.is_included_in(other_nfa);
+            std::cout << (result.holds ? "included!\n" : "not included!\n");
+        } else {
+            result = nfa.is_universal();
+            std::cout << (result.holds ? "universal!\n" : "not universal!\n");
+        }
+        if (!result.holds) {
+            std::cout << "Counterexample:";
+            for (uint32_t c : result.counterexample) std::cout << ' ' << c;
+            std::cout << (result.counterexample.empty() ? " (empty word)\n" : "\n");
+        }
+        return 0;
+    }
+
+    // with --lazy NFA is never determinized fully: DFA states are built while the file is scanned
+    if (lazy_limit != 0) {
+        if (grep_idx == 0 || (strcmp(argv[1], "from_nfa_string") != 0 && strcmp(argv[1], "from_nfa_text_file") != 0)) {
+            std::cout << "Error: --lazy works only with --grep and NFA inputs\n";
+            return 0;
+        }
+        NFA nfa;
+        if (strcmp(argv[1], "from_nfa_string") == 0) nfa = NFA(argv[2]);
+        else if (nfa.load_from_text_file(argv[2], std::thread::hardware_concurrency()) != 0) {
+            std::cout << "Error happened when reading " << argv[2] << '\n';
+            return 0;
+        }
+        LazyMatcher matcher(nfa, grep_lines ? MatchMode::LINES : MatchMode::POSITIONS, lazy_limit);
+        uint64_t found = 0;
+        auto scan_start = std::chrono::high_resolution_clock::now();
+        const int scanning = scan_file(matcher, argv[grep_idx + 1], [&found, grep_count_only](uint64_t x) {
+            ++found;
+            if (!grep_count_only) std::cout << x << '\n';
+        });
+        auto scan_end = std::chrono::high_resolution_clock::now();
+        if (scanning != 0) {
+            std::cout << "Error happened when reading " << argv[grep_idx + 1] << '\n';
+            return 0;
+        }
+        std::cout << found << (grep_lines ? " lines matched" : " matches") << '\n';
+        const LazyStats& stats = matcher.get_stats();
+        const uint64_t transitions = stats.hits + stats.misses;
+        std::cout << "Lazy DFA: " << stats.states << " states built (cache of " << matcher.get_max_states() << "), "
+                  << stats.flushes << " flushes, hit rate " << (transitions == 0 ? 0 : 100.0 * stats.hits / transitions)
+                  << "%, " << stats.simulated << " symbols simulated by NFA\n";
+        if (time_counter_flag) {
+            std::chrono::duration<double> scan_duration = scan_end - scan_start;
+            std::cout << "Scanning time: " << scan_duration.count() << " seconds." << std::endl;
+        }
+        return 0;
+    }
+
+    // with --mem-limit big binary files are minimized out-of-core, then only the quotient DFA is loaded in RAM
+    const bool external_mode = (mem_limit != 0 && strcmp(argv[1], "from_bin_file") == 0);
+
+    auto external_start = std::chrono::high_resolution_clock::now();
+    // if the quotient is only saved, it goes to the file without being loaded in RAM
+    if (external_mode && need_to_save && operation_idx == 0 && renumber_idx == 0 && grep_idx == 0 &&
+        !compiled_benchmark && !print_table_at_the_end) {
+        if (external_minimization_to_file(argv[2], mem_limit, debug_flag, argv[4]) != 0) {
+            std::cout << "Error: external minimization of " << argv[2] << " failed\n";
+            return 0;
+        }
+        if (time_counter_flag) {
+            std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - external_start;
+            std::cout << "Execution time: " << duration.count() << " seconds." << std::endl;
+        }
+        std::cout << "Saved successfully to binary file\n";
+        return 0;
+    }
+    DFA new_dfa((char*)"", (char*)""); // 1 state, replaced by the loaded (or the quotient) DFA
+    if (external_mode) {
+        if (external_minimization(argv[2], mem_limit, debug_flag, new_dfa) != 0) {
+            std::cout << "Error: external minimization of " << argv[2] << " failed\n";
+            return 0;
+        }
+    } else if (read_dfa(argv[1], argv[2], new_dfa) != 0) {
+        std::cout << "Error happened when reading " << argv[2] << '\n';
+        return 0;
+    }
+    auto external_end = std::chrono::high_resolution_clock::now();
+
+    if (operation_idx != 0) {
+        DFA other_dfa((char*)"", (char*)"");
+        if (read_dfa(argv[operation_idx + 1], argv[operation_idx + 2], other_dfa) != 0) {
+            std::cout << "Error happened when reading " << argv[operation_idx + 2] << '\n';
+            return 0;
+        }
+        if (other_dfa.get_alphabet_length() != new_dfa.get_alphabet_length()) {
+            std::cout << "Error: automata have different alphabets\n";
+            return 0;
+        }
+        if (strcmp(argv[operation_idx], "--intersect") == 0) new_dfa = new_dfa.intersect(other_dfa);
+        else if (strcmp(argv[operation_idx], "--unite") == 0) new_dfa = new_dfa.unite(other_dfa);
+        else new_dfa = new_dfa.difference(other_dfa);
     }
 
     // Start the timer
     auto start = std::chrono::high_resolution_clock::now();
 
-    new_dfa.minimization(debug_flag);
+    new_dfa.set_refinement(refinement_mode, queue_policy);
+    new_dfa.set_arena_mode(arena_mode);
+    new_dfa.set_acyclic_fast_path(acyclic_fast_path);
+    new_dfa.set_unary_fast_path(unary_fast_path);
+    new_dfa.set_prepartition(prepartition_rounds);
+    std::unique_ptr<PerfReport> perf_report(perf_idx != 0 ? new PerfReport() : nullptr);
+    new_dfa.set_perf_report(perf_report.get());
+    if (progress_interval > 0) {
+        while (new_dfa.minimization_step({progress_interval, 0}, [](const MinimizationProgress& progress) {
+            std::cout << "Progress: " << progress.blocks << " blocks of " << progress.states << " states, "
+                      << progress.queue_length << " splitters in queue, " << progress.iterations << " iterations" << std::endl;
+        }) == MinimizationStatus::PAUSED) {}
+    } else {
+        new_dfa.minimization(debug_flag);
+    }
+    new_dfa.set_perf_report(nullptr);
 
     // // End the timer
     auto end = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> duration = end - start;
+    if (external_mode) duration += external_end - external_start;
     
     if (time_counter_flag) {
         std::cout << "Execution time: " << duration.count() << " seconds." << std::endl;
+        std::cout << "Iterations: " << new_dfa.get_iterations() << std::endl;
+    }
+
+    if (renumber_idx != 0) {
+        std::vector<std::vector<uint32_t> > samples;
+        if (profile_idx != 0) samples = read_words(argv[profile_idx + 1]);
+        else if (time_counter_flag) samples = random_words(new_dfa.get_alphabet_length(), 64, 1 << 18);
+
+        const char* order_name = argv[renumber_idx + 1];
+        const StateOrder order = (strcmp(order_name, "bfs") == 0 ? StateOrder::BFS : (strcmp(order_name, "dfs") == 0 ? StateOrder::DFS : StateOrder::HOTNESS));
+        const double before = (time_counter_flag ? matching_throughput(new_dfa, samples) : 0);
+        perf_phase(perf_report.get(), "renumber");
+        new_dfa.renumber_states(order, samples);
+        perf_end(perf_report.get());
+        if (time_counter_flag) {
+            const double after = matching_throughput(new_dfa, samples);
+            std::cout << "Matching throughput (check_string): " << before / 1e6 << " -> " << after / 1e6 << " M symbols/s" << std::endl;
+        }
+    }
+
+    if (compiled_benchmark) {
+        std::vector<std::vector<uint32_t> > samples;
+        if (profile_idx != 0) samples = read_words(argv[profile_idx + 1]);
+        else samples = random_words(new_dfa.get_alphabet_length(), 64, 1 << 18);
+        perf_phase(perf_report.get(), "compile");
+        CompiledDFA compiled(new_dfa);
+        if (!compiled.ok()) {
+            perf_end(perf_report.get());
+            std::cout << "Error: DFA is too big for the compiled table (size * stride must be < 2^32)\n";
+            return 0;
+        }
+        perf_phase(perf_report.get(), "check_string");
+        const double before = matching_throughput(new_dfa, samples);
+        perf_phase(perf_report.get(), "check (compiled)");
+        const double after = matching_throughput(compiled, samples);
+        perf_end(perf_report.get());
+        std::cout << "Matching throughput (check_string -> compiled): " << before / 1e6 << " -> " << after / 1e6 << " M symbols/s" << std::endl;
     }
 
     if (print_table_at_the_end) new_dfa.print_table();
@@ -62,5 +514,118 @@ int main(int argc, char *argv[]) {
         std::cout << (saving == 0 ? "Saved successfully to binary file" : "Error happened when saving") << '\n';
     }
 
+    if (need_to_save_text) {
+        int saving = new_dfa.save_to_text_file(argv[4], std::thread::hardware_concurrency());
+        std::cout << (saving == 0 ? "Saved successfully to text file" : "Error happened when saving") << '\n';
+    }
+
+    if (need_to_save_packed) {
+        int saving = new_dfa.save_to_packed_file(argv[4], std::thread::hardware_concurrency());
+        std::cout << (saving == 0 ? "Saved successfully to compressed file" : "Error happened when saving") << '\n';
+    }
+
+    if (need_to_save_compiled) {
+        CompiledDFA compiled(new_dfa);
+        if (!compiled.ok()) std::cout << "Error: DFA is too big for the compiled table (size * stride must be < 2^32)\n";
+        else std::cout << (compiled.save(argv[4]) == 0 ? "Saved successfully to compiled file" : "Error happened when saving") << '\n';
+    }
+
+    if (grep_idx != 0 && grep_all_idx != 0) { // main DFA and all DFAs from the list scan the file in one pass
+        std::vector<DFA> dfas = {new_dfa};
+        FILE* list = fopen(argv[grep_all_idx + 1], "r");
+        if (list == nullptr) {
+            std::cout << "Error: couldn't open " << argv[grep_all_idx + 1] << '\n';
+            return 0;
+        }
+        char command[64];
+        static char dfa_str[1 << 16];
+        while (fscanf(list, "%63s %65535s", command, dfa_str) == 2) {
+            request_check check = correctness_of_dfa_input(command, dfa_str);
+            if (!check.accepted) {
+                std::cout << "DFA " << dfas.size() << ": " << check.error << '\n';
+                fclose(list);
+                return 0;
+            }
+            DFA dfa((char*)"", (char*)"");
+            if (read_dfa(command, dfa_str, dfa) != 0) {
+                std::cout << "Error happened when reading " << dfa_str << '\n';
+                fclose(list);
+                return 0;
+            }
+            dfa.minimization(false);
+            dfas.push_back(dfa);
+        }
+        fclose(list);
+
+        MultiMatcher multi_matcher(dfas);
+        std::vector<uint64_t> found(dfas.size(), 0);
+        auto scan_start = std::chrono::high_resolution_clock::now();
+        perf_phase(perf_report.get(), "scan (all DFAs)");
+        int scanning = scan_file(multi_matcher, argv[grep_idx + 1], [&found](uint32_t idx, uint64_t) { ++found[idx]; });
+        perf_end(perf_report.get());
+        auto scan_end = std::chrono::high_resolution_clock::now();
+        if (scanning != 0) {
+            std::cout << "Error happened when reading " << argv[grep_idx + 1] << '\n';
+            return 0;
+        }
+        for (size_t i = 0; i < dfas.size(); ++i) std::cout << "DFA " << i << ": " << found[i] << " matches\n";
+
+        if (time_counter_flag) {
+            std::chrono::duration<double> scan_duration = scan_end - scan_start;
+            std::cout << "Scanning time (" << dfas.size() << " DFAs in one pass): " << scan_duration.count() << " seconds." << std::endl;
+            // for comparison: every DFA reads the file separately
+            auto separate_start = std::chrono::high_resolution_clock::now();
+            for (const DFA& dfa : dfas) {
+                Matcher matcher(dfa, MatchMode::POSITIONS);
+                scan_file(matcher, argv[grep_idx + 1], 1, [](uint64_t) {});
+            }
+            auto separate_end = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double> separate_duration = separate_end - separate_start;
+            std::cout << "Scanning time (" << dfas.size() << " separate passes): " << separate_duration.count() << " seconds." << std::endl;
+        }
+    } else if (grep_idx != 0) {
+        Matcher matcher(new_dfa, grep_lines ? MatchMode::LINES : MatchMode::POSITIONS);
+        uint64_t found = 0;
+        auto scan_start = std::chrono::high_resolution_clock::now();
+        perf_phase(perf_report.get(), "scan");
+        int scanning;
+        if (new_dfa.has_labels()) { // labels of matches are printed too (one sequential pass)
+            MappedFile file(argv[grep_idx + 1]);
+            scanning = (file.ok() ? 0 : 1);
+            matcher.feed_labels(file.get_data(), file.get_length(), [&found, grep_count_only](uint64_t x, uint32_t label) {
+                ++found;
+                if (!grep_count_only) std::cout << x << ' ' << label << '\n';
+            });
+        } else {
+            scanning = scan_file(matcher, argv[grep_idx + 1], grep_threads, [&found, grep_count_only](uint64_t x) {
+                ++found;
+                if (!grep_count_only) std::cout << x << '\n';
+            });
+        }
+        perf_end(perf_report.get());
+        auto scan_end = std::chrono::high_resolution_clock::now();
+        if (scanning != 0) {
+            std::cout << "Error happened when reading " << argv[grep_idx + 1] << '\n';
+        } else {
+            std::cout << found << (grep_lines ? " lines matched" : " matches") << '\n';
+        }
+        if (time_counter_flag) {
+            std::chrono::duration<double> scan_duration = scan_end - scan_start;
+            std::cout << "Scanning time: " << scan_duration.count() << " seconds." << std::endl;
+        }
+    }
+
+    if (perf_report) {
+        // check_string on random words, if nothing else was matched
+        if (grep_idx == 0) {
+            std::vector<std::vector<uint32_t> > words = random_words(new_dfa.get_alphabet_length(), 64, 1 << 16);
+            perf_phase(perf_report.get(), "check_string");
+            matching_throughput(new_dfa, words);
+            perf_end(perf_report.get());
+        }
+        int saving = perf_report->save(argv[perf_idx + 1]);
+        std::cout << (saving == 0 ? "Counters report saved" : "Error happened when saving counters report") << '\n';
+    }
+
     return 0;
 }
@@ -0,0 +1,24 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mapped_file.h"
+
+MappedFile::MappedFile(const char* filename) {
+    const int fd = open(filename, O_RDONLY);
+    if (fd < 0) { this->error = true; return; }
+    struct stat st;
+    if (fstat(fd, &st) != 0) { close(fd); this->error = true; return; }
+    this->length = (size_t)st.st_size;
+    if (this->length == 0) { close(fd); return; }
+
+    void* mapped = mmap(nullptr, this->length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) { this->error = true; this->length = 0; return; }
+    madvise(mapped, this->length, MADV_SEQUENTIAL);
+    this->data = (const char*)mapped;
+}
+
+MappedFile::~MappedFile() {
+    if (this->data != nullptr) munmap((void*)this->data, this->length);
+}
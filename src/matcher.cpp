@@ -0,0 +1,333 @@
+#include <map>
+#include <thread>
+#include <immintrin.h>
+#include "matcher.h"
+#include "mapped_file.h"
+
+uint32_t byte_to_symbol(uint32_t b, uint32_t alphabet_length) {
+    const char c = (char)b;
+    if (alphabet_length >= 256) {
+        return b;
+    } else if ((('0' <= c && c <= '9') || ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z')) && char2integer(c) < alphabet_length) {
+        return char2integer(c);
+    } else {
+        return UNMAPPED_BYTE;
+    }
+}
+
+Matcher::Matcher(const DFA& dfa, MatchMode _mode) {
+    this->alphabet_length = dfa.get_alphabet_length();
+    this->starting_node = dfa.get_starting_node();
+    this->mode = _mode;
+
+    const uint32_t size = dfa.get_size();
+    this->table.resize((uint64_t)size * this->alphabet_length);
+    this->acc.resize(size);
+    for (uint32_t s = 0; s < size; ++s) {
+        for (uint32_t a = 0; a < this->alphabet_length; ++a) {
+            this->table[(uint64_t)s * this->alphabet_length + a] = dfa.get_transition(a, s);
+        }
+        this->acc[s] = dfa.is_accepting(s);
+    }
+    if (dfa.has_labels()) {
+        this->labels.resize(size);
+        for (uint32_t s = 0; s < size; ++s) this->labels[s] = dfa.get_label(s);
+    }
+
+    for (uint32_t b = 0; b < 256; ++b) {
+        this->byte2symbol[b] = byte_to_symbol(b, this->alphabet_length);
+    }
+
+    reset();
+}
+
+void Matcher::reset() {
+    this->current = {this->starting_node, 0, 1, false};
+}
+
+template <typename F>
+MatcherState Matcher::run_states(MatcherState cur, const char* data, size_t length, F on_match) const {
+    for (size_t i = 0; i < length; ++i) {
+        const unsigned char b = (unsigned char)data[i];
+        ++cur.position;
+        if (this->mode == MatchMode::LINES && b == '\n') {
+            cur.state = this->starting_node;
+            ++cur.line;
+            cur.line_reported = false;
+            continue;
+        }
+        const uint32_t symbol = this->byte2symbol[b];
+        if (symbol == UNMAPPED_BYTE) continue;
+        cur.state = this->table[(uint64_t)cur.state * this->alphabet_length + symbol];
+        if (this->acc[cur.state]) {
+            if (this->mode == MatchMode::POSITIONS) {
+                on_match(cur.position, cur.state);
+            } else if (!cur.line_reported) {
+                on_match(cur.line, cur.state);
+                cur.line_reported = true;
+            }
+        }
+    }
+    return cur;
+}
+
+MatcherState Matcher::run(MatcherState cur, const char* data, size_t length, const std::function<void(uint64_t)>& on_match) const {
+    return run_states(cur, data, length, [&on_match](uint64_t x, uint32_t) { on_match(x); });
+}
+
+void Matcher::feed(const char* data, size_t length, const std::function<void(uint64_t)>& on_match) {
+    this->current = run(this->current, data, length, on_match);
+}
+
+MatcherState Matcher::run_labels(MatcherState cur, const char* data, size_t length, const std::function<void(uint64_t, uint32_t)>& on_match) const {
+    return run_states(cur, data, length, [this, &on_match](uint64_t x, uint32_t state) { on_match(x, label_of(state)); });
+}
+
+void Matcher::feed_labels(const char* data, size_t length, const std::function<void(uint64_t, uint32_t)>& on_match) {
+    this->current = run_labels(this->current, data, length, on_match);
+}
+
+
+// Simulates the chunk from all states at once. Runs which come to the same state are merged,
+// usually very few runs are left after a short prefix of the chunk. Merges are kept as a forest of runs
+// (parent[r] is the run which r was merged into), so the history takes O(states) memory.
+// Returns end state for each start state, or an empty vector if the runs don't merge fast enough
+// (more than max_steps steps of all runs): then the chunk is scanned after its start state is known.
+static std::vector<uint32_t> speculative_run(const Matcher& matcher, const char* data, size_t length, uint64_t max_steps) {
+    const uint32_t size = matcher.get_size();
+    if (size > max_steps) return {};
+    std::vector<uint32_t> active(size), run(size); // run run[k] is in state active[k]
+    std::vector<uint32_t> parent(size);
+    for (uint32_t s = 0; s < size; ++s) active[s] = run[s] = parent[s] = s;
+    std::vector<uint32_t> where(size, EMPTY_STATE); // state --> run in it (while merging)
+
+    uint64_t steps = 0;
+    for (size_t i = 0; i < length; ++i) {
+        const uint32_t symbol = matcher.symbol_of((unsigned char)data[i]);
+        if (symbol == UNMAPPED_BYTE) continue;
+        steps += active.size();
+        if (steps > max_steps) return {};
+        for (uint32_t& state : active) state = matcher.step(state, symbol);
+        if (active.size() == 1) continue;
+
+        size_t kept = 0;
+        for (size_t k = 0; k < active.size(); ++k) {
+            const uint32_t state = active[k];
+            if (where[state] == EMPTY_STATE) {
+                where[state] = run[k];
+                active[kept] = state;
+                run[kept] = run[k];
+                ++kept;
+            } else {
+                parent[run[k]] = where[state];
+            }
+        }
+        for (size_t k = 0; k < kept; ++k) where[active[k]] = EMPTY_STATE;
+        active.resize(kept);
+        run.resize(kept);
+    }
+
+    // runs which are left are roots, every other run ends where its root does
+    std::vector<uint32_t> result(size, EMPTY_STATE);
+    for (size_t k = 0; k < active.size(); ++k) result[run[k]] = active[k];
+    for (uint32_t s = 0; s < size; ++s) {
+        uint32_t root = s;
+        while (parent[root] != root) root = parent[root];
+        for (uint32_t r = s; r != root;) {
+            const uint32_t next = parent[r];
+            parent[r] = root;
+            r = next;
+        }
+        result[s] = result[root];
+    }
+    return result;
+}
+
+int scan_file(const Matcher& matcher, const char* filename, uint32_t threads, const std::function<void(uint64_t)>& on_match) {
+    MappedFile file(filename);
+    if (!file.ok()) return 1;
+    const char* data = file.get_data();
+    const size_t file_size = file.get_length();
+    if (file_size == 0) return 0;
+
+    const size_t MIN_CHUNK = 1 << 16; // smaller chunks are not worth a thread
+    if (threads == 0) threads = 1;
+    if (file_size / MIN_CHUNK < threads) threads = (uint32_t)(file_size / MIN_CHUNK) + 1;
+
+    std::vector<size_t> bounds(threads + 1);
+    bounds[0] = 0;
+    bounds[threads] = file_size;
+    for (uint32_t j = 1; j < threads; ++j) {
+        size_t b = (file_size / threads) * j;
+        if (b < bounds[j - 1]) b = bounds[j - 1];
+        if (matcher.get_mode() == MatchMode::LINES && b > 0 && b < file_size) { // chunk starts at the beginning of a line
+            const void* newline = memchr(data + b - 1, '\n', file_size - b + 1);
+            b = (newline == nullptr ? file_size : (size_t)((const char*)newline - data) + 1);
+        }
+        bounds[j] = b;
+    }
+
+    std::vector<std::vector<uint64_t> > matches(threads);
+    std::vector<MatcherState> ends(threads);
+    auto scan_chunk = [&](uint32_t j, uint32_t start_state) {
+        const MatcherState from = {start_state, bounds[j], 1, false};
+        ends[j] = matcher.run(from, data + bounds[j], bounds[j + 1] - bounds[j], [&matches, j](uint64_t x) { matches[j].push_back(x); });
+    };
+
+    std::vector<std::thread> workers;
+    if (matcher.get_mode() == MatchMode::LINES) {
+        for (uint32_t j = 0; j < threads; ++j) workers.emplace_back(scan_chunk, j, matcher.get_starting_node());
+        for (std::thread& worker : workers) worker.join();
+        // line numbers were counted from the start of each chunk
+        uint64_t lines_before = 0;
+        for (uint32_t j = 0; j < threads; ++j) {
+            for (uint64_t line : matches[j]) on_match(line + lines_before);
+            lines_before += ends[j].line - 1;
+        }
+    } else {
+        // chunk 0 is scanned for real, others are simulated from all states at the same time;
+        // the simulation may cost at most SPECULATION_STEPS_PER_BYTE steps per byte of the chunk
+        const uint64_t SPECULATION_STEPS_PER_BYTE = 4;
+        std::vector<std::vector<uint32_t> > end_state_of(threads);
+        workers.emplace_back(scan_chunk, 0, matcher.get_starting_node());
+        for (uint32_t j = 1; j < threads; ++j) {
+            workers.emplace_back([&, j]() {
+                const size_t length = bounds[j + 1] - bounds[j];
+                end_state_of[j] = speculative_run(matcher, data + bounds[j], length, SPECULATION_STEPS_PER_BYTE * length);
+            });
+        }
+        for (std::thread& worker : workers) worker.join();
+        workers.clear();
+
+        // start states go from one chunk to the next; chunks where the simulation gave up are scanned here
+        std::vector<char> scanned(threads, 0);
+        scanned[0] = 1;
+        uint32_t start_state = matcher.get_starting_node();
+        for (uint32_t j = 1; j < threads; ++j) {
+            start_state = (scanned[j - 1] ? ends[j - 1].state : end_state_of[j - 1][start_state]);
+            if (end_state_of[j].empty()) {
+                scan_chunk(j, start_state);
+                scanned[j] = 1;
+            } else {
+                workers.emplace_back(scan_chunk, j, start_state);
+            }
+        }
+        for (std::thread& worker : workers) worker.join();
+
+        for (uint32_t j = 0; j < threads; ++j) {
+            for (uint64_t position : matches[j]) on_match(position);
+        }
+    }
+
+    return 0;
+}
+
+
+MultiMatcher::MultiMatcher(const std::vector<DFA>& dfas) {
+    // bytes with the same symbols in all DFAs are in one class
+    std::map<std::vector<uint32_t>, uint32_t> class_of_symbols;
+    std::vector<std::vector<uint32_t> > symbols_of_class;
+    for (uint32_t b = 0; b < 256; ++b) {
+        std::vector<uint32_t> symbols(dfas.size());
+        for (size_t i = 0; i < dfas.size(); ++i) symbols[i] = byte_to_symbol(b, dfas[i].get_alphabet_length());
+        auto it = class_of_symbols.find(symbols);
+        if (it == class_of_symbols.end()) {
+            it = class_of_symbols.insert(std::make_pair(symbols, (uint32_t)symbols_of_class.size())).first;
+            symbols_of_class.push_back(symbols);
+        }
+        this->byte2class[b] = (uint8_t)it->second;
+    }
+    this->classes = (uint32_t)symbols_of_class.size();
+
+    std::vector<uint64_t> first_row(dfas.size());
+    uint64_t total = 0;
+    for (size_t i = 0; i < dfas.size(); ++i) {
+        first_row[i] = total;
+        total += (uint64_t)dfas[i].get_size() * this->classes;
+    }
+    assert(total < MATCH_BIT); // offsets must fit in 31 bits (they are signed indices for gathers)
+    this->table.resize(total);
+
+    for (size_t i = 0; i < dfas.size(); ++i) {
+        const DFA& dfa = dfas[i];
+        auto row = [&](uint32_t s) {
+            return (uint32_t)(first_row[i] + (uint64_t)s * this->classes);
+        };
+        for (uint32_t s = 0; s < dfa.get_size(); ++s) {
+            this->row_acc.push_back(dfa.is_accepting(s));
+            for (uint32_t c = 0; c < this->classes; ++c) {
+                const uint32_t symbol = symbols_of_class[c][i];
+                uint32_t& cell = this->table[first_row[i] + (uint64_t)s * this->classes + c];
+                if (symbol == UNMAPPED_BYTE) { // unmapped bytes are skipped: DFA stays in the same state
+                    cell = row(s);
+                } else {
+                    const uint32_t next_state = dfa.get_transition(symbol, s);
+                    cell = row(next_state) | (dfa.is_accepting(next_state) ? MATCH_BIT : 0);
+                }
+            }
+        }
+        this->starting_rows.push_back(row(dfa.get_starting_node()));
+    }
+
+    this->use_avx2 = __builtin_cpu_supports("avx2");
+    reset();
+}
+
+void MultiMatcher::reset() {
+    this->current = this->starting_rows;
+    this->position = 0;
+}
+
+// one step of all DFAs, returns true if at least one of them came to acc state
+__attribute__((target("avx2")))
+static bool step_avx2(const uint32_t* table, uint32_t* states, size_t count, uint32_t byte_class) {
+    const __m256i mask = _mm256_set1_epi32((int)~MultiMatcher::MATCH_BIT);
+    const __m256i add = _mm256_set1_epi32((int)byte_class);
+    __m256i any = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i cur = _mm256_loadu_si256((const __m256i*)(states + i));
+        const __m256i idx = _mm256_add_epi32(_mm256_and_si256(cur, mask), add);
+        const __m256i next = _mm256_i32gather_epi32((const int*)table, idx, 4);
+        _mm256_storeu_si256((__m256i*)(states + i), next);
+        any = _mm256_or_si256(any, next);
+    }
+    uint32_t any_tail = 0;
+    for (; i < count; ++i) {
+        states[i] = table[(states[i] & ~MultiMatcher::MATCH_BIT) + byte_class];
+        any_tail |= states[i];
+    }
+    return _mm256_movemask_ps(_mm256_castsi256_ps(any)) != 0 || (any_tail & MultiMatcher::MATCH_BIT);
+}
+
+static bool step_scalar(const uint32_t* table, uint32_t* states, size_t count, uint32_t byte_class) {
+    uint32_t any = 0;
+    for (size_t i = 0; i < count; ++i) {
+        states[i] = table[(states[i] & ~MultiMatcher::MATCH_BIT) + byte_class];
+        any |= states[i];
+    }
+    return (any & MultiMatcher::MATCH_BIT) != 0;
+}
+
+void MultiMatcher::feed(const char* data, size_t length, const std::function<void(uint32_t, uint64_t)>& on_match) {
+    const uint32_t* table_data = this->table.data();
+    uint32_t* states = this->current.data();
+    const size_t count = this->current.size();
+    for (size_t i = 0; i < length; ++i) {
+        ++this->position;
+        const uint32_t byte_class = this->byte2class[(unsigned char)data[i]];
+        const bool any_acc = (this->use_avx2 ? step_avx2(table_data, states, count, byte_class) : step_scalar(table_data, states, count, byte_class));
+        if (!any_acc) continue;
+        for (size_t k = 0; k < count; ++k) {
+            if (states[k] & MATCH_BIT) on_match((uint32_t)k, this->position);
+        }
+    }
+}
+
+int scan_file(MultiMatcher& matcher, const char* filename, const std::function<void(uint32_t, uint64_t)>& on_match) {
+    MappedFile file(filename);
+    if (!file.ok()) return 1;
+    matcher.reset();
+    matcher.feed(file.get_data(), file.get_length(), on_match);
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include "nfa_class.h"
+
+// Antichain algorithm for L(A) ⊆ L(B) without determinization of B.
+// We explore pairs (p, S): p is a state of A, S is the set of states of B after the same word.
+// A pair with p acc in A and S without acc states of B gives a counterexample.
+// (p, S) is subsumed by (p, S') if S' ⊆ S: every word rejected from S is also rejected from S',
+// so we keep only the minimal sets for each p (the antichain) and explore pairs in BFS order.
+// A smaller set found deeper doesn't remove a bigger one which is not expanded yet
+// (the shortest counterexample may go through it), so the first counterexample is one of the shortest.
+
+namespace {
+
+struct AntichainNode {
+    uint32_t p; // state of A
+    uint32_t parent; // index of the node we came from (EMPTY_STATE for initial nodes)
+    uint32_t symbol; // symbol we came by
+    uint32_t depth; // length of the word
+    bool alive; // false if the node was removed from the antichain by a smaller set
+};
+
+class SubsetStorage { // all sets of B-states as bitsets stored one after another
+private:
+    uint32_t words;
+    std::vector<uint64_t> data={};
+public:
+    explicit SubsetStorage(uint32_t nfa_size) : words((nfa_size + 63) / 64) {}
+
+    uint32_t words_per_set() const { return this->words; }
+
+    const uint64_t* get(uint32_t idx) const { return this->data.data() + (uint64_t)idx * this->words; }
+
+    void add(const std::vector<uint64_t>& set) { this->data.insert(this->data.end(), set.begin(), set.end()); }
+
+    bool is_subset(const uint64_t* x, const uint64_t* y) const { // x ⊆ y
+        for (uint32_t i = 0; i < this->words; ++i) {
+            if (x[i] & ~y[i]) return false;
+        }
+        return true;
+    }
+};
+
+}
+
+language_check NFA::is_included_in(const NFA& other) const {
+    assert(this->alphabet_length == other.alphabet_length);
+
+    SubsetStorage sets(other.size);
+    const uint32_t words = sets.words_per_set();
+    std::vector<AntichainNode> nodes;
+    std::vector<std::vector<uint32_t> > antichain(this->size); // for each p: indices of nodes with minimal sets
+    uint32_t cur = 0; // nodes are expanded in the order they were added (BFS), nodes before cur are expanded
+
+    std::vector<uint64_t> other_acc_mask(words, 0);
+    for (uint32_t s = 0; s < other.size; ++s) {
+        if (other.v_acc[s]) other_acc_mask[s / 64] |= (1ULL << (s % 64));
+    }
+
+    auto build_counterexample = [&nodes](uint32_t idx) {
+        std::vector<uint32_t> word;
+        while (nodes[idx].parent != EMPTY_STATE) {
+            word.push_back(nodes[idx].symbol);
+            idx = nodes[idx].parent;
+        }
+        return std::vector<uint32_t>(word.rbegin(), word.rend());
+    };
+
+    // returns false if (p, set) is subsumed, otherwise adds it to the antichain (it is expanded later)
+    auto try_add = [&](uint32_t p, const std::vector<uint64_t>& set, uint32_t parent, uint32_t symbol) {
+        for (uint32_t idx : antichain[p]) {
+            if (sets.is_subset(sets.get(idx), set.data())) return false;
+        }
+        const uint32_t new_idx = (uint32_t)nodes.size();
+        const uint32_t depth = (parent == EMPTY_STATE ? 0 : nodes[parent].depth + 1);
+        nodes.push_back({p, parent, symbol, depth, true});
+        sets.add(set);
+
+        std::vector<uint32_t> minimal_sets;
+        for (uint32_t idx : antichain[p]) {
+            // bigger set is not needed if it has the same depth or it is already expanded
+            if (sets.is_subset(sets.get(new_idx), sets.get(idx)) && (nodes[idx].depth == depth || idx < cur)) nodes[idx].alive = false;
+            else minimal_sets.push_back(idx);
+        }
+        minimal_sets.push_back(new_idx);
+        antichain[p].swap(minimal_sets);
+        return true;
+    };
+
+    auto is_counterexample = [&](uint32_t idx) {
+        if (!this->v_acc[nodes[idx].p]) return false;
+        const uint64_t* set = sets.get(idx);
+        for (uint32_t i = 0; i < words; ++i) {
+            if (set[i] & other_acc_mask[i]) return false;
+        }
+        return true;
+    };
+
+    std::vector<uint64_t> initial_set(words, 0);
+    for (uint32_t s : other.starting_nodes) initial_set[s / 64] |= (1ULL << (s % 64));
+    for (uint32_t p : this->starting_nodes) try_add(p, initial_set, EMPTY_STATE, 0);
+
+    std::vector<uint64_t> next_set(words);
+    for (; cur < nodes.size(); ++cur) {
+        if (!nodes[cur].alive) continue;
+        if (is_counterexample(cur)) return {false, build_counterexample(cur)};
+
+        const uint32_t p = nodes[cur].p;
+        for (uint32_t a = 0; a < this->alphabet_length; ++a) {
+            if (this->delta[p][a].empty()) continue;
+            std::fill(next_set.begin(), next_set.end(), 0);
+            const uint64_t* set = sets.get(cur); // pointer may change after adding nodes, so take it for each symbol
+            for (uint32_t i = 0; i < words; ++i) {
+                uint64_t bits = set[i];
+                while (bits) {
+                    const uint32_t s = i * 64 + __builtin_ctzll(bits);
+                    bits &= bits - 1;
+                    for (uint32_t t : other.delta[s][a]) next_set[t / 64] |= (1ULL << (t % 64));
+                }
+            }
+            for (uint32_t next_p : this->delta[p][a]) {
+                try_add(next_p, next_set, cur, a);
+            }
+        }
+    }
+
+    return {true, {}};
+}
+
+language_check NFA::is_universal() const {
+    // L(N) = Σ* <=> L(one state automaton accepting everything) ⊆ L(N)
+    std::vector<std::vector<std::vector<uint32_t> > > all_delta(1, std::vector<std::vector<uint32_t> >(this->alphabet_length, std::vector<uint32_t>(1, 0)));
+    std::vector<uint32_t> all_starting_nodes = {0};
+    std::vector<bool> all_acc = {true};
+    NFA all_words(this->alphabet_length, 1, all_delta, all_starting_nodes, all_acc);
+    return all_words.is_included_in(*this);
+}
@@ -1,4 +1,5 @@
 #include "nfa_class.h"
+#include "parallel_utils.h"
 
 NFA::NFA(char* s) { // I assume that string s is valid
     char* ptr = s;
@@ -46,15 +47,22 @@ NFA::NFA(char* s) { // I assume that string s is valid
         _starting_nodes.push_back(0);
     }
 
-    init(_alphabet_length, _size, _delta, _starting_nodes, _v_acc);
+    init(_alphabet_length, _size, std::move(_delta), std::move(_starting_nodes), std::move(_v_acc));
 }
 
 void NFA::init(uint32_t _alphabet_length, uint32_t _size, std::vector<std::vector<std::vector<uint32_t> > > &_delta, std::vector<uint32_t> &_starting_nodes, std::vector<bool> &_v_acc) {
+    std::vector<std::vector<std::vector<uint32_t> > > delta_copy = _delta;
+    std::vector<uint32_t> starting_nodes_copy = _starting_nodes;
+    std::vector<bool> v_acc_copy = _v_acc;
+    init(_alphabet_length, _size, std::move(delta_copy), std::move(starting_nodes_copy), std::move(v_acc_copy));
+}
+
+void NFA::init(uint32_t _alphabet_length, uint32_t _size, std::vector<std::vector<std::vector<uint32_t> > > &&_delta, std::vector<uint32_t> &&_starting_nodes, std::vector<bool> &&_v_acc) {
     alphabet_length = _alphabet_length;
     size = _size;
-    starting_nodes = _starting_nodes;
+    starting_nodes = std::move(_starting_nodes);
     for (uint32_t starting_node : starting_nodes) assert(starting_node != EMPTY_STATE && starting_node < size);
-    delta = _delta;
+    delta = std::move(_delta);
     assert(delta.size() == size);
     for(uint32_t node = 0; node < size; ++node) {
         assert(delta[node].size() == alphabet_length);
@@ -62,7 +70,7 @@ void NFA::init(uint32_t _alphabet_length, uint32_t _size, std::vector<std::vecto
             for (uint32_t next_node: delta[node][a]) assert(next_node != EMPTY_STATE && next_node < size);
         }
     }
-    v_acc = _v_acc;
+    v_acc = std::move(_v_acc);
     assert(v_acc.size() == size);
 }
 
@@ -82,10 +90,16 @@ void NFA::print() {
     }
 }
 
-DFA NFA::convert2dfa() { // O(2^n * n^2)
+// Full subset construction: subset `node` is a bitmask of NFA states. Successors of a subset are the OR of
+// successors of its 8-bit slices, so for each symbol and slice the successors of all 256 values are precomputed
+// (table of 256 * ceil(n / 8) masks per symbol, it fits in L1/L2 for n <= 31).
+static const uint32_t SLICE_BITS = 8;
+static const uint32_t MIN_SUBSETS_PER_THREAD = 1 << 16;
+
+DFA NFA::convert2dfa() { // O(2^n * |alphabet| * n / 8)
     assert(size <= 31); // I'm not sure that more than 2^31 nodes will be okay
     uint32_t dfa_size = (1 << size);
-    std::vector<std::vector<uint32_t> > dfa_delta(alphabet_length, std::vector<uint32_t>(dfa_size));
+    std::vector<table_vector<uint32_t> > dfa_delta(alphabet_length, table_vector<uint32_t>(dfa_size));
 
     uint32_t dfa_starting_node = 0;
     for (uint32_t node: starting_nodes) {
@@ -93,26 +107,48 @@ DFA NFA::convert2dfa() { // O(2^n * n^2)
         dfa_starting_node += (1 << node);
     }
 
-    for (uint32_t node = 0; node < dfa_size; ++node) {
-        for (uint32_t a = 0; a < alphabet_length; ++a) {
-            for (uint32_t nfa_node = 0; nfa_node < size; ++nfa_node) {
-                if (node & (1 << nfa_node)) {
-                    for (auto next_nfa_node : delta[nfa_node][a]) {dfa_delta[a][node] |= (1 << next_nfa_node);}
+    // slice_successors[(a * slices + j) * 256 + x] is the set of successors by a of states 8j + i for bits i of x
+    const uint32_t slices = (size + SLICE_BITS - 1) / SLICE_BITS;
+    std::vector<uint32_t> slice_successors((size_t)alphabet_length * slices << SLICE_BITS, 0);
+    for (uint32_t a = 0; a < alphabet_length; ++a) {
+        for (uint32_t j = 0; j < slices; ++j) {
+            uint32_t* table = &slice_successors[((size_t)a * slices + j) << SLICE_BITS];
+            for (uint32_t x = 1; x < (1u << SLICE_BITS); ++x) {
+                const uint32_t low = __builtin_ctz(x); // table[x] = table[x without lowest bit] | successors of that state
+                const uint32_t nfa_node = j * SLICE_BITS + low;
+                uint32_t successors = 0;
+                if (nfa_node < size) {
+                    for (uint32_t next_nfa_node : delta[nfa_node][a]) successors |= (1u << next_nfa_node);
                 }
+                table[x] = table[x & (x - 1)] | successors;
             }
         }
     }
 
-    std::vector<bool> dfa_v_acc(dfa_size, false);
+    uint32_t acc_mask = 0;
     for (uint32_t nfa_node = 0; nfa_node < size; ++nfa_node) {
-        if (v_acc[nfa_node]) {
-            for (uint32_t node = 0; node < dfa_size; ++node) {
-                if (node & (1 << nfa_node)) {
-                    dfa_v_acc[node] = true;
-                }
+        if (v_acc[nfa_node]) acc_mask |= (1u << nfa_node);
+    }
+
+    std::vector<char> acc_flags(dfa_size, 0); // vector<bool> can't be written from different threads
+    const uint32_t threads = threads_for(dfa_size, MIN_SUBSETS_PER_THREAD);
+    run_in_threads(threads, [&](uint32_t j) {
+        const uint32_t from = (uint32_t)((uint64_t)dfa_size * j / threads);
+        const uint32_t to = (uint32_t)((uint64_t)dfa_size * (j + 1) / threads);
+        for (uint32_t a = 0; a < alphabet_length; ++a) {
+            const uint32_t* tables = &slice_successors[(size_t)a * slices << SLICE_BITS];
+            uint32_t* row = dfa_delta[a].data();
+            for (uint32_t node = from; node < to; ++node) {
+                uint32_t successors = 0;
+                for (uint32_t i = 0; i < slices; ++i) successors |= tables[(i << SLICE_BITS) | ((node >> (i * SLICE_BITS)) & 0xFF)];
+                row[node] = successors;
             }
         }
-    }
+        for (uint32_t node = from; node < to; ++node) acc_flags[node] = ((node & acc_mask) != 0);
+    });
 
-    return DFA(alphabet_length, dfa_size, dfa_starting_node, dfa_delta, dfa_v_acc);
+    std::vector<bool> dfa_v_acc(dfa_size);
+    for (uint32_t node = 0; node < dfa_size; ++node) dfa_v_acc[node] = acc_flags[node];
+    std::vector<char>().swap(acc_flags);
+    return DFA(alphabet_length, dfa_size, dfa_starting_node, std::move(dfa_delta), std::move(dfa_v_acc));
 }
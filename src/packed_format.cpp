@@ -0,0 +1,216 @@
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include "dfa_class.h"
+#include "packed_format.h"
+#include "mapped_file.h"
+
+static const uint32_t STATES_PER_BLOCK = 1 << 16;
+
+static inline uint64_t zigzag(int64_t x) {
+    return ((uint64_t)x << 1) ^ (uint64_t)(x >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t x) {
+    return (int64_t)(x >> 1) ^ -(int64_t)(x & 1);
+}
+
+static inline void write_varint(std::vector<uint8_t>& out, uint64_t x) {
+    while (x >= 0x80) {
+        out.push_back((uint8_t)(x | 0x80));
+        x >>= 7;
+    }
+    out.push_back((uint8_t)x);
+}
+
+// returns pointer after the varint or nullptr if it is broken
+static inline const uint8_t* read_varint(const uint8_t* p, const uint8_t* end, uint64_t& x) {
+    if (p < end && *p < 0x80) { // most of tokens are one byte
+        x = *p;
+        return p + 1;
+    }
+    x = 0;
+    for (uint32_t shift = 0; shift < 64 && p < end; shift += 7) {
+        const uint8_t byte = *p++;
+        x |= (uint64_t)(byte & 0x7F) << shift;
+        if (byte < 0x80) return p;
+    }
+    return nullptr;
+}
+
+const char* parse_packed_header(const char* p, const char* end, PackedHeader& header, bool& labeled) {
+    if (end - p < (long)(sizeof(PACKED_MAGIC) + sizeof(PackedHeader))) return nullptr;
+    labeled = (memcmp(p, PACKED_LABELED_MAGIC, sizeof(PACKED_LABELED_MAGIC)) == 0);
+    if (!labeled && memcmp(p, PACKED_MAGIC, sizeof(PACKED_MAGIC)) != 0) return nullptr;
+    memcpy(&header, p + sizeof(PACKED_MAGIC), sizeof(PackedHeader));
+    if (header.size == 0 || header.alphabet_length == 0 || header.starting_node >= header.size) return nullptr;
+    if (header.sink != EMPTY_STATE && header.sink >= header.size) return nullptr;
+    if (header.states_per_block == 0) return nullptr;
+    if (header.blocks != (header.size - 1) / header.states_per_block + 1) return nullptr;
+    return p + sizeof(PACKED_MAGIC) + sizeof(PackedHeader);
+}
+
+// encodes transitions of states [from, to)
+static void encode_block(const std::vector<table_vector<uint32_t> >& delta, uint32_t sink,
+                         uint32_t from, uint32_t to, std::vector<uint8_t>& out) {
+    const uint32_t alphabet_length = (uint32_t)delta.size();
+    out.clear();
+    for (uint32_t s = from; s < to; ++s) {
+        uint32_t prev = s;
+        for (uint32_t a = 0; a < alphabet_length;) {
+            if (delta[a][s] == sink) {
+                uint32_t run = 0;
+                while (a < alphabet_length && delta[a][s] == sink) { ++run; ++a; }
+                write_varint(out, ((uint64_t)(run - 1) << 1) | 1);
+            } else {
+                write_varint(out, zigzag((int64_t)delta[a][s] - (int64_t)prev) << 1);
+                prev = delta[a][s];
+                ++a;
+            }
+        }
+    }
+}
+
+// decodes transitions of states [from, to) from [p, end); false if the data is broken
+static bool decode_block(const uint8_t* p, const uint8_t* end, const PackedHeader& header,
+                         uint32_t from, uint32_t to, std::vector<table_vector<uint32_t> >& table) {
+    for (uint32_t s = from; s < to; ++s) {
+        int64_t prev = s;
+        for (uint32_t a = 0; a < header.alphabet_length;) {
+            uint64_t token;
+            p = read_varint(p, end, token);
+            if (p == nullptr) return false;
+            if (token & 1) {
+                const uint64_t run = (token >> 1) + 1;
+                if (header.sink == EMPTY_STATE || run > header.alphabet_length - a) return false;
+                for (uint64_t i = 0; i < run; ++i) table[a++][s] = header.sink;
+            } else {
+                const int64_t target = prev + unzigzag(token >> 1);
+                if (target < 0 || target >= header.size) return false;
+                table[a++][s] = (uint32_t)target;
+                prev = target;
+            }
+        }
+    }
+    return p == end;
+}
+
+int DFA::save_to_packed_file(const char* filename, uint32_t threads) const {
+    if (threads == 0) threads = 1;
+    PackedHeader header;
+    header.size = this->size;
+    header.alphabet_length = this->alphabet_length;
+    header.starting_node = this->starting_node;
+    header.states_per_block = STATES_PER_BLOCK;
+    header.blocks = (this->size - 1) / STATES_PER_BLOCK + 1;
+
+    // the most frequent target becomes the sink
+    std::vector<uint32_t> in_degree(this->size, 0);
+    for (uint32_t a = 0; a < this->alphabet_length; ++a) {
+        for (uint32_t s = 0; s < this->size; ++s) ++in_degree[this->delta[a][s]];
+    }
+    header.sink = 0;
+    for (uint32_t s = 1; s < this->size; ++s) {
+        if (in_degree[s] > in_degree[header.sink]) header.sink = s;
+    }
+    if (in_degree[header.sink] < 2) header.sink = EMPTY_STATE; // nothing to elide
+
+    FILE* file = fopen(filename, "wb");
+    if (file == nullptr) return 1;
+    const char* magic = (this->labels.empty() ? PACKED_MAGIC : PACKED_LABELED_MAGIC);
+    bool ok = (fwrite(magic, 1, sizeof(PACKED_MAGIC), file) == sizeof(PACKED_MAGIC));
+    ok = ok && (fwrite(&header, sizeof(PackedHeader), 1, file) == 1);
+
+    // block ends are known only after encoding, so their place is filled later
+    const long block_ends_position = ftell(file);
+    std::vector<uint64_t> block_ends(header.blocks, 0);
+    ok = ok && (fwrite(block_ends.data(), sizeof(uint64_t), header.blocks, file) == header.blocks);
+
+    std::vector<uint8_t> acc_bits((this->size + 7) / 8, 0);
+    for (uint32_t s = 0; s < this->size; ++s) {
+        if (this->acc[s]) acc_bits[s / 8] |= (uint8_t)(1 << (s % 8));
+    }
+    ok = ok && (fwrite(acc_bits.data(), 1, acc_bits.size(), file) == acc_bits.size());
+    if (!this->labels.empty()) ok = ok && (fwrite(this->labels.data(), sizeof(uint32_t), this->size, file) == this->size);
+
+    // every thread encodes one block of a batch, blocks are written in order
+    std::vector<std::vector<uint8_t> > buffers(threads);
+    uint64_t written = 0;
+    for (uint32_t first = 0; ok && first < header.blocks; first += threads) {
+        const uint32_t batch = std::min(threads, header.blocks - first);
+        std::vector<std::thread> workers;
+        for (uint32_t j = 0; j < batch; ++j) {
+            workers.emplace_back([&, j]() {
+                const uint64_t from = (uint64_t)(first + j) * STATES_PER_BLOCK;
+                const uint64_t to = std::min<uint64_t>(from + STATES_PER_BLOCK, this->size);
+                encode_block(this->delta, header.sink, (uint32_t)from, (uint32_t)to, buffers[j]);
+            });
+        }
+        for (std::thread& worker : workers) worker.join();
+        for (uint32_t j = 0; ok && j < batch; ++j) {
+            ok = (fwrite(buffers[j].data(), 1, buffers[j].size(), file) == buffers[j].size());
+            written += buffers[j].size();
+            block_ends[first + j] = written;
+        }
+    }
+
+    ok = ok && (fseek(file, block_ends_position, SEEK_SET) == 0);
+    ok = ok && (fwrite(block_ends.data(), sizeof(uint64_t), header.blocks, file) == header.blocks);
+    if (fclose(file) != 0) ok = false;
+    return (ok ? 0 : 1);
+}
+
+int DFA::load_from_packed_file(const char* filename, uint32_t threads) {
+    MappedFile file(filename);
+    if (!file.ok()) return 1;
+    const char* end = file.get_data() + file.get_length();
+    PackedHeader header;
+    bool labeled;
+    const char* p = parse_packed_header(file.get_data(), end, header, labeled);
+    if (p == nullptr) return 1;
+
+    const uint64_t acc_bytes = ((uint64_t)header.size + 7) / 8;
+    const uint64_t label_bytes = (labeled ? (uint64_t)header.size * sizeof(uint32_t) : 0);
+    if ((uint64_t)(end - p) < (uint64_t)header.blocks * sizeof(uint64_t) + acc_bytes + label_bytes) return 1;
+    std::vector<uint64_t> block_ends(header.blocks);
+    memcpy(block_ends.data(), p, header.blocks * sizeof(uint64_t));
+    const uint8_t* acc_bits = (const uint8_t*)p + header.blocks * sizeof(uint64_t);
+    const uint8_t* label_data = acc_bits + acc_bytes;
+    const uint8_t* data = label_data + label_bytes;
+    const uint64_t data_length = (const uint8_t*)end - data;
+    for (uint32_t b = 0; b < header.blocks; ++b) {
+        if (block_ends[b] > data_length || (b > 0 && block_ends[b] < block_ends[b - 1])) return 1;
+    }
+    if (block_ends.back() != data_length) return 1;
+
+    // threads take blocks one by one
+    std::vector<table_vector<uint32_t> > table(header.alphabet_length, table_vector<uint32_t>(header.size));
+    std::atomic<uint32_t> next_block(0);
+    std::atomic<bool> broken(false);
+    auto decode = [&]() {
+        for (uint32_t b = next_block++; b < header.blocks && !broken; b = next_block++) {
+            const uint64_t from = (uint64_t)b * header.states_per_block;
+            const uint64_t to = std::min<uint64_t>(from + header.states_per_block, header.size);
+            const uint8_t* block_begin = data + (b == 0 ? 0 : block_ends[b - 1]);
+            if (!decode_block(block_begin, data + block_ends[b], header, (uint32_t)from, (uint32_t)to, table)) {
+                broken = true;
+            }
+        }
+    };
+    if (threads == 0) threads = 1;
+    if (threads > header.blocks) threads = header.blocks;
+    std::vector<std::thread> workers;
+    for (uint32_t j = 0; j < threads; ++j) workers.emplace_back(decode);
+    for (std::thread& worker : workers) worker.join();
+    if (broken) return 1;
+
+    std::vector<bool> v_acc(header.size);
+    for (uint32_t s = 0; s < header.size; ++s) v_acc[s] = (acc_bits[s / 8] >> (s % 8)) & 1;
+    init(header.alphabet_length, header.size, header.starting_node, std::move(table), std::move(v_acc));
+    if (labeled) {
+        std::vector<uint32_t> _labels(header.size);
+        memcpy(_labels.data(), label_data, label_bytes);
+        set_labels(std::move(_labels));
+    }
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "perf_counters.h"
+
+struct CounterKind {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+};
+
+static uint64_t cache_event(uint64_t cache, uint64_t op, uint64_t result) {
+    return cache | (op << 8) | (result << 16);
+}
+
+static const CounterKind COUNTER_KINDS[] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"L1d-misses", PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {"LLC-misses", PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {"dTLB-misses", PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS} // software event, shows the effect of huge pages
+};
+
+static int open_counter(const CounterKind& kind) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = kind.type;
+    attr.config = kind.config;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = 1; // allowed with perf_event_paranoid <= 2
+    attr.exclude_hv = 1;
+    attr.inherit = 1; // worker threads
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+PerfReport::PerfReport() {
+    for (const CounterKind& kind : COUNTER_KINDS) {
+        const int fd = open_counter(kind);
+        if (fd < 0) this->skipped.push_back(kind.name);
+        else this->counters.push_back({kind.name, fd});
+    }
+    this->start_values.assign(this->counters.size(), 0);
+}
+
+PerfReport::~PerfReport() {
+    for (const Counter& counter : this->counters) close(counter.fd);
+}
+
+void PerfReport::read_counters(std::vector<double>& values) const {
+    values.assign(this->counters.size(), 0);
+    for (size_t i = 0; i < this->counters.size(); ++i) {
+        uint64_t data[3]; // value, time enabled, time running
+        if (read(this->counters[i].fd, data, sizeof(data)) != (ssize_t)sizeof(data) || data[2] == 0) continue;
+        values[i] = (double)data[0] * ((double)data[1] / (double)data[2]);
+    }
+}
+
+void PerfReport::begin(const char* name) {
+    end();
+    int idx = -1;
+    for (size_t i = 0; i < this->phases.size(); ++i) {
+        if (this->phases[i].name == name) idx = (int)i;
+    }
+    if (idx == -1) {
+        this->phases.push_back({name, 0, 0, std::vector<double>(this->counters.size(), 0)});
+        idx = (int)this->phases.size() - 1;
+    }
+    this->current = idx;
+    this->start_time = std::chrono::steady_clock::now();
+    read_counters(this->start_values);
+}
+
+void PerfReport::end() {
+    if (this->current == -1) return;
+    std::vector<double> values;
+    read_counters(values);
+    const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - this->start_time;
+    Phase& phase = this->phases[this->current];
+    ++phase.calls;
+    phase.seconds += duration.count();
+    for (size_t i = 0; i < values.size(); ++i) phase.values[i] += values[i] - this->start_values[i];
+    this->current = -1;
+}
+
+// index of the counter or -1
+static int counter_index(const std::vector<const char*>& names, const char* name) {
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (strcmp(names[i], name) == 0) return (int)i;
+    }
+    return -1;
+}
+
+void PerfReport::print(std::ostream& out) const {
+    std::vector<const char*> names;
+    for (const Counter& counter : this->counters) names.push_back(counter.name);
+    const int cycles = counter_index(names, "cycles");
+    const int instructions = counter_index(names, "instructions");
+
+    out << std::left << std::setw(20) << "phase" << std::right << std::setw(8) << "calls" << std::setw(12) << "seconds";
+    for (const char* name : names) out << std::setw(16) << name;
+    if (cycles != -1 && instructions != -1) out << std::setw(8) << "IPC";
+    out << '\n';
+    for (const Phase& phase : this->phases) {
+        out << std::left << std::setw(20) << phase.name << std::right << std::setw(8) << phase.calls
+            << std::setw(12) << std::fixed << std::setprecision(4) << phase.seconds;
+        for (double value : phase.values) out << std::setw(16) << std::setprecision(0) << value;
+        if (cycles != -1 && instructions != -1) {
+            const double ipc = (phase.values[cycles] > 0 ? phase.values[instructions] / phase.values[cycles] : 0);
+            out << std::setw(8) << std::setprecision(2) << ipc;
+        }
+        out << '\n';
+    }
+
+    // misses per 1000 instructions
+    if (instructions != -1) {
+        for (const Phase& phase : this->phases) {
+            if (phase.values[instructions] <= 0) continue;
+            out << phase.name << ':';
+            for (size_t i = 0; i < names.size(); ++i) {
+                if (strstr(names[i], "misses") == nullptr) continue;
+                out << ' ' << names[i] << "/1000 instr = " << std::setprecision(3)
+                    << phase.values[i] * 1000 / phase.values[instructions] << ';';
+            }
+            out << '\n';
+        }
+    }
+    out << std::defaultfloat << std::setprecision(6);
+
+    if (!this->skipped.empty()) {
+        out << "not available:";
+        for (const char* name : this->skipped) out << ' ' << name;
+        out << '\n';
+    }
+}
+
+int PerfReport::save(const char* filename) const {
+    std::ofstream file(filename);
+    if (!file) return 1;
+    print(file);
+    file.close();
+    return (file ? 0 : 1);
+}
@@ -0,0 +1,177 @@
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "table_allocator.h"
+
+static const size_t HUGE_PAGE_SIZE = 2 << 20;
+static const size_t ARENA_CHUNK = 64 << 20; // chunks are only reserved, untouched pages cost nothing
+static const size_t ARENA_ALIGNMENT = 64;
+static const int MPOL_INTERLEAVE_MODE = 3; // MPOL_INTERLEAVE of <linux/mempolicy.h>
+
+static std::atomic<HugePages> huge_pages_policy(HugePages::NONE);
+static std::atomic<NumaPlacement> placement_policy(NumaPlacement::FIRST_TOUCH);
+
+// mapped tables: begin --> length (other tables are from malloc)
+static std::mutex regions_mutex;
+static std::unordered_map<void*, size_t> mapped_regions;
+
+static thread_local TableArena* current_arena = nullptr;
+
+static inline size_t round_up(size_t x, size_t to) {
+    return (x + to - 1) / to * to;
+}
+
+// bitmask of online NUMA nodes from sysfs ("0-3,5"); 0 if there is only one node or it is unknown
+static uint64_t online_nodes() {
+    static const uint64_t nodes = []() {
+        uint64_t mask = 0;
+        FILE* file = fopen("/sys/devices/system/node/online", "r");
+        if (file == nullptr) return mask;
+        unsigned first, last;
+        while (fscanf(file, "%u", &first) == 1) {
+            last = first;
+            int c = fgetc(file);
+            if (c == '-') {
+                if (fscanf(file, "%u", &last) != 1) break;
+                c = fgetc(file);
+            }
+            for (unsigned node = first; node <= last && node < 64; ++node) mask |= 1ULL << node;
+            if (c != ',') break;
+        }
+        fclose(file);
+        return (__builtin_popcountll(mask) > 1 ? mask : 0);
+    }();
+    return nodes;
+}
+
+// mmap by the current policy; length gets the mapped length; nullptr if nothing worked
+static void* map_table(size_t bytes, size_t& length) {
+    const HugePages huge_pages = huge_pages_policy.load(std::memory_order_relaxed);
+    void* p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (huge_pages == HugePages::EXPLICIT) {
+        length = round_up(bytes, HUGE_PAGE_SIZE);
+        p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+#endif
+    if (p == MAP_FAILED && huge_pages != HugePages::NONE) {
+        // 2M aligned part of a bigger mapping, so the kernel can use huge pages for all of it
+        length = round_up(bytes, HUGE_PAGE_SIZE);
+        char* raw = (char*)mmap(nullptr, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw != (char*)MAP_FAILED) {
+            char* aligned = (char*)round_up((uintptr_t)raw, HUGE_PAGE_SIZE);
+            if (aligned > raw) munmap(raw, aligned - raw);
+            if (raw + HUGE_PAGE_SIZE > aligned) munmap(aligned + length, raw + HUGE_PAGE_SIZE - aligned);
+#ifdef MADV_HUGEPAGE
+            madvise(aligned, length, MADV_HUGEPAGE); // fails if THP is off, then pages are usual
+#endif
+            p = aligned;
+        }
+    }
+    if (p == MAP_FAILED) {
+        length = round_up(bytes, (size_t)sysconf(_SC_PAGESIZE));
+        p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (p == MAP_FAILED) return nullptr;
+
+    if (placement_policy.load(std::memory_order_relaxed) == NumaPlacement::INTERLEAVE) {
+        const uint64_t nodes = online_nodes();
+        // without NUMA (or without permission) pages just stay local
+        if (nodes != 0) syscall(SYS_mbind, p, length, MPOL_INTERLEAVE_MODE, &nodes, 64, 0);
+    }
+    return p;
+}
+
+void set_table_allocation(HugePages huge_pages, NumaPlacement placement) {
+    huge_pages_policy.store(huge_pages, std::memory_order_relaxed);
+    placement_policy.store(placement, std::memory_order_relaxed);
+}
+
+void* allocate_table(size_t bytes) {
+    if (bytes == 0) bytes = 1;
+    TableArena* arena = current_arena;
+    if (arena != nullptr && !arena->is_frozen()) return arena->allocate(bytes);
+
+    const bool special = (huge_pages_policy.load(std::memory_order_relaxed) != HugePages::NONE ||
+                          placement_policy.load(std::memory_order_relaxed) != NumaPlacement::FIRST_TOUCH);
+    if (special && bytes >= LARGE_TABLE_BYTES) {
+        size_t length;
+        void* p = map_table(bytes, length);
+        if (p != nullptr) {
+            std::lock_guard<std::mutex> lock(regions_mutex);
+            mapped_regions[p] = length;
+            return p;
+        }
+    }
+    void* p = malloc(bytes);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+void deallocate_table(void* p, size_t bytes) {
+    if (p == nullptr) return;
+    TableArena* arena = current_arena;
+    if (arena != nullptr && arena->owns(p)) return; // freed with the arena
+    if (bytes >= LARGE_TABLE_BYTES) {
+        std::lock_guard<std::mutex> lock(regions_mutex);
+        auto it = mapped_regions.find(p);
+        if (it != mapped_regions.end()) {
+            munmap(p, it->second);
+            mapped_regions.erase(it);
+            return;
+        }
+    }
+    free(p);
+}
+
+void set_table_arena(TableArena* arena) {
+    current_arena = arena;
+}
+
+TableArena* get_table_arena() {
+    return current_arena;
+}
+
+TableArena::~TableArena() {
+    release();
+}
+
+void* TableArena::allocate(size_t bytes) {
+    bytes = round_up(bytes, ARENA_ALIGNMENT);
+    if (this->chunks.empty() || this->used + bytes > this->chunks.back().second) {
+        size_t length;
+        void* p = map_table(bytes > ARENA_CHUNK ? bytes : ARENA_CHUNK, length);
+        if (p == nullptr) throw std::bad_alloc();
+        this->chunks.push_back({(char*)p, length});
+        this->used = 0;
+    }
+    void* p = this->chunks.back().first + this->used;
+    this->used += bytes;
+    return p;
+}
+
+bool TableArena::owns(const void* p) const {
+    for (const std::pair<char*, size_t>& chunk : this->chunks) {
+        if ((const char*)p >= chunk.first && (const char*)p < chunk.first + chunk.second) return true;
+    }
+    return false;
+}
+
+void TableArena::release() {
+    for (const std::pair<char*, size_t>& chunk : this->chunks) munmap(chunk.first, chunk.second);
+    std::vector<std::pair<char*, size_t> >().swap(this->chunks);
+    this->used = 0;
+    this->frozen = false;
+}
+
+size_t TableArena::reserved() const {
+    size_t total = 0;
+    for (const std::pair<char*, size_t>& chunk : this->chunks) total += chunk.second;
+    return total;
+}
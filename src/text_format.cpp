@@ -0,0 +1,364 @@
+#include <thread>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "nfa_class.h"
+#include "text_format.h"
+#include "mapped_file.h"
+
+static inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// reads decimal number; returns pointer after it or nullptr if there is no number or it is >= 2^32
+static inline const char* parse_number(const char* p, const char* end, uint32_t& value) {
+    size_t digits = 0;
+#ifdef __SSE2__
+    if (end - p >= 16) { // find the length of the digit run with one comparison of 16 bytes
+        const __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+        const __m128i not_less = _mm_cmpgt_epi8(chunk, _mm_set1_epi8('0' - 1));
+        const __m128i not_greater = _mm_cmplt_epi8(chunk, _mm_set1_epi8('9' + 1));
+        const uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(not_less, not_greater));
+        digits = __builtin_ctz(~mask); // ~mask has bits 16..31 set, so digits <= 16
+    } else
+#endif
+    {
+        while (p + digits < end && '0' <= p[digits] && p[digits] <= '9') ++digits;
+    }
+    if (digits == 0 || digits > 10) return nullptr;
+
+    uint64_t x = 0;
+    for (size_t i = 0; i < digits; ++i) x = x * 10 + (uint64_t)(p[i] - '0');
+    if (x > UINT32_MAX) return nullptr;
+    value = (uint32_t)x;
+    return p + digits;
+}
+
+static inline const char* skip_spaces(const char* p, const char* end) {
+    while (p < end && is_space(*p)) ++p;
+    return p;
+}
+
+static inline const char* next_line(const char* p, const char* end) {
+    const void* newline = memchr(p, '\n', end - p);
+    return (newline == nullptr ? end : (const char*)newline + 1);
+}
+
+// after the last number of a line only spaces are allowed
+static inline bool is_end_of_line(const char* p, const char* end) {
+    p = skip_spaces(p, end);
+    return p == end || *p == '\n';
+}
+
+const char* parse_text_line(const char* p, const char* end, TextLine& kind, uint32_t& x, uint32_t& y, uint32_t& z) {
+    const char* line_end = next_line(p, end);
+    p = skip_spaces(p, end);
+    if (p == end || *p == '\n' || *p == '#') {
+        kind = TextLine::EMPTY;
+        return line_end;
+    }
+
+    if (*p == 'a' || *p == 'i') {
+        kind = (*p == 'a' ? TextLine::ACC : TextLine::INITIAL);
+        p = skip_spaces(p + 1, end);
+        p = parse_number(p, end, x);
+        if (p == nullptr || !is_end_of_line(p, end)) kind = TextLine::ERROR;
+        return line_end;
+    }
+
+    if (*p == 'l') {
+        kind = TextLine::LABEL;
+        p = parse_number(skip_spaces(p + 1, end), end, x);
+        if (p != nullptr) p = parse_number(skip_spaces(p, end), end, y);
+        if (p == nullptr || !is_end_of_line(p, end)) kind = TextLine::ERROR;
+        return line_end;
+    }
+
+    kind = TextLine::TRANSITION;
+    p = parse_number(p, end, x);
+    if (p != nullptr) p = parse_number(skip_spaces(p, end), end, y);
+    if (p != nullptr) p = parse_number(skip_spaces(p, end), end, z);
+    if (p == nullptr || !is_end_of_line(p, end)) kind = TextLine::ERROR;
+    return line_end;
+}
+
+const char* parse_text_header(const char* p, const char* end, bool& is_dfa, uint32_t& size, uint32_t& alphabet_length, uint32_t& starting_node) {
+    while (p < end) { // comments before the header
+        const char* q = skip_spaces(p, end);
+        if (q < end && *q != '\n' && *q != '#') break;
+        p = next_line(p, end);
+    }
+    p = skip_spaces(p, end);
+    if (end - p < 3 || (strncmp(p, "dfa", 3) != 0 && strncmp(p, "nfa", 3) != 0)) return nullptr;
+    is_dfa = (*p == 'd');
+    p = parse_number(skip_spaces(p + 3, end), end, size);
+    if (p != nullptr) p = parse_number(skip_spaces(p, end), end, alphabet_length);
+    starting_node = 0;
+    if (p != nullptr && is_dfa) p = parse_number(skip_spaces(p, end), end, starting_node);
+    if (p == nullptr || !is_end_of_line(p, end)) return nullptr;
+    if (size == 0 || alphabet_length == 0 || (is_dfa && starting_node >= size)) return nullptr;
+    return next_line(p, end);
+}
+
+char* write_number(char* buffer, uint32_t x) {
+    char digits[10];
+    int len = 0;
+    do {
+        digits[len++] = (char)('0' + x % 10);
+        x /= 10;
+    } while (x != 0);
+    while (len > 0) *buffer++ = digits[--len];
+    return buffer;
+}
+
+
+// splits [begin, end) into `threads` chunks at line borders
+static std::vector<const char*> split_in_chunks(const char* begin, const char* end, uint32_t& threads) {
+    const size_t MIN_CHUNK = 1 << 20;
+    const size_t length = end - begin;
+    if (threads == 0) threads = 1;
+    if (length / MIN_CHUNK < threads) threads = (uint32_t)(length / MIN_CHUNK) + 1;
+
+    std::vector<const char*> bounds(threads + 1);
+    bounds[0] = begin;
+    bounds[threads] = end;
+    for (uint32_t j = 1; j < threads; ++j) {
+        const char* b = begin + (length / threads) * j;
+        if (b < bounds[j - 1]) b = bounds[j - 1];
+        if (b > begin && b < end && *(b - 1) != '\n') b = next_line(b, end);
+        bounds[j] = b;
+    }
+    return bounds;
+}
+
+int DFA::load_from_text_file(const char* filename, uint32_t threads) {
+    MappedFile file(filename);
+    if (!file.ok() || file.get_length() == 0) return 1;
+    const char* end = file.get_data() + file.get_length();
+
+    bool is_dfa;
+    uint32_t _size, _alphabet_length, _starting_node;
+    const char* body = parse_text_header(file.get_data(), end, is_dfa, _size, _alphabet_length, _starting_node);
+    if (body == nullptr || !is_dfa) return 1;
+
+    // table is filled directly by the threads, EMPTY_STATE marks transitions which are not read yet;
+    // cells (and labels) are claimed by compare-exchange, so a repeated line in two chunks isn't a race, it is an error
+    std::vector<table_vector<uint32_t> > table(_alphabet_length, table_vector<uint32_t>(_size, EMPTY_STATE));
+    std::vector<char> acc_flags(_size, 0); // vector<bool> can't be written from different threads
+    std::vector<uint32_t> label_values(_size, EMPTY_STATE); // EMPTY_STATE: no "l" line
+    std::vector<const char*> bounds = split_in_chunks(body, end, threads);
+    std::vector<char> errors(threads, 0);
+    std::vector<char> labeled(threads, 0);
+
+    // stores value if the cell is still EMPTY_STATE; false if it was already set (by any thread)
+    auto claim = [](uint32_t& cell, uint32_t value) {
+        uint32_t expected = EMPTY_STATE;
+        return __atomic_compare_exchange_n(&cell, &expected, value, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    };
+    auto parse_chunk = [&](uint32_t j) {
+        const char* p = bounds[j];
+        TextLine kind;
+        uint32_t x, y, z;
+        while (p < bounds[j + 1]) {
+            p = parse_text_line(p, bounds[j + 1], kind, x, y, z);
+            if (kind == TextLine::TRANSITION && x < _size && y < _alphabet_length && z < _size) {
+                if (!claim(table[y][x], z)) { // repeated transition
+                    errors[j] = 1;
+                    return;
+                }
+            } else if (kind == TextLine::ACC && x < _size) {
+                __atomic_store_n(&acc_flags[x], 1, __ATOMIC_RELAXED); // repeated "a" lines are allowed
+            } else if (kind == TextLine::LABEL && x < _size && y != EMPTY_STATE) {
+                if (!claim(label_values[x], y)) { // repeated label, even with the same value
+                    errors[j] = 1;
+                    return;
+                }
+                labeled[j] = 1;
+            } else if (kind != TextLine::EMPTY) {
+                errors[j] = 1;
+                return;
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (uint32_t j = 0; j < threads; ++j) workers.emplace_back(parse_chunk, j);
+    for (std::thread& worker : workers) worker.join();
+
+    bool has_labels = false;
+    for (uint32_t j = 0; j < threads; ++j) {
+        if (errors[j]) return 1;
+        if (labeled[j]) has_labels = true;
+    }
+    // duplicates are already rejected, so all transitions are given iff none of them is missing
+    for (uint32_t a = 0; a < _alphabet_length; ++a) {
+        for (uint32_t s = 0; s < _size; ++s) {
+            if (table[a][s] == EMPTY_STATE) return 1;
+        }
+    }
+
+    std::vector<bool> v_acc(_size);
+    for (uint32_t s = 0; s < _size; ++s) v_acc[s] = acc_flags[s];
+    init(_alphabet_length, _size, _starting_node, std::move(table), std::move(v_acc));
+    if (has_labels) {
+        for (uint32_t s = 0; s < _size; ++s) {
+            if (label_values[s] == EMPTY_STATE) label_values[s] = acc_flags[s];
+        }
+        set_labels(std::move(label_values));
+    }
+    return 0;
+}
+
+// formats lines of states [from, to) with `format_state`, threads format blocks of states in parallel,
+// blocks are written in order, so the whole text is never kept in RAM
+template <typename F>
+static bool write_states_in_parallel(FILE* file, uint32_t size, uint32_t threads, size_t max_state_length, F format_state) {
+    const uint32_t STATES_PER_BLOCK = 1 << 14;
+    if (threads == 0) threads = 1;
+    std::vector<std::vector<char> > buffers(threads);
+    std::vector<size_t> lengths(threads);
+    for (uint64_t first = 0; first < size; first += (uint64_t)STATES_PER_BLOCK * threads) {
+        std::vector<std::thread> workers;
+        for (uint32_t j = 0; j < threads; ++j) {
+            workers.emplace_back([&, j]() {
+                const uint64_t from = first + (uint64_t)j * STATES_PER_BLOCK;
+                const uint64_t to = std::min<uint64_t>(from + STATES_PER_BLOCK, size);
+                lengths[j] = 0;
+                if (from >= to) return;
+                buffers[j].resize((to - from) * max_state_length);
+                char* p = buffers[j].data();
+                for (uint64_t s = from; s < to; ++s) p = format_state((uint32_t)s, p);
+                lengths[j] = p - buffers[j].data();
+            });
+        }
+        for (std::thread& worker : workers) worker.join();
+        for (uint32_t j = 0; j < threads; ++j) {
+            if (lengths[j] && fwrite(buffers[j].data(), 1, lengths[j], file) != lengths[j]) return false;
+        }
+    }
+    return true;
+}
+
+int DFA::save_to_text_file(const char* filename, uint32_t threads) const {
+    FILE* file = fopen(filename, "w");
+    if (file == nullptr) return 1;
+    fprintf(file, "dfa %u %u %u\n", this->size, this->alphabet_length, this->starting_node);
+
+    // each state gives "a s\n" (or "l s label\n") and alphabet_length lines "s a t\n"
+    const size_t max_state_length = 24 + (size_t)this->alphabet_length * 33;
+    bool ok = write_states_in_parallel(file, this->size, threads, max_state_length, [this](uint32_t s, char* p) {
+        if (!this->labels.empty()) {
+            if (this->labels[s] != 0) {
+                *p++ = 'l'; *p++ = ' ';
+                p = write_number(p, s); *p++ = ' ';
+                p = write_number(p, this->labels[s]); *p++ = '\n';
+            }
+        } else if (this->acc[s]) {
+            *p++ = 'a'; *p++ = ' ';
+            p = write_number(p, s);
+            *p++ = '\n';
+        }
+        for (uint32_t a = 0; a < this->alphabet_length; ++a) {
+            p = write_number(p, s); *p++ = ' ';
+            p = write_number(p, a); *p++ = ' ';
+            p = write_number(p, this->delta[a][s]); *p++ = '\n';
+        }
+        return p;
+    });
+    if (fclose(file) != 0) ok = false;
+    return (ok ? 0 : 1);
+}
+
+int NFA::load_from_text_file(const char* filename, uint32_t threads) {
+    MappedFile file(filename);
+    if (!file.ok() || file.get_length() == 0) return 1;
+    const char* end = file.get_data() + file.get_length();
+
+    bool is_dfa;
+    uint32_t _size, _alphabet_length, _unused;
+    const char* body = parse_text_header(file.get_data(), end, is_dfa, _size, _alphabet_length, _unused);
+    if (body == nullptr || is_dfa) return 1;
+
+    // threads collect edges in flat arrays, then they are put in delta
+    struct Edge { uint32_t from, symbol, to; };
+    std::vector<const char*> bounds = split_in_chunks(body, end, threads);
+    std::vector<std::vector<Edge> > edges(threads);
+    std::vector<std::vector<uint32_t> > initial(threads), accepting(threads);
+    std::vector<char> errors(threads, 0);
+
+    auto parse_chunk = [&](uint32_t j) {
+        const char* p = bounds[j];
+        TextLine kind;
+        uint32_t x, y, z;
+        while (p < bounds[j + 1]) {
+            p = parse_text_line(p, bounds[j + 1], kind, x, y, z);
+            if (kind == TextLine::TRANSITION && x < _size && y < _alphabet_length && z < _size) {
+                edges[j].push_back({x, y, z});
+            } else if (kind == TextLine::ACC && x < _size) {
+                accepting[j].push_back(x);
+            } else if (kind == TextLine::INITIAL && x < _size) {
+                initial[j].push_back(x);
+            } else if (kind != TextLine::EMPTY) {
+                errors[j] = 1;
+                return;
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (uint32_t j = 0; j < threads; ++j) workers.emplace_back(parse_chunk, j);
+    for (std::thread& worker : workers) worker.join();
+
+    std::vector<std::vector<std::vector<uint32_t> > > _delta(_size, std::vector<std::vector<uint32_t> >(_alphabet_length));
+    std::vector<bool> _v_acc(_size, false);
+    std::vector<bool> is_initial(_size, false);
+    std::vector<uint32_t> _starting_nodes;
+    for (uint32_t j = 0; j < threads; ++j) {
+        if (errors[j]) return 1;
+        for (const Edge& e : edges[j]) _delta[e.from][e.symbol].push_back(e.to);
+        for (uint32_t s : accepting[j]) _v_acc[s] = true;
+        for (uint32_t s : initial[j]) {
+            if (!is_initial[s]) _starting_nodes.push_back(s);
+            is_initial[s] = true;
+        }
+    }
+    if (_starting_nodes.empty()) _starting_nodes.push_back(0); // like in nfa strings: 0 is initial by default
+
+    init(_alphabet_length, _size, std::move(_delta), std::move(_starting_nodes), std::move(_v_acc));
+    return 0;
+}
+
+int NFA::save_to_text_file(const char* filename) const {
+    FILE* file = fopen(filename, "w");
+    if (file == nullptr) return 1;
+    fprintf(file, "nfa %u %u\n", this->size, this->alphabet_length);
+    for (uint32_t s : this->starting_nodes) fprintf(file, "i %u\n", s);
+
+    std::vector<char> buffer(1 << 16);
+    char* p = buffer.data();
+    bool ok = true;
+    for (uint32_t s = 0; s < this->size && ok; ++s) {
+        if (this->v_acc[s]) {
+            *p++ = 'a'; *p++ = ' ';
+            p = write_number(p, s);
+            *p++ = '\n';
+        }
+        for (uint32_t a = 0; a < this->alphabet_length; ++a) {
+            for (uint32_t t : this->delta[s][a]) {
+                if (buffer.data() + buffer.size() - p < 34) { // no space for one more line
+                    ok = (fwrite(buffer.data(), 1, p - buffer.data(), file) == (size_t)(p - buffer.data()));
+                    p = buffer.data();
+                }
+                p = write_number(p, s); *p++ = ' ';
+                p = write_number(p, a); *p++ = ' ';
+                p = write_number(p, t); *p++ = '\n';
+            }
+        }
+        if (buffer.data() + buffer.size() - p < 34) {
+            ok = ok && (fwrite(buffer.data(), 1, p - buffer.data(), file) == (size_t)(p - buffer.data()));
+            p = buffer.data();
+        }
+    }
+    if (ok && p != buffer.data()) ok = (fwrite(buffer.data(), 1, p - buffer.data(), file) == (size_t)(p - buffer.data()));
+    if (fclose(file) != 0) ok = false;
+    return (ok ? 0 : 1);
+}
@@ -1,14 +1,856 @@
+#include <algorithm>
 #include <iostream>
+#include <map>
+#include <set>
+#include <random>
 #include <string>
 #include <string.h>
+#include <thread>
 #include <vector>
 #include <chrono>
+#include <unistd.h>
 #include "dfa_class.h"
 #include "nfa_class.h"
+#include "dictionary_builder.h"
+#include "lazy_matcher.h"
+#include "compiled_dfa.h"
+#include "dfa_server.h"
+
+// Without arguments: self-checks on random automata, new algorithms are compared with plain Hopcroft's
+// algorithm (or with a simple reference). Returns 1 if some check failed.
+// With 4 arguments: two DFAs are minimized and compared (like the 1st and 2nd arguments of minimizer).
+
+static std::mt19937 rng(12345);
+static uint32_t failures = 0;
+
+static void expect(bool condition, const std::string& what) {
+    if (!condition) {
+        ++failures;
+        std::cout << "FAILED: " << what << '\n';
+    }
+}
+
+static uint32_t random_below(uint32_t n) {
+    return (uint32_t)(rng() % n);
+}
+
+// DFA with labels of states (boolean DFA without set_labels if labels == 2)
+static DFA make_dfa(uint32_t k, uint32_t start, std::vector<std::vector<uint32_t> >& delta, std::vector<uint32_t>& state_labels, uint32_t labels) {
+    const uint32_t n = (uint32_t)state_labels.size();
+    if (labels > 2) return DFA(k, n, start, delta, state_labels);
+    std::vector<bool> acc(n);
+    for (uint32_t s = 0; s < n; ++s) acc[s] = (state_labels[s] != 0);
+    return DFA(k, n, start, delta, acc);
+}
+
+// DFA with random transitions and labels 0, ..., labels - 1
+static DFA random_dfa(uint32_t n, uint32_t k, uint32_t labels = 2) {
+    std::vector<std::vector<uint32_t> > delta(k, std::vector<uint32_t>(n));
+    for (uint32_t a = 0; a < k; ++a) {
+        for (uint32_t s = 0; s < n; ++s) delta[a][s] = random_below(n);
+    }
+    std::vector<uint32_t> state_labels(n);
+    for (uint32_t s = 0; s < n; ++s) state_labels[s] = random_below(labels);
+    return make_dfa(k, random_below(n), delta, state_labels, labels);
+}
+
+static std::vector<uint32_t> random_word(uint32_t k, uint32_t max_length) {
+    std::vector<uint32_t> word(random_below(max_length + 1));
+    for (uint32_t& x : word) x = random_below(k);
+    return word;
+}
+
+static NFA random_nfa(uint32_t n, uint32_t k) {
+    std::vector<std::vector<std::vector<uint32_t> > > delta(n, std::vector<std::vector<uint32_t> >(k));
+    for (uint32_t s = 0; s < n; ++s) {
+        for (uint32_t a = 0; a < k; ++a) {
+            for (uint32_t t = 0; t < n; ++t) {
+                if (random_below(3) == 0) delta[s][a].push_back(t);
+            }
+        }
+    }
+    std::vector<uint32_t> starting_nodes = {0};
+    if (n > 1 && random_below(2) == 0) starting_nodes.push_back(1);
+    std::vector<bool> acc(n);
+    for (uint32_t s = 0; s < n; ++s) acc[s] = (random_below(2) == 0);
+    return NFA(k, n, delta, starting_nodes, acc);
+}
+
+// length of the shortest word accepted by DFA (UINT32_MAX if there is no such word)
+static uint32_t shortest_accepted(const DFA& dfa) {
+    std::vector<uint32_t> distance(dfa.get_size(), UINT32_MAX);
+    std::vector<uint32_t> queue = {dfa.get_starting_node()};
+    distance[dfa.get_starting_node()] = 0;
+    for (size_t i = 0; i < queue.size(); ++i) {
+        const uint32_t s = queue[i];
+        if (dfa.is_accepting(s)) return distance[s];
+        for (uint32_t a = 0; a < dfa.get_alphabet_length(); ++a) {
+            const uint32_t t = dfa.get_transition(a, s);
+            if (distance[t] == UINT32_MAX) {
+                distance[t] = distance[s] + 1;
+                queue.push_back(t);
+            }
+        }
+    }
+    return UINT32_MAX;
+}
+
+// Hopcroft's algorithm without fast paths and pre-partition
+static DFA plain_minimized(DFA dfa) {
+    dfa.set_acyclic_fast_path(false);
+    dfa.set_unary_fast_path(false);
+    dfa.set_prepartition(0);
+    dfa.minimization(false);
+    return dfa;
+}
+
+// states which are reachable from the starting node
+static std::vector<char> reachable_states(const DFA& dfa) {
+    std::vector<char> reachable(dfa.get_size(), 0);
+    std::vector<uint32_t> queue = {dfa.get_starting_node()};
+    reachable[dfa.get_starting_node()] = 1;
+    for (size_t i = 0; i < queue.size(); ++i) {
+        for (uint32_t a = 0; a < dfa.get_alphabet_length(); ++a) {
+            const uint32_t t = dfa.get_transition(a, queue[i]);
+            if (!reachable[t]) {
+                reachable[t] = 1;
+                queue.push_back(t);
+            }
+        }
+    }
+    return reachable;
+}
+
+// number of states of the minimal DFA by Moore's algorithm (reachable states, blocks start from labels)
+static uint32_t moore_size(const DFA& dfa) {
+    std::vector<char> reachable = reachable_states(dfa);
+    std::vector<uint32_t> block(dfa.get_size());
+    for (uint32_t s = 0; s < dfa.get_size(); ++s) block[s] = dfa.get_label(s);
+    uint32_t blocks = 0;
+    while (true) {
+        std::map<std::vector<uint32_t>, uint32_t> signatures;
+        std::vector<uint32_t> new_block(dfa.get_size());
+        for (uint32_t s = 0; s < dfa.get_size(); ++s) {
+            if (!reachable[s]) continue;
+            std::vector<uint32_t> signature = {block[s]};
+            for (uint32_t a = 0; a < dfa.get_alphabet_length(); ++a) signature.push_back(block[dfa.get_transition(a, s)]);
+            new_block[s] = signatures.insert(std::make_pair(signature, (uint32_t)signatures.size())).first->second;
+        }
+        block.swap(new_block);
+        if (signatures.size() == blocks) return blocks;
+        blocks = (uint32_t)signatures.size();
+    }
+}
+
+// the same tables (not only the same language)
+static bool same_tables(const DFA& x, const DFA& y) {
+    if (x.get_size() != y.get_size() || x.get_alphabet_length() != y.get_alphabet_length() ||
+        x.get_starting_node() != y.get_starting_node() || x.has_labels() != y.has_labels()) return false;
+    for (uint32_t s = 0; s < x.get_size(); ++s) {
+        if (x.get_label(s) != y.get_label(s)) return false;
+        for (uint32_t a = 0; a < x.get_alphabet_length(); ++a) {
+            if (x.get_transition(a, s) != y.get_transition(a, s)) return false;
+        }
+    }
+    return true;
+}
+
+static void write_file(const std::string& path, const std::string& data) {
+    FILE* file = fopen(path.c_str(), "wb");
+    fwrite(data.data(), 1, data.size(), file);
+    fclose(file);
+}
+
+static std::string read_file(const std::string& path) {
+    std::string data;
+    FILE* file = fopen(path.c_str(), "rb");
+    char buffer[1 << 12];
+    size_t got;
+    while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0) data.append(buffer, got);
+    fclose(file);
+    return data;
+}
+
+static std::string temp_path(const char* name) {
+    return "/tmp/minimizer_test_" + std::to_string(getpid()) + "_" + name;
+}
+
+static void check_external_minimization() {
+    std::string path = temp_path("external.bin"), out_path = temp_path("quotient.bin");
+    for (uint32_t it = 0; it < 20; ++it) {
+        DFA dfa = random_dfa(1 + random_below(3000), 1 + random_below(4));
+        dfa.save_to_file(&path[0]);
+        DFA quotient((char*)"", (char*)"");
+        if (it % 2 == 0) {
+            // a small budget makes many runs, so they are merged in several levels; the quotient goes to the file
+            expect(external_minimization_to_file(&path[0], 4096, false, &out_path[0]) == 0, "external minimization to file succeeds");
+            expect(quotient.load_from_bin_file(out_path.c_str()) == 0, "quotient DFA is saved correctly");
+        } else {
+            expect(external_minimization(&path[0], 1 << 20, false, quotient) == 0, "external minimization succeeds");
+        }
+        quotient.minimization(false);
+        expect(quotient == plain_minimized(dfa), "external minimization gives the same DFA as Hopcroft");
+    }
+
+    // almost all states of a random DFA are different, so the quotient doesn't fit in 4K and isn't built in RAM
+    random_dfa(1000, 2).save_to_file(&path[0]);
+    DFA big_quotient((char*)"", (char*)"");
+    expect(external_minimization(&path[0], 4096, false, big_quotient) != 0, "quotient bigger than the memory limit is refused");
+    unlink(out_path.c_str());
+
+    FILE* file = fopen(path.c_str(), "wb");
+    const uint32_t header[3] = {100, 2, 0}; // no table after the header
+    fwrite(header, sizeof(header), 1, file);
+    fclose(file);
+    DFA quotient((char*)"", (char*)"");
+    expect(external_minimization(&path[0], 4096, false, quotient) != 0, "external minimization rejects a truncated file");
+    unlink(path.c_str());
+}
+
+static void check_products() {
+    for (uint32_t it = 0; it < 50; ++it) {
+        const uint32_t k = 1 + random_below(3);
+        DFA first = random_dfa(1 + random_below(30), k), second = random_dfa(1 + random_below(30), k);
+        DFA intersection = first.intersect(second), union_dfa = first.unite(second), difference = first.difference(second);
+        for (uint32_t w = 0; w < 50; ++w) {
+            std::vector<uint32_t> word = random_word(k, 20);
+            const bool x = first.check_string(word), y = second.check_string(word);
+            expect(intersection.check_string(word) == (x && y), "intersection accepts words of both DFAs");
+            expect(union_dfa.check_string(word) == (x || y), "union accepts words of one of DFAs");
+            expect(difference.check_string(word) == (x && !y), "difference accepts words of the first DFA only");
+        }
+        // L1 = (L1 - L2) + (L1 & L2)
+        DFA parts = difference.unite(intersection);
+        parts.minimization(false);
+        first.minimization(false);
+        expect(parts == first, "difference and intersection make the first DFA");
+    }
+}
+
+static void check_inclusion() {
+    for (uint32_t it = 0; it < 500; ++it) {
+        const uint32_t k = 1 + random_below(2);
+        NFA first = random_nfa(1 + random_below(5), k), second = random_nfa(1 + random_below(6), k);
+        DFA first_dfa = first.convert2dfa(), second_dfa = second.convert2dfa();
+        const DFA difference = first_dfa.difference(second_dfa);
+
+        language_check inclusion = first.is_included_in(second);
+        const uint32_t shortest = shortest_accepted(difference);
+        expect(inclusion.holds == (shortest == UINT32_MAX), "verdict of inclusion");
+        if (!inclusion.holds) {
+            expect(first_dfa.check_string(inclusion.counterexample) && !second_dfa.check_string(inclusion.counterexample),
+                   "counterexample of inclusion is in the first language only");
+            expect(inclusion.counterexample.size() == shortest, "counterexample of inclusion is one of the shortest");
+        }
+
+        language_check universality = second.is_universal();
+        std::vector<bool> all(1, true);
+        std::vector<std::vector<uint32_t> > loops(k, std::vector<uint32_t>(1, 0));
+        const uint32_t shortest_rejected = shortest_accepted(DFA(k, 1, 0, loops, all).difference(second_dfa));
+        expect(universality.holds == (shortest_rejected == UINT32_MAX), "verdict of universality");
+        if (!universality.holds) {
+            expect(!second_dfa.check_string(universality.counterexample), "counterexample of universality is rejected");
+            expect(universality.counterexample.size() == shortest_rejected, "counterexample of universality is one of the shortest");
+        }
+    }
+}
+
+static void check_text_format() {
+    const std::string path = temp_path("dfa.txt");
+    for (uint32_t it = 0; it < 20; ++it) {
+        DFA dfa = random_dfa(1 + random_below(5000), 1 + random_below(5), (it % 2 == 0 ? 2 : 4));
+        DFA loaded((char*)"", (char*)"");
+        expect(dfa.save_to_text_file(path.c_str(), 1 + it % 4) == 0, "DFA is written in text format");
+        expect(loaded.load_from_text_file(path.c_str(), 1 + it % 3) == 0, "DFA is read from text format");
+        expect(same_tables(dfa, loaded), "text format keeps the tables");
+    }
+    for (uint32_t it = 0; it < 10; ++it) {
+        NFA nfa = random_nfa(1 + random_below(6), 1 + random_below(3)), loaded;
+        expect(nfa.save_to_text_file(path.c_str()) == 0 && loaded.load_from_text_file(path.c_str(), 2) == 0, "NFA is written and read in text format");
+        DFA x = nfa.convert2dfa(), y = loaded.convert2dfa();
+        x.minimization(false);
+        y.minimization(false);
+        expect(x == y, "text format keeps the language of NFA");
+    }
+
+    const char* malformed[] = {
+        "dfa 2 2 0\n0 0 1\n0 1 1\nbogus\n", // garbage line
+        "dfa 2 2 0\n0 0 1\n0 1 1\n1 0 0\n", // missing transition
+        "dfa 2 2 0\n0 0 1\n0 1 1\n1 0 0\n1 1 5\n", // target out of range
+        "dfa 2 2 0\n0 0 1\n0 0 1\n0 1 1\n1 0 0\n1 1 1\n", // repeated transition
+        "dfa 2 1 0\nl 0 3\n0 0 1\n1 0 0\nl 0 3\n", // repeated label
+        "dfa 2 1 0\nl 1 3\n0 0 1\n1 0 0\nl 1 4\n", // two labels of one state
+        "dfa 2 2\n", // short header
+        "" // empty file
+    };
+    for (const char* text : malformed) {
+        write_file(path, text);
+        DFA loaded((char*)"", (char*)"");
+        expect(loaded.load_from_text_file(path.c_str(), 2) != 0, std::string("malformed text is rejected: ") + text);
+        expect(loaded.get_size() == 1, "rejected text doesn't change DFA");
+    }
+
+    // a transition or a label repeated far from the first one is parsed by another thread
+    DFA big = random_dfa(300000, 2, 3);
+    big.save_to_text_file(path.c_str(), 4);
+    const std::string text = read_file(path);
+    for (const char* prefix : {"\n1 ", "\nl "}) {
+        const size_t begin = text.find(prefix) + 1;
+        write_file(path, text + text.substr(begin, text.find('\n', begin) + 1 - begin));
+        DFA loaded((char*)"", (char*)"");
+        expect(loaded.load_from_text_file(path.c_str(), 4) != 0, std::string("line repeated in another chunk is rejected: ") + prefix);
+    }
+    unlink(path.c_str());
+}
+
+static void check_packed_format() {
+    const std::string path = temp_path("dfa.dfz");
+    for (uint32_t it = 0; it < 20; ++it) {
+        const uint32_t n = 1 + random_below(20000), k = 1 + random_below(6);
+        DFA dfa = random_dfa(n, k, (it % 3 == 0 ? 5 : 2));
+        if (it % 2 == 0) { // most transitions go to a sink, so runs are used
+            std::vector<std::vector<uint32_t> > delta(k, std::vector<uint32_t>(n));
+            std::vector<bool> acc(n);
+            for (uint32_t s = 0; s < n; ++s) {
+                acc[s] = dfa.is_accepting(s);
+                for (uint32_t a = 0; a < k; ++a) delta[a][s] = (random_below(4) == 0 ? dfa.get_transition(a, s) : 0);
+            }
+            dfa = DFA(k, n, 0, delta, acc);
+        }
+        DFA loaded((char*)"", (char*)"");
+        expect(dfa.save_to_packed_file(path.c_str(), 1 + it % 4) == 0, "DFA is written in packed format");
+        expect(loaded.load_from_packed_file(path.c_str(), 1 + it % 3) == 0, "DFA is read from packed format");
+        expect(same_tables(dfa, loaded), "packed format keeps the tables");
+    }
+
+    DFA dfa = random_dfa(3000, 3);
+    dfa.save_to_packed_file(path.c_str(), 2);
+    const std::string data = read_file(path);
+    std::vector<std::string> malformed = {data + '\0', "DFAX" + data.substr(4), ""};
+    for (uint32_t i = 0; i < 20; ++i) malformed.push_back(data.substr(0, random_below((uint32_t)data.size())));
+    for (const std::string& bad : malformed) {
+        write_file(path, bad);
+        DFA loaded((char*)"", (char*)"");
+        expect(loaded.load_from_packed_file(path.c_str(), 2) != 0, "malformed packed file of " + std::to_string(bad.size()) + " bytes is rejected");
+        expect(loaded.get_size() == 1, "rejected packed file doesn't change DFA");
+    }
+    unlink(path.c_str());
+}
+
+static void check_trimming() {
+    for (uint32_t it = 0; it < 10; ++it) {
+        // live states [0, n / 3) go to live or dead ones, dead states [n / 3, 2n / 3) only to dead ones,
+        // states [2n / 3, n) are unreachable
+        const uint32_t n = 3 * (2000 + random_below(4000)), k = 1 + random_below(3);
+        std::vector<std::vector<uint32_t> > delta(k, std::vector<uint32_t>(n));
+        std::vector<bool> acc(n, false);
+        for (uint32_t s = 0; s < n; ++s) {
+            for (uint32_t a = 0; a < k; ++a) {
+                if (s < n / 3) delta[a][s] = random_below(random_below(4) == 0 ? 2 * n / 3 : n / 3);
+                else if (s < 2 * n / 3) delta[a][s] = n / 3 + random_below(n / 3);
+                else delta[a][s] = random_below(n);
+            }
+            acc[s] = (s < n / 3 || s >= 2 * n / 3) && random_below(3) == 0;
+        }
+        DFA dfa(k, n, 0, delta, acc);
+
+        // expected size: reachable states which reach acc states, and one sink for the others
+        std::vector<char> reachable = reachable_states(dfa);
+        std::vector<char> alive(n, 0);
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (uint32_t s = 0; s < n; ++s) {
+                if (alive[s]) continue;
+                bool reaches = dfa.is_accepting(s);
+                for (uint32_t a = 0; a < k && !reaches; ++a) reaches = alive[dfa.get_transition(a, s)];
+                if (reaches) alive[s] = changed = 1;
+            }
+        }
+        uint32_t expected = 0;
+        bool has_dead = false;
+        for (uint32_t s = 0; s < n; ++s) {
+            if (reachable[s] && alive[s]) ++expected;
+            if (reachable[s] && !alive[s]) has_dead = true;
+        }
+        if (has_dead) ++expected;
+
+        DFA trimmed = dfa;
+        trimmed.trim_states(4);
+        expect(trimmed.get_size() == expected, "trimming keeps reachable live states and one sink");
+        for (uint32_t w = 0; w < 100; ++w) {
+            std::vector<uint32_t> word = random_word(k, 30);
+            expect(trimmed.check_string(word) == dfa.check_string(word), "trimming keeps the language");
+        }
+        trimmed.minimization(false);
+        expect(trimmed == plain_minimized(dfa), "trimmed DFA minimizes to the same DFA");
+    }
+}
+
+static void check_labels() {
+    for (uint32_t it = 0; it < 50; ++it) {
+        const uint32_t k = 1 + random_below(3);
+        DFA dfa = random_dfa(1 + random_below(300), k, 3 + random_below(4));
+        DFA minimized = dfa;
+        minimized.minimization(false);
+        expect(minimized.get_size() == moore_size(dfa), "labeled DFA has as many states as Moore's algorithm gives");
+        expect(minimized.has_labels(), "minimized DFA keeps labels");
+        for (uint32_t w = 0; w < 50; ++w) {
+            std::vector<uint32_t> word = random_word(k, 20);
+            expect(minimized.classify_string(word) == dfa.classify_string(word), "minimization keeps labels of words");
+        }
+    }
+}
+
+static void check_refinement_policies() {
+    const RefinementMode modes[] = {RefinementMode::SYMBOL, RefinementMode::BLOCK};
+    const QueuePolicy policies[] = {QueuePolicy::FIFO, QueuePolicy::LIFO, QueuePolicy::SMALLEST_FIRST};
+    for (uint32_t it = 0; it < 40; ++it) {
+        DFA dfa = random_dfa(1 + random_below(1000), 1 + random_below(4), (it % 2 == 0 ? 2 : 2 + random_below(4)));
+        dfa.set_acyclic_fast_path(false);
+        dfa.set_unary_fast_path(false);
+        const uint32_t expected_size = moore_size(dfa);
+        std::vector<DFA> results;
+        for (RefinementMode mode : modes) {
+            for (QueuePolicy policy : policies) {
+                DFA minimized = dfa;
+                minimized.set_refinement(mode, policy);
+                minimized.minimization(false);
+                expect(minimized.get_size() == expected_size, "every refinement mode and queue policy gives as many states as Moore's algorithm");
+                results.push_back(minimized);
+            }
+        }
+        for (const DFA& result : results) expect(result == results[0], "all refinement modes and queue policies give the same DFA");
+    }
+}
+
+static void check_dictionary_builder() {
+    for (uint32_t it = 0; it < 30; ++it) {
+        const uint32_t k = 1 + random_below(4);
+        std::set<std::vector<uint32_t> > words;
+        const uint32_t count = random_below(500);
+        for (uint32_t i = 0; i < count; ++i) words.insert(random_word(k, 12));
+
+        DictionaryBuilder builder(k);
+        for (const std::vector<uint32_t>& word : words) {
+            expect(builder.add_word(word) == 0, "sorted word is added");
+            if (random_below(10) == 0) expect(builder.add_word(word) == 0, "repeated word is added");
+        }
+        DFA dfa = builder.finish();
+        for (std::vector<uint32_t> word : words) expect(dfa.check_string(word), "dictionary accepts its words");
+        for (uint32_t w = 0; w < 200; ++w) {
+            std::vector<uint32_t> word = random_word(k, 12);
+            expect(dfa.check_string(word) == (words.count(word) != 0), "dictionary accepts only its words");
+        }
+        expect(dfa.get_size() == plain_minimized(dfa).get_size(), "dictionary DFA is minimal");
+
+        if (k >= 2) { // the branch of 0 was left, so 00 can't be added
+            DictionaryBuilder unsorted(k);
+            unsorted.add_word({0});
+            unsorted.add_word({1});
+            expect(unsorted.add_word({0, 0}) != 0, "word which goes back to a left branch is rejected");
+        }
+        DictionaryBuilder small(k);
+        expect(small.add_word({k}) != 0, "symbol out of the alphabet is rejected");
+    }
+}
+
+static void check_acyclic_fast_path() {
+    for (uint32_t it = 0; it < 50; ++it) {
+        // transitions go to bigger states or to the sink n - 1
+        const uint32_t n = 2 + random_below(2000), k = 1 + random_below(4), labels = (it % 2 == 0 ? 2 : 4);
+        std::vector<std::vector<uint32_t> > delta(k, std::vector<uint32_t>(n, n - 1));
+        for (uint32_t a = 0; a < k; ++a) {
+            for (uint32_t s = 0; s + 1 < n; ++s) {
+                if (random_below(3) != 0) delta[a][s] = s + 1 + random_below(std::min<uint32_t>(n - 1 - s, 20));
+            }
+        }
+        std::vector<uint32_t> state_labels(n);
+        for (uint32_t s = 0; s < n; ++s) state_labels[s] = (random_below(3) == 0 ? random_below(labels) : 0);
+        DFA dfa = make_dfa(k, 0, delta, state_labels, labels);
+        DFA fast = dfa;
+        fast.minimization(false);
+        expect(fast.get_iterations() == 0, "acyclic DFA is minimized by the fast path");
+        expect(fast == plain_minimized(dfa), "acyclic fast path gives the same DFA as Hopcroft");
+    }
+}
+
+static void check_unary_fast_path() {
+    for (uint32_t it = 0; it < 100; ++it) {
+        const uint32_t labels = (it % 2 == 0 ? 2 : 3);
+        if (it % 4 == 3) {
+            // random DFA with one symbol (unreachable states are trimmed before the fast path)
+            DFA dfa = random_dfa(1 + random_below(500), 1, labels);
+            DFA fast = dfa;
+            fast.minimization(false);
+            expect(fast.get_iterations() == 0, "unary DFA is minimized by the fast path");
+            expect(fast == plain_minimized(dfa), "unary fast path gives the same DFA as Hopcroft");
+            continue;
+        }
+        // lasso with periodic labels on the cycle, the end of the tail often follows the same pattern;
+        // states are numbered in random order
+        const uint32_t period = 1 + random_below(10), cycle = period * (1 + random_below(10));
+        const uint32_t tail = random_below(30), n = tail + cycle;
+        std::vector<uint32_t> pattern(period);
+        for (uint32_t i = 0; i < period; ++i) pattern[i] = random_below(labels);
+        std::vector<uint32_t> word(n);
+        for (uint32_t i = 0; i < cycle; ++i) word[tail + i] = pattern[i % period];
+        const uint32_t periodic_tail = random_below(tail + 1);
+        for (uint32_t i = 0; i < tail; ++i) {
+            word[i] = (i + periodic_tail >= tail ? pattern[(i + cycle - tail % cycle) % period] : random_below(labels));
+        }
+        std::vector<uint32_t> order(n);
+        for (uint32_t i = 0; i < n; ++i) order[i] = i;
+        std::shuffle(order.begin(), order.end(), rng);
+        std::vector<std::vector<uint32_t> > delta(1, std::vector<uint32_t>(n));
+        std::vector<uint32_t> state_labels(n);
+        for (uint32_t i = 0; i < n; ++i) {
+            delta[0][order[i]] = order[i + 1 < n ? i + 1 : tail];
+            state_labels[order[i]] = word[i];
+        }
+        DFA dfa = make_dfa(1, order[0], delta, state_labels, labels);
+        DFA fast = dfa;
+        fast.minimization(false);
+        expect(fast.get_iterations() == 0, "lasso is minimized by the fast path");
+        expect(fast == plain_minimized(dfa), "unary fast path gives the same DFA as Hopcroft on a lasso");
+    }
+}
+
+static void check_prepartition() {
+    for (uint32_t it = 0; it < 60; ++it) {
+        // small alphabets and labels give many equivalent states, so the pre-partition has something to merge
+        const uint32_t n = 1 + random_below(3000), k = 1 + random_below(3), labels = 2 + random_below(3);
+        DFA dfa = random_dfa(n, k, labels);
+        dfa.set_acyclic_fast_path(false);
+        dfa.set_unary_fast_path(false);
+        const DFA plain = plain_minimized(dfa);
+        for (uint32_t rounds = 1; rounds <= 4; ++rounds) {
+            DFA prepartitioned = dfa;
+            prepartitioned.set_prepartition(rounds);
+            prepartitioned.minimization(false);
+            expect(prepartitioned == plain, "pre-partition gives the same DFA as Hopcroft");
+        }
+    }
+}
+
+// matches of a random text fed by chunks of random length
+template <typename M>
+static std::vector<uint64_t> chunked_matches(M& matcher, const std::string& text, uint32_t seed) {
+    std::mt19937 chunks(seed);
+    std::vector<uint64_t> matches;
+    size_t begin = 0;
+    while (begin < text.size()) {
+        const size_t length = std::min<size_t>(text.size() - begin, chunks() % 100);
+        matcher.feed(text.data() + begin, length, [&](uint64_t x) { matches.push_back(x); });
+        begin += length;
+    }
+    return matches;
+}
+
+// random text over symbols '0', ..., '0' + k - 1, '\n' and 'x' (which isn't a symbol and is skipped)
+static std::string random_text(uint32_t k, uint32_t length) {
+    std::string text(length, '0');
+    for (char& c : text) {
+        const uint32_t r = random_below(k + 2);
+        c = (r < k ? (char)('0' + r) : (r == k ? '\n' : 'x'));
+    }
+    return text;
+}
+
+// DFA whose symbols are permutations of states: runs from different states never merge
+static DFA permutation_dfa(uint32_t n, uint32_t k) {
+    std::vector<std::vector<uint32_t> > delta(k, std::vector<uint32_t>(n));
+    for (uint32_t a = 0; a < k; ++a) {
+        for (uint32_t s = 0; s < n; ++s) delta[a][s] = s;
+        std::shuffle(delta[a].begin(), delta[a].end(), rng);
+    }
+    std::vector<bool> acc(n);
+    for (uint32_t s = 0; s < n; ++s) acc[s] = (random_below(10) == 0);
+    return DFA(k, n, 0, delta, acc);
+}
+
+static void check_parallel_scan() {
+    std::string path = temp_path("scan.txt");
+    for (uint32_t it = 0; it < 8; ++it) {
+        const uint32_t k = 1 + random_below(4);
+        // small DFAs merge the speculative runs fast, permutations make the simulation give up
+        DFA dfa = (it % 2 == 0 ? random_dfa(1 + random_below(50), k) : permutation_dfa(1000 + random_below(5000), k));
+        dfa.minimization(false);
+        const std::string text = random_text(k, 200000 + random_below(200000));
+        write_file(path, text);
+        for (MatchMode mode : {MatchMode::POSITIONS, MatchMode::LINES}) {
+            Matcher matcher(dfa, mode);
+            std::vector<uint64_t> expected;
+            matcher.feed(text.data(), text.size(), [&](uint64_t x) { expected.push_back(x); });
+            for (uint32_t threads : {1, 2, 3, 8}) {
+                std::vector<uint64_t> found;
+                expect(scan_file(matcher, path.c_str(), threads, [&](uint64_t x) { found.push_back(x); }) == 0, "file is scanned");
+                expect(found == expected, "parallel scan finds the same matches as Matcher::feed");
+            }
+        }
+    }
+    unlink(path.c_str());
+}
+
+static void check_multi_matcher() {
+    for (uint32_t it = 0; it < 20; ++it) {
+        // DFAs with different alphabets, so bytes are split into several classes
+        std::vector<DFA> dfas;
+        const uint32_t count = 1 + random_below(20);
+        for (uint32_t i = 0; i < count; ++i) {
+            DFA dfa = random_dfa(1 + random_below(100), 1 + random_below(4));
+            dfa.minimization(false);
+            dfas.push_back(dfa);
+        }
+        const std::string text = random_text(4, 1 + random_below(5000));
+        std::vector<std::vector<uint64_t> > expected(count), found(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            Matcher matcher(dfas[i], MatchMode::POSITIONS);
+            matcher.feed(text.data(), text.size(), [&](uint64_t x) { expected[i].push_back(x); });
+        }
+        MultiMatcher multi_matcher(dfas);
+        multi_matcher.feed(text.data(), text.size(), [&](uint32_t idx, uint64_t x) { found[idx].push_back(x); });
+        expect(found == expected, "MultiMatcher finds the same matches as Matcher of every DFA");
+    }
+}
+
+static void check_lazy_matcher() {
+    uint64_t flushes = 0, simulated = 0;
+    for (uint32_t it = 0; it < 40; ++it) {
+        const uint32_t n = 1 + random_below(12), k = 1 + random_below(4);
+        NFA nfa = random_nfa(n, k);
+        DFA dfa = nfa.convert2dfa();
+        const std::string text = random_text(k, 1 + random_below(5000));
+        for (MatchMode mode : {MatchMode::POSITIONS, MatchMode::LINES}) {
+            Matcher matcher(dfa, mode);
+            const std::vector<uint64_t> expected = chunked_matches(matcher, text, it);
+            // the smallest cache (2 states) is flushed all the time and falls back to simulation
+            for (uint64_t memory_limit : {(uint64_t)0, (uint64_t)1 << 20}) {
+                LazyMatcher lazy(nfa, mode, memory_limit);
+                expect(chunked_matches(lazy, text, it + 1) == expected, "LazyMatcher finds the same matches as Matcher");
+                expect(lazy.accepted() == matcher.accepted(), "LazyMatcher ends in the same state as Matcher");
+                flushes += lazy.get_stats().flushes;
+                simulated += lazy.get_stats().simulated;
+            }
+        }
+    }
+    expect(flushes > 0 && simulated > 0, "small cache of LazyMatcher is flushed and simulation is used");
+}
+
+static void check_compiled_dfa() {
+    std::string path = temp_path("compiled.cmp");
+    for (uint32_t it = 0; it < 30; ++it) {
+        const uint32_t k = 1 + random_below(6);
+        DFA dfa = random_dfa(1 + random_below(1000), k);
+        if (it % 2 == 0) dfa.minimization(false);
+        CompiledDFA compiled(dfa);
+        expect(compiled.ok(), "small DFA is compiled");
+        expect(compiled.save(path.c_str()) == 0, "CompiledDFA is saved");
+        CompiledDFA loaded;
+        expect(loaded.load(path.c_str()) == 0, "saved CompiledDFA is loaded");
+        for (uint32_t w = 0; w < 200; ++w) {
+            std::vector<uint32_t> word = random_word(k, 50);
+            const bool expected = dfa.check_string(word);
+            expect(compiled.check_string(word) == expected, "CompiledDFA accepts the same words as DFA");
+            expect(loaded.check_string(word) == expected, "loaded CompiledDFA accepts the same words as DFA");
+        }
+
+        // a cell out of the table, odd stride, truncated file; loaded must stay as it was
+        const std::string data = read_file(path);
+        std::string damaged = data;
+        const uint32_t far_cell = UINT32_MAX - 1;
+        memcpy(&damaged[4 * sizeof(uint32_t) + random_below((uint32_t)(data.size() / 4 - 4)) * 4], &far_cell, sizeof(far_cell));
+        write_file(path, damaged);
+        expect(loaded.load(path.c_str()) != 0, "cell out of the table is rejected");
+        damaged = data;
+        damaged[4] ^= 1;
+        write_file(path, damaged);
+        expect(loaded.load(path.c_str()) != 0, "odd stride is rejected");
+        write_file(path, data.substr(0, data.size() - 1 - random_below((uint32_t)data.size())));
+        expect(loaded.load(path.c_str()) != 0, "truncated file is rejected");
+        std::vector<uint32_t> word = random_word(k, 50);
+        expect(loaded.check_string(word) == dfa.check_string(word), "failed load doesn't change CompiledDFA");
+    }
+    CompiledDFA empty;
+    expect(!empty.ok() && empty.save(path.c_str()) != 0, "empty CompiledDFA isn't saved");
+    unlink(path.c_str());
+}
+
+static void check_minimization_step() {
+    uint32_t paused = 0;
+    for (uint32_t it = 0; it < 30; ++it) {
+        DFA dfa = random_dfa(100 + random_below(3000), 2 + random_below(3), (it % 3 == 0 ? 4 : 2));
+        const DFA expected = plain_minimized(dfa);
+        const bool arena = (it % 2 == 0);
+
+        // small slices until it is done
+        DFA stepped = dfa;
+        stepped.set_arena_mode(arena);
+        MinimizationStatus status;
+        while ((status = stepped.minimization_step({0, 1 + random_below(20)})) == MinimizationStatus::PAUSED) ++paused;
+        expect(status == MinimizationStatus::DONE && stepped == expected, "minimization by steps gives the same DFA as Hopcroft");
+
+        // a paused DFA is copied (the copy goes on alone), cancelled and minimized again, assigned and destroyed
+        DFA original = dfa;
+        original.set_arena_mode(arena);
+        if (original.minimization_step({0, 1}) != MinimizationStatus::PAUSED) continue;
+        DFA copy = original;
+        while (copy.minimization_step({0, 50}) == MinimizationStatus::PAUSED) {}
+        expect(copy == expected, "copy of paused DFA is minimized correctly");
+        original.cancel_minimization();
+        expect(original.get_minimization_progress().blocks == 0, "cancelled minimization is dropped");
+        expect(original.minimization_step({0, 1}) == MinimizationStatus::PAUSED, "minimization starts again after cancel");
+        std::atomic<bool> cancel(true);
+        expect(original.minimization_step({0, 0}, nullptr, &cancel) == MinimizationStatus::CANCELLED, "minimization is cancelled by the flag");
+        original.minimization_step({0, 1});
+        original = dfa; // replaces the paused DFA
+        original.minimization(false);
+        expect(original == expected, "paused DFA is replaced by assignment");
+        std::unique_ptr<DFA> destroyed(new DFA(dfa));
+        destroyed->set_arena_mode(arena);
+        destroyed->minimization_step({0, 1});
+        destroyed.reset(); // paused DFA is destroyed
+    }
+    expect(paused > 0, "minimization_step pauses");
+}
+
+static void check_arena_mode() {
+    for (uint32_t it = 0; it < 20; ++it) {
+        DFA dfa = random_dfa(1 + random_below(5000), 1 + random_below(4), (it % 3 == 0 ? 3 : 2));
+        DFA in_arena = dfa;
+        in_arena.set_arena_mode(true);
+        in_arena.set_refinement(it % 2 == 0 ? RefinementMode::SYMBOL : RefinementMode::BLOCK, QueuePolicy::FIFO);
+        in_arena.minimization(false);
+        expect(in_arena == plain_minimized(dfa), "minimization in arena mode gives the same DFA as Hopcroft");
+        for (uint32_t w = 0; w < 20; ++w) { // tables of the result don't live in the freed arena
+            std::vector<uint32_t> word = random_word(dfa.get_alphabet_length(), 30);
+            expect(in_arena.check_string(word) == dfa.check_string(word), "DFA minimized in arena mode keeps the language");
+        }
+    }
+
+    // tables cut from an installed arena are owned by it, deallocation leaves them there
+    TableArena arena;
+    set_table_arena(&arena);
+    table_vector<uint32_t> table(1000, 7);
+    set_table_arena(nullptr);
+    expect(arena.owns(table.data()) && arena.reserved() >= 1000 * sizeof(uint32_t), "table is cut from the arena");
+    set_table_arena(&arena);
+    table_vector<uint32_t>().swap(table);
+    set_table_arena(nullptr);
+    table_vector<uint32_t> heap_table(1000, 7);
+    expect(!arena.owns(heap_table.data()), "table without arena is in the heap");
+}
+
+static void check_renumbering() {
+    for (uint32_t it = 0; it < 30; ++it) {
+        const uint32_t k = 1 + random_below(4);
+        DFA dfa = random_dfa(1 + random_below(2000), k, (it % 3 == 0 ? 3 : 2));
+        if (it % 2 == 0) dfa.minimization(false);
+        const DFA expected = plain_minimized(dfa);
+        std::vector<std::vector<uint32_t> > samples;
+        for (uint32_t w = 0; w < 100; ++w) samples.push_back(random_word(k, 30));
+        for (StateOrder order : {StateOrder::BFS, StateOrder::DFS, StateOrder::HOTNESS}) {
+            DFA renumbered = dfa;
+            renumbered.renumber_states(order, samples);
+            expect(renumbered.get_size() == dfa.get_size(), "renumbering keeps all states");
+            expect(renumbered.get_starting_node() < renumbered.get_size(), "starting node is a state after renumbering");
+            if (order != StateOrder::HOTNESS) expect(renumbered.get_starting_node() == 0, "BFS and DFS start from state 0");
+            for (uint32_t w = 0; w < 100; ++w) {
+                std::vector<uint32_t> word = random_word(k, 30);
+                expect(renumbered.classify_string(word) == dfa.classify_string(word), "renumbering keeps the language");
+            }
+            renumbered.minimization(false);
+            expect(renumbered == plain_minimized(dfa), "renumbered DFA is minimized to the same DFA");
+        }
+    }
+}
+
+// reply of the server to one request ("" if it can't be reached)
+static std::string ask(const std::string& socket_path, const std::string& request) {
+    std::string reply;
+    if (ask_server(socket_path.c_str(), request, reply) != 0) return "";
+    return reply;
+}
+
+static bool starts_with(const std::string& s, const std::string& prefix) {
+    return s.compare(0, prefix.size(), prefix) == 0;
+}
+
+static void check_server() {
+    const std::string socket_path = temp_path("server.sock");
+    const std::string first_path = temp_path("first.bin"), second_path = temp_path("second.bin"), third_path = temp_path("third.bin");
+    const uint32_t k = 2;
+    DFA first = random_dfa(2000, k);
+    DFA second = plain_minimized(first), third = random_dfa(3000, k);
+    first.save_to_file((char*)first_path.c_str());
+    second.save_to_file((char*)second_path.c_str());
+    third.save_to_file((char*)third_path.c_str());
+
+    // the minimized first and the second DFA fit in the cache together, the third one doesn't fit with them
+    DFAServer server(socket_path.c_str(), 2, 2 * dfa_memory(second) + 100);
+    int result = -1;
+    std::thread serving([&server, &result]() { result = server.run(); });
+    std::string reply;
+    for (uint32_t attempt = 0; attempt < 500 && (reply = ask(socket_path, "stats")).empty(); ++attempt) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    expect(starts_with(reply, "ok 0 DFAs"), "server answers: " + reply);
+
+    expect(starts_with(ask(socket_path, "load a from_bin_file " + first_path), "ok a loaded, 2000 states"), "DFA is loaded by the server");
+    expect(starts_with(ask(socket_path, "load a from_bin_file " + first_path), "ok a cached"), "the same file is taken from the cache");
+    for (uint32_t w = 0; w < 50; ++w) {
+        std::vector<uint32_t> word = random_word(k, 20);
+        std::string text;
+        for (uint32_t c : word) text += (char)('0' + c);
+        expect(ask(socket_path, "match a " + text) == (first.check_string(word) ? "ok accepted" : "ok rejected"), "server matches like check_string");
+    }
+    expect(starts_with(ask(socket_path, "minimize a"), "ok a " + std::to_string(second.get_size()) + " states"), "server minimizes DFA");
+    expect(starts_with(ask(socket_path, "load b from_bin_file " + second_path), "ok b loaded"), "second DFA is loaded");
+    expect(ask(socket_path, "compare a b") == "ok equal", "equivalent DFAs are equal");
+    expect(starts_with(ask(socket_path, "load c from_bin_file " + third_path), "ok c loaded"), "third DFA is loaded");
+    expect(ask(socket_path, "match a") == "error no DFA a", "the least recently used DFA is evicted");
+    expect(ask(socket_path, "stats").find(" 0 evictions") == std::string::npos, "evictions are counted");
+    expect(starts_with(ask(socket_path, "match c 0101"), "ok "), "the last loaded DFA is kept");
+    expect(starts_with(ask(socket_path, "load d from_bin_file " + temp_path("missing.bin")), "error"), "missing file gives an error");
+    expect(ask(socket_path, "match d") == "error no DFA d", "failed load isn't cached");
+    expect(ask(socket_path, "shutdown") == "ok", "server is shut down");
+    serving.join();
+    expect(result == 0, "server stops after shutdown");
+
+    unlink(first_path.c_str());
+    unlink(second_path.c_str());
+    unlink(third_path.c_str());
+}
+
+static int run_checks() {
+    check_external_minimization();
+    check_products();
+    check_inclusion();
+    check_text_format();
+    check_packed_format();
+    check_trimming();
+    check_labels();
+    check_refinement_policies();
+    check_dictionary_builder();
+    check_acyclic_fast_path();
+    check_unary_fast_path();
+    check_prepartition();
+    check_parallel_scan();
+    check_multi_matcher();
+    check_lazy_matcher();
+    check_compiled_dfa();
+    check_minimization_step();
+    check_arena_mode();
+    check_renumbering();
+    check_server();
+    if (failures == 0) std::cout << "all checks passed\n";
+    else std::cout << failures << " checks failed\n";
+    return (failures == 0 ? 0 : 1);
+}
 
 int main(int argc, char *argv[]) {
+    if (argc == 1) return run_checks();
     if (argc != 5) {
-        std::cout << "argc must be 5!\n";
+        std::cout << "argc must be 5 (or 1 for self-checks)!\n";
         return 0;
     }
 